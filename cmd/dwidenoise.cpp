@@ -233,6 +233,7 @@ void run ()
 
   DenoisingFunctor< Image<value_type> > func (dwi_in, extent, mask, noise);
   ThreadedLoop ("running MP-PCA denoising", dwi_in, 0, 3)
+    .tiled()
     .run (func, dwi_in, dwi_out);
 }
 
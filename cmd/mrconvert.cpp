@@ -21,6 +21,7 @@
 #include "adapter/extract.h"
 #include "adapter/permute_axes.h"
 #include "file/json_utils.h"
+#include "file/mmap.h"
 #include "file/ofstream.h"
 #include "dwi/gradient.h"
 
@@ -257,6 +258,8 @@ inline void copy_permute (Header& header_in, Header& header_out, const vector<ve
 
 void run ()
 {
+  File::MMap::set_default_access (File::MMap::Access::Sequential);
+
   Header header_in = Header::open (argument[0]);
 
   Header header_out (header_in);
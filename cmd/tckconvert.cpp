@@ -36,6 +36,7 @@ void usage ()
 
   DESCRIPTION
   + "The program currently supports MRtrix .tck files (input/output), "
+    "MRtrix quantised track files with the .tcq suffix (input/output), "
     "ascii text files (input/output), VTK polydata files (input/output), "
     "and RenderMan RIB (export only)."
 
@@ -614,7 +615,7 @@ void run ()
     // Reader
     Properties properties;
     std::unique_ptr<ReaderInterface<float> > reader;
-    if (has_suffix(argument[0], ".tck")) {
+    if (has_suffix(argument[0], ".tck") || has_suffix(argument[0], ".tcq")) {
         reader.reset( new Reader<float>(argument[0], properties) );
     }
     else if (has_suffix(argument[0], ".txt")) {
@@ -630,7 +631,7 @@ void run ()
 
     // Writer
     std::unique_ptr<WriterInterface<float> > writer;
-    if (has_suffix(argument[1], ".tck")) {
+    if (has_suffix(argument[1], ".tck") || has_suffix(argument[1], ".tcq")) {
         writer.reset( new Writer<float>(argument[1], properties) );
     }
     else if (has_suffix(argument[1], ".vtk")) {
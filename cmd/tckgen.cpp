@@ -14,6 +14,7 @@
 
 #include "command.h"
 #include "image.h"
+#include "file/mmap.h"
 
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/roi.h"
@@ -184,7 +185,7 @@ void usage ()
         "The image containing the source data. "
         "The type of image data required depends on the algorithm used (see Description section).").type_image_in()
 
-    + Argument ("tracks", "the output file containing the tracks generated.").type_tracks_out();
+    + Argument ("tracks", "the output file containing the tracks generated.").type_tracks_out().append_on_resume();
 
 
 
@@ -218,6 +219,9 @@ void run ()
   using namespace DWI::Tractography::Tracking;
   using namespace DWI::Tractography::Algorithms;
 
+  // image data are sampled at arbitrary locations as streamlines propagate:
+  File::MMap::set_default_access (File::MMap::Access::Random);
+
   Properties properties;
 
   int algorithm = 2; // default = ifod2
@@ -237,8 +241,12 @@ void run ()
   // By over-riding the values in properties, the progress bar should still be valid
   if (properties.seeds.is_finite()) {
 
-    if (properties["max_num_tracks"].size())
+    if (properties["max_num_tracks"].size()) {
+      // in shard mode, the number of streamlines is determined by the number of seeds:
+      if (properties.find ("shard") != properties.end())
+        throw Exception ("The -select option cannot be used in conjunction with the -shard option");
       WARN ("Overriding -select option (desired number of successful streamline selections), as seeds can only provide a finite number");
+    }
     properties["max_num_tracks"] = str (properties.seeds.get_total_count());
 
     if (properties["max_num_seeds"].size())
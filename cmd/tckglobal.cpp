@@ -23,6 +23,7 @@
 
 #include "dwi/tractography/GT/particlegrid.h"
 #include "dwi/tractography/GT/gt.h"
+#include "dwi/tractography/GT/checkpoint.h"
 #include "dwi/tractography/GT/externalenergy.h"
 #include "dwi/tractography/GT/internalenergy.h"
 #include "dwi/tractography/GT/mhsampler.h"
@@ -156,8 +157,19 @@ void usage ()
   + Option ("eext", "Residual external energy in every voxel.")
     + Argument ("eext").type_image_out()
 
-  + Option ("etrend", "internal and external energy trend and cooling statistics.")
-    + Argument ("stats").type_file_out()
+  + Option ("etrend", "internal and external energy trend and cooling statistics. "
+            "Each line holds 9 comma-separated values: the temperature, the total external and internal energy, "
+            "the acceptance rates of the birth, death, random shift, optimal shift and connect proposals, "
+            "and the mean no. proposals per second (this last column is not written by older versions).")
+    + Argument ("stats").type_file_out().append_on_resume()
+
+  + Option ("checkpoint", "periodically save the particle configuration and the state of the optimizer "
+            "to the specified file, so that an interrupted run can be continued using the -resume option "
+            "(the interval can be set using the TckglobalCheckpointInterval config file option).")
+    + Argument ("path").type_file_out().append_on_resume()
+
+  + Option ("resume", "continue the optimization from the state saved in the file provided with the "
+            "-checkpoint option. All other parameters must be identical to those of the interrupted run.")
 
 
   + OptionGroup("Advanced parameters, if you really know what you're doing")
@@ -296,10 +308,15 @@ void run ()
   
   INFO("Initialise data structures for global tractography.");
   
+  const bool resume = get_options("resume").size();
+  auto checkpoint_opt = get_options("checkpoint");
+  if (resume && !checkpoint_opt.size())
+    throw Exception("-resume option requires the checkpoint file to be provided using the -checkpoint option");
+
   Stats stats (t0, t1, niter);
   opt = get_options("etrend");
   if (opt.size())
-    stats.open_stream(opt[0][0]);
+    stats.open_stream(opt[0][0], resume);
   
   ParticleGrid pgrid (dwi);
   
@@ -309,16 +326,25 @@ void run ()
   EnergySumComputer* Esum = new EnergySumComputer(stats, Eint, properties.lam_int, Eext, properties.lam_ext / ( wmscale2 * properties.weight*properties.weight));
   
   MHSampler mhs (dwi, properties, stats, pgrid, Esum, mask);   // All EnergyComputers are recursively destroyed upon destruction of mhs, except for the shared data.
+
+  if (checkpoint_opt.size()) {
+    auto checkpoint = std::make_shared<Checkpoint>(checkpoint_opt[0][0], stats, pgrid);
+    if (resume)
+      checkpoint->load(Esum);
+    mhs.setCheckpoint(checkpoint);
+  }
   
   
   INFO("Start MH sampler");
   
+  stats.startTimer();
   auto t = Thread::run (Thread::multi(mhs), "MH sampler");
   t.wait();
   
   INFO("Final no. particles: " + std::to_string(pgrid.getTotalCount()));
   INFO("Final external energy: " + std::to_string(stats.getEextTotal()));
   INFO("Final internal energy: " + std::to_string(stats.getEintTotal()));
+  INFO("Mean no. proposals per second: " + std::to_string(stats.getProposalRate()));
   
   
   // Copy results to output buffers -----------------------------------------------------
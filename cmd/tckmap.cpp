@@ -142,7 +142,15 @@ const OptionGroup MappingOption = OptionGroup ("Options for the streamline-to-vo
       "(these lengths are then taken into account during TWI calculation)")
 
   + Option ("ends_only",
-      "only map the streamline endpoints to the image");
+      "only map the streamline endpoints to the image")
+
+  + Option ("partial_maps",
+      "accumulate the streamlines mapped within each thread in a separate buffer, and combine these "
+      "buffers once all streamlines have been mapped; this avoids the thread writing to the output "
+      "image becoming a bottleneck (e.g. for TOD or high-resolution TDI mapping), at the expense of "
+      "additional memory usage. Each buffer holds either the complete output image, or only those "
+      "voxels traversed by streamlines, depending on the size of the output image relative to the "
+      "TckmapPartialDenseLimit config file option.");
 
 
 
@@ -242,6 +250,49 @@ MapWriterBase* make_writer (Header& H, const std::string& name, const vox_stat_t
 
 
 
+// Map streamlines and accumulate the result within each thread (-partial_maps option)
+template <class MapperType, class SetType>
+class MapAndAccumulate
+{ MEMALIGN(MapAndAccumulate<MapperType,SetType>)
+  public:
+    MapAndAccumulate (const MapperType& mapper, MapWriterBase& writer) :
+        mapper (mapper),
+        writer (writer),
+        partial (writer.create_partial()) { }
+
+    MapAndAccumulate (const MapAndAccumulate& that) :
+        mapper (that.mapper),
+        writer (that.writer),
+        partial (writer.create_partial()) { }
+
+    bool operator() (Tractography::Streamline<float>& in)
+    {
+      mapper (in, set);
+      return partial (set);
+    }
+
+  private:
+    MapperType mapper;
+    MapWriterBase& writer;
+    MapWriterBase& partial;
+    SetType set;
+};
+
+
+template <class MapperType, class SetType>
+void map_partial (TrackLoader& loader, const MapperType& mapper, MapWriterBase& writer)
+{
+  MapAndAccumulate<MapperType, SetType> accumulator (mapper, writer);
+  Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (accumulator));
+}
+
+
+
+
+
+
+
+
 DataType determine_datatype (const DataType current_dt, const contrast_t contrast, const DataType default_dt, const bool precise)
 {
   if (current_dt == DataType::Undefined) {
@@ -588,18 +639,38 @@ void run () {
     case TOD:       writer.reset (new MapWriter<float>  (header, argument[1], stat_vox, TOD));       break;
   }
 
+  const bool partial_maps = get_options ("partial_maps").size();
+
   // Finally get to do some number crunching!
   // Complete branch here for Gaussian track-wise statistic; it's a nightmare to manage, so am
   //   keeping the code as separate as possible
   if (stat_tck == GAUSSIAN) {
     Gaussian::TrackMapper* const mapper_ptr = dynamic_cast<Gaussian::TrackMapper*>(mapper.get());
     mapper_ptr->set_gaussian_FWHM (gaussian_fwhm_tck);
+    if (partial_maps) {
+      switch (writer_type) {
+        case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
+        case GREYSCALE: map_partial<Gaussian::TrackMapper, Gaussian::SetVoxel>    (loader, *mapper_ptr, *writer); break;
+        case DEC:       map_partial<Gaussian::TrackMapper, Gaussian::SetVoxelDEC> (loader, *mapper_ptr, *writer); break;
+        case DIXEL:     map_partial<Gaussian::TrackMapper, Gaussian::SetDixel>    (loader, *mapper_ptr, *writer); break;
+        case TOD:       map_partial<Gaussian::TrackMapper, Gaussian::SetVoxelTOD> (loader, *mapper_ptr, *writer); break;
+      }
+    } else {
+      switch (writer_type) {
+        case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
+        case GREYSCALE: Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxel()),    *writer); break;
+        case DEC:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelDEC()), *writer); break;
+        case DIXEL:     Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetDixel()),    *writer); break;
+        case TOD:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelTOD()), *writer); break;
+      }
+    }
+  } else if (partial_maps) {
     switch (writer_type) {
       case UNDEFINED: throw Exception ("Invalid TWI writer image dimensionality");
-      case GREYSCALE: Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxel()),    *writer); break;
-      case DEC:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelDEC()), *writer); break;
-      case DIXEL:     Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetDixel()),    *writer); break;
-      case TOD:       Thread::run_queue (loader, Thread::batch (Tractography::Streamline<float>()), Thread::multi (*mapper_ptr), Thread::batch (Gaussian::SetVoxelTOD()), *writer); break;
+      case GREYSCALE: map_partial<TrackMapperTWI, SetVoxel>    (loader, *mapper, *writer); break;
+      case DEC:       map_partial<TrackMapperTWI, SetVoxelDEC> (loader, *mapper, *writer); break;
+      case DIXEL:     map_partial<TrackMapperTWI, SetDixel>    (loader, *mapper, *writer); break;
+      case TOD:       map_partial<TrackMapperTWI, SetVoxelTOD> (loader, *mapper, *writer); break;
     }
   } else {
     switch (writer_type) {
@@ -0,0 +1,214 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <fstream>
+#include <map>
+
+#include "command.h"
+#include "progressbar.h"
+#include "file/key_value.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "dwi/tractography/file.h"
+#include "dwi/tractography/properties.h"
+#include "dwi/tractography/scalar_file.h"
+
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+
+#define STATISTICS_FILE_FIRST_LINE "mrtrix tracking statistics"
+#define SEEDS_FILE_FIRST_LINE "#Track_index,"
+
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Combine the outputs of a tckgen run split into shards using the -shard option";
+
+  DESCRIPTION
+  + "The input files must be provided in order of shard index (i.e. the output of "
+    "'-shard 0/N' first), and must all be of the same type. This can be a track file (.tck), "
+    "a track scalar file (.tsf), a seeds file as written by the tckgen -output_seeds option, "
+    "or a statistics file as written by the tckgen -output_stats option. The type of the "
+    "input files is determined from the suffix of the output file for track and track "
+    "scalar files, and from the contents of the first input file otherwise."
+
+  + "Track and track scalar files are concatenated, and the numbers of streamlines "
+    "listed in the header are summed; the streamline indices listed in seeds files are "
+    "offset accordingly, and the counts listed in statistics files are summed. The output "
+    "of tckgen with the option -shard 0/1 is therefore reproduced exactly, other than the "
+    "timestamp and the names of any additional output files listed in the header.";
+
+  ARGUMENTS
+  + Argument ("input", "the outputs of each shard, in order of shard index").type_file_in().allow_multiple()
+  + Argument ("output", "the combined output file").type_file_out();
+}
+
+
+
+// verify that the inputs correspond to the complete set of shards, in order:
+void check_shard (Properties& properties, const std::string& path, const size_t index, const size_t num_inputs)
+{
+  const auto p = properties.find ("shard");
+  if (p == properties.end()) {
+    if (num_inputs > 1)
+      WARN ("file \"" + path + "\" does not appear to have been generated using the -shard option");
+    return;
+  }
+  if (p->second != str(index) + "/" + str(num_inputs))
+    throw Exception ("file \"" + path + "\" contains shard " + p->second + "; expected shard "
+                     + str(index) + "/" + str(num_inputs) + " (inputs must be provided in order of shard index)");
+  properties.erase (p);
+}
+
+
+
+size_t count_total (const Properties& properties)
+{
+  const auto p = properties.find ("total_count");
+  return p == properties.end() ? 0 : to<size_t> (p->second);
+}
+
+
+
+void merge_tracks (const vector<std::string>& inputs, const std::string& output)
+{
+  std::unique_ptr<Writer<float>> writer;
+  size_t total_count = 0;
+  ProgressBar progress ("merging track files", inputs.size());
+  for (size_t n = 0; n != inputs.size(); ++n) {
+    Properties properties;
+    Reader<float> reader (inputs[n], properties);
+    check_shard (properties, inputs[n], n, inputs.size());
+    total_count += count_total (properties);
+    if (!writer)
+      writer.reset (new Writer<float> (output, properties));
+    Streamline<float> tck;
+    while (reader (tck))
+      (*writer) (tck);
+    ++progress;
+  }
+  writer->total_count = std::max (size_t (writer->total_count), total_count);
+}
+
+
+
+void merge_scalars (const vector<std::string>& inputs, const std::string& output)
+{
+  std::unique_ptr<ScalarWriter<float>> writer;
+  size_t total_count = 0;
+  ProgressBar progress ("merging track scalar files", inputs.size());
+  for (size_t n = 0; n != inputs.size(); ++n) {
+    Properties properties;
+    ScalarReader<float> reader (inputs[n], properties);
+    check_shard (properties, inputs[n], n, inputs.size());
+    total_count += count_total (properties);
+    if (!writer)
+      writer.reset (new ScalarWriter<float> (output, properties));
+    vector<float> scalars;
+    while (reader (scalars))
+      (*writer) (scalars);
+    ++progress;
+  }
+  writer->total_count = std::max (size_t (writer->total_count), total_count);
+}
+
+
+
+void merge_seeds (const vector<std::string>& inputs, const std::string& output)
+{
+  File::OFStream out (output);
+  out << SEEDS_FILE_FIRST_LINE << "Seed_index,Pos_x,Pos_y,Pos_z,\n";
+  size_t offset = 0;
+  for (const auto& path : inputs) {
+    std::ifstream in (path);
+    if (!in)
+      throw Exception ("error opening seeds file \"" + path + "\": " + strerror (errno));
+    std::string line;
+    std::getline (in, line);
+    if (line.compare (0, strlen (SEEDS_FILE_FIRST_LINE), SEEDS_FILE_FIRST_LINE))
+      throw Exception ("file \"" + path + "\" is not a tckgen seeds file");
+    size_t count = 0;
+    while (std::getline (in, line)) {
+      if (line.empty())
+        continue;
+      const size_t comma = line.find (',');
+      if (comma == std::string::npos)
+        throw Exception ("malformed entry \"" + line + "\" in seeds file \"" + path + "\"");
+      const size_t index = to<size_t> (line.substr (0, comma));
+      out << str(index + offset) << line.substr (comma) << "\n";
+      count = std::max (count, index + 1);
+    }
+    offset += count;
+  }
+  out << "\n";
+}
+
+
+
+void merge_statistics (const vector<std::string>& inputs, const std::string& output)
+{
+  vector<std::pair<std::string, size_t>> counts;
+  for (const auto& path : inputs) {
+    File::KeyValue kv (path, STATISTICS_FILE_FIRST_LINE);
+    size_t n = 0;
+    while (kv.next()) {
+      if (n == counts.size())
+        counts.push_back (std::make_pair (kv.key(), size_t(0)));
+      else if (counts[n].first != kv.key())
+        throw Exception ("mismatched entries in statistics file \"" + path + "\"");
+      counts[n++].second += to<size_t> (kv.value());
+    }
+    if (n != counts.size())
+      throw Exception ("mismatched entries in statistics file \"" + path + "\"");
+  }
+  File::OFStream out (output);
+  out << STATISTICS_FILE_FIRST_LINE << "\n";
+  for (const auto& i : counts)
+    out << i.first << ": " << i.second << "\n";
+  out << "END\n";
+}
+
+
+
+void run ()
+{
+  vector<std::string> inputs;
+  for (size_t n = 0; n + 1 < argument.size(); ++n)
+    inputs.push_back (argument[n]);
+  const std::string output = argument.back();
+
+  if (Path::has_suffix (output, ".tck")) {
+    merge_tracks (inputs, output);
+  } else if (Path::has_suffix (output, ".tsf")) {
+    merge_scalars (inputs, output);
+  } else {
+    std::ifstream in (inputs[0]);
+    if (!in)
+      throw Exception ("error opening file \"" + inputs[0] + "\": " + strerror (errno));
+    std::string line;
+    std::getline (in, line);
+    if (!line.compare (0, strlen (SEEDS_FILE_FIRST_LINE), SEEDS_FILE_FIRST_LINE))
+      merge_seeds (inputs, output);
+    else if (!line.compare (0, strlen (STATISTICS_FILE_FIRST_LINE), STATISTICS_FILE_FIRST_LINE))
+      merge_statistics (inputs, output);
+    else
+      throw Exception ("unable to determine type of file \"" + inputs[0] + "\"");
+  }
+}
+
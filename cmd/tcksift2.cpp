@@ -145,7 +145,7 @@ void run ()
   if (get_options("max_factor").size() && get_options("max_coeff").size())
     throw Exception ("Options -max_factor and -max_coeff are mutually exclusive");
 
-  if (Path::has_suffix (argument[2], ".tck"))
+  if (Path::has_suffix (argument[2], ".tck") || Path::has_suffix (argument[2], ".tcq"))
     throw Exception ("Output of tcksift2 command should be a text file, not a tracks file");
 
   auto in_dwi = Image<float>::open (argument[1]);
@@ -15,6 +15,8 @@
 #ifndef __algo_threaded_loop_h__
 #define __algo_threaded_loop_h__
 
+#include <atomic>
+
 #include "debug.h"
 #include "algo/loop.h"
 #include "algo/iterator.h"
@@ -229,6 +231,31 @@ namespace MR
    * invocation - the functor will need to then implement looping over the
    * inner axes from the position provided in the `Iterator`. 
    *
+   * \section threaded_loop_tiled Tiled looping
+   *
+   * By default, threads obtain their next position along the outer axes one
+   * at a time, and loop over the entire extent of the inner axes from there.
+   * For functors that access a neighbourhood around each voxel (e.g.
+   * filtering or patch-based operations), it can be more efficient for each
+   * thread to process compact bricks of the image instead, so that the data
+   * in the neighbourhood of the current voxel are still in cache from the
+   * processing of its neighbours. This can be requested by invoking the
+   * tiled() method prior to run():
+   * \code
+   * ThreadedLoop ("filtering image...", in, 0, 3)
+   *     .tiled ({ 16, 16, 16 })
+   *     .run (MyNeighbourhoodFunctor (in), in, out);
+   * \endcode
+   * The tile dimensions apply to the axes in the order in which they are
+   * looped over (innermost first), and default to 16 voxels along each of
+   * the first three axes; any remaining axes are processed one position at a
+   * time. Bricks are handed out to threads in runs of consecutive (and hence
+   * neighbouring) bricks, with the length of each run proportional to the
+   * amount of work remaining, so that contention is low at the start of the
+   * loop, while the load remains balanced towards the end. The functor is
+   * invoked exactly as for the regular run() method. Note that the order in
+   * which voxels are processed is different from that of the regular loop.
+   *
    * \sa Loop
    * \sa Thread::run()
    * \sa thread_queue
@@ -302,11 +329,91 @@ namespace MR
       };
 
 
+    // loop over all voxels within the brick extending from \a from to \a to
+    // (exclusive) along the \a axes provided, invoking \a call() for each:
+    template <class VoxType, class CallType>
+      FORCE_INLINE void loop_over_tile (VoxType& vox, const vector<size_t>& axes,
+          const vector<ssize_t>& from, const vector<ssize_t>& to, CallType&& call)
+      {
+        for (size_t n = 0; n < axes.size(); ++n)
+          apply (set_pos (axes[n], from[n]), vox);
+        const size_t axis0 = axes[0];
+        while (true) {
+          for (ssize_t i = from[0]; i < to[0]; ++i) {
+            call();
+            apply (inc_pos (axis0), vox);
+          }
+          apply (set_pos (axis0, from[0]), vox);
+          size_t n = 1;
+          for (; n < axes.size(); ++n) {
+            apply (inc_pos (axes[n]), vox);
+            if (std::get<0>(vox).index (axes[n]) < to[n])
+              break;
+            apply (set_pos (axes[n], from[n]), vox);
+          }
+          if (n == axes.size())
+            return;
+        }
+      }
+
+
+    template <int N, class Functor, class... ImageType>
+      struct ThreadedLoopRunTile
+      { MEMALIGN(ThreadedLoopRunTile<N,Functor,ImageType...>)
+        const vector<size_t>& axes;
+        typename std::remove_reference<Functor>::type func;
+        std::tuple<ImageType...> vox;
+
+        ThreadedLoopRunTile (const vector<size_t>& axes, const Iterator& /*iterator*/,
+            const Functor& functor, ImageType&... voxels) :
+          axes (axes),
+          func (functor),
+          vox (voxels...) { }
+
+        void operator() (const vector<ssize_t>& from, const vector<ssize_t>& to) {
+          loop_over_tile (vox, axes, from, to, [this] { unpack (func, vox); });
+        }
+      };
+
+
+    template <class Functor, class... ImageType>
+      struct ThreadedLoopRunTile<0,Functor,ImageType...>
+      { MEMALIGN(ThreadedLoopRunTile<0,Functor,ImageType...>)
+        const vector<size_t>& axes;
+        typename std::remove_reference<Functor>::type func;
+        std::tuple<Iterator> vox;
+
+        ThreadedLoopRunTile (const vector<size_t>& axes, const Iterator& iterator,
+            const Functor& functor, ImageType&... /*voxels*/) :
+          axes (axes),
+          func (functor),
+          vox (iterator) { }
+
+        void operator() (const vector<ssize_t>& from, const vector<ssize_t>& to) {
+          loop_over_tile (vox, axes, from, to, [this] { func (std::get<0>(vox)); });
+        }
+      };
+
+
+    inline std::string progress_message (const LoopAlongDynamicAxes&) { return std::string(); }
+    inline std::string progress_message (const LoopAlongDynamicAxesProgress& loop) { return loop.text; }
+
+
+
     template <class OuterLoopType>
       struct ThreadedLoopRunOuter { MEMALIGN(ThreadedLoopRunOuter<OuterLoopType>)
         Iterator iterator;
         OuterLoopType outer_loop;
         vector<size_t> inner_axes;
+        vector<size_t> tile_size;
+
+        //! process the image in bricks of the size specified
+        /*! \sa threaded_loop_tiled */
+        ThreadedLoopRunOuter& tiled (const vector<size_t>& size = { 16, 16, 16 })
+        {
+          tile_size = size;
+          return *this;
+        }
 
         //! invoke \a functor (const Iterator& pos) per voxel <em> in the outer axes only</em>
         template <class Functor> 
@@ -351,10 +458,98 @@ namespace MR
 
 
 
+        //! invoke \a functor (from, to) per brick, for a set of bricks covering \a axes
+        template <class Functor>
+          void run_tiles (const vector<size_t>& axes, Functor&& functor)
+          {
+            vector<ssize_t> tiles (axes.size()), extent (axes.size());
+            size_t num_tiles = 1;
+            for (size_t n = 0; n < axes.size(); ++n) {
+              extent[n] = n < tile_size.size() ? std::max (tile_size[n], size_t(1)) : 1;
+              tiles[n] = (iterator.size (axes[n]) + extent[n] - 1) / extent[n];
+              num_tiles *= tiles[n];
+            }
+
+            std::unique_ptr<ProgressBar> progress;
+            const std::string message = progress_message (outer_loop);
+            if (message.size())
+              progress.reset (new ProgressBar (message, num_tiles));
+
+            std::atomic<size_t> next (0);
+            std::mutex mutex;
+            const size_t nthreads = std::max (Thread::number_of_threads(), size_t(1));
+
+            struct PerThread { MEMALIGN(PerThread)
+              const Iterator& iterator;
+              const vector<size_t>& axes;
+              const vector<ssize_t>& tiles;
+              const vector<ssize_t>& extent;
+              const size_t num_tiles, nthreads;
+              std::atomic<size_t>& next;
+              std::mutex& mutex;
+              ProgressBar* progress;
+              typename std::remove_reference<Functor>::type func;
+
+              void execute () {
+                vector<ssize_t> from (axes.size()), to (axes.size());
+                size_t start = next.load();
+                while (true) {
+                  // guided scheduling: claim a run of consecutive tiles,
+                  // proportional to the number of tiles remaining:
+                  size_t count;
+                  do {
+                    if (start >= num_tiles)
+                      return;
+                    count = std::max ((num_tiles - start) / (2*nthreads), size_t(1));
+                  } while (!next.compare_exchange_weak (start, start + count));
+
+                  for (size_t tile = start; tile < start + count; ++tile) {
+                    size_t index = tile;
+                    for (size_t n = 0; n < axes.size(); ++n) {
+                      from[n] = (index % tiles[n]) * extent[n];
+                      to[n] = std::min (from[n] + extent[n], iterator.size (axes[n]));
+                      index /= tiles[n];
+                    }
+                    func (from, to);
+                  }
+
+                  if (progress) {
+                    std::lock_guard<std::mutex> lock (mutex);
+                    for (size_t n = 0; n < count; ++n)
+                      ++(*progress);
+                  }
+                  start = next.load();
+                }
+              }
+            } loop_thread = { iterator, axes, tiles, extent, num_tiles, nthreads, next, mutex, progress.get(), functor };
+
+            if (Thread::number_of_threads() == 0) {
+              loop_thread.execute();
+              return;
+            }
+
+            auto t = Thread::run (Thread::multi (loop_thread), "tiled loop threads");
+            t.wait();
+          }
+
+
+
         //! invoke \a functor (const Iterator& pos) per voxel <em> in the outer axes only</em>
         template <class Functor, class... ImageType>
           void run (Functor&& functor, ImageType&&... vox)
           {
+            if (tile_size.size()) {
+              vector<size_t> axes (inner_axes);
+              axes.insert (axes.end(), outer_loop.axes.begin(), outer_loop.axes.end());
+              ThreadedLoopRunTile<
+                sizeof...(ImageType),
+                typename std::remove_reference<Functor>::type,
+                typename std::remove_reference<ImageType>::type...
+                  > loop_thread (axes, iterator, functor, vox...);
+              run_tiles (axes, loop_thread);
+              return;
+            }
+
             ThreadedLoopRunInner< 
               sizeof...(ImageType),
               typename std::remove_reference<Functor>::type, 
@@ -164,6 +164,13 @@ namespace MR
         return retval;
       }
 
+
+      // .tck files, or quantised track files (.tcq):
+      inline bool is_track_file (const std::string& path)
+      {
+        return Path::has_suffix (path, ".tck") || Path::has_suffix (path, ".tcq");
+      }
+
     }
 
 
@@ -1036,15 +1043,17 @@ namespace MR
       // check for the existence of all specified input files (including optional ones that have been provided)
       // if necessary, also check for pre-existence of any output files with known paths
       //   (if the output is e.g. given as a prefix, the argument should be flagged as type_text())
+      // when a command is resuming from a checkpoint, the outputs it continues are expected to exist
+      const bool resuming = get_options ("resume").size();
       for (const auto& i : argument) {
         if ((i.arg->type == ArgFileIn || i.arg->type == TracksIn) && !Path::exists (std::string(i)))
           throw Exception ("required input file \"" + str(i) + "\" not found");
-        if (i.arg->type == ArgFileOut || i.arg->type == TracksOut)
+        if ((i.arg->type == ArgFileOut || i.arg->type == TracksOut) && !(resuming && (i.arg->flags & AppendOnResume)))
           check_overwrite (std::string(i));
-        if (i.arg->type == TracksIn && !Path::has_suffix (str(i), ".tck"))
+        if (i.arg->type == TracksIn && !is_track_file (str(i)))
           throw Exception ("input file " + str(i) + " is not a valid track file");
-        if (i.arg->type == TracksOut && !Path::has_suffix (str(i), ".tck"))
-          throw Exception ("output track file (" + str(i) + ") must use the .tck suffix");
+        if (i.arg->type == TracksOut && !is_track_file (str(i)))
+          throw Exception ("output track file (" + str(i) + ") must use the .tck or .tcq suffix");
       }
       for (const auto& i : option) {
         for (size_t j = 0; j != i.opt->size(); ++j) {
@@ -1052,12 +1061,12 @@ namespace MR
           const char* const name = i.args[j];
           if ((arg.type == ArgFileIn || arg.type == TracksIn) && !Path::exists (name))
             throw Exception ("input file \"" + str(name) + "\" not found (required for option \"-" + std::string(i.opt->id) + "\")");
-          if (arg.type == ArgFileOut || arg.type == TracksOut)
+          if ((arg.type == ArgFileOut || arg.type == TracksOut) && !(resuming && (arg.flags & AppendOnResume)))
             check_overwrite (name);
-          if (arg.type == TracksIn && !Path::has_suffix (str(name), ".tck"))
+          if (arg.type == TracksIn && !is_track_file (str(name)))
             throw Exception ("input file " + str(name) + " is not a valid track file");
-          if (arg.type == TracksOut && !Path::has_suffix (str(name), ".tck"))
-            throw Exception ("output track file (" + str(name) + ") must use the .tck suffix");
+          if (arg.type == TracksOut && !is_track_file (str(name)))
+            throw Exception ("output track file (" + str(name) + ") must use the .tck or .tcq suffix");
         }
       }
 
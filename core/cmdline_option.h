@@ -60,6 +60,7 @@ namespace MR
     constexpr ArgFlags None = 0;
     constexpr ArgFlags Optional = 0x1;
     constexpr ArgFlags AllowMultiple = 0x2;
+    constexpr ArgFlags AppendOnResume = 0x4;
     //! \endcond
 
 
@@ -115,7 +116,7 @@ namespace MR
         std::string desc;
         //! the argument type
         ArgType  type;
-        //! the argument flags (AllowMultiple & Optional)
+        //! the argument flags (AllowMultiple, Optional & AppendOnResume)
         ArgFlags flags;
 
         //! a structure to store the various parameters of the Argument
@@ -157,6 +158,16 @@ namespace MR
           return *this;
         }
 
+        //! specifies that an existing output file is continued when resuming
+        /*! For commands that provide a -resume option: when that option is
+         * used, this output file is expected to exist already (e.g. as
+         * recorded in a checkpoint), and will therefore not be checked for
+         * pre-existence. All other outputs are checked as usual. */
+        Argument& append_on_resume () {
+          flags |= AppendOnResume;
+          return *this;
+        }
+
         //! specifies that the argument should be a text string */
         Argument& type_text () {
           assert (type == Undefined);
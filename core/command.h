@@ -19,6 +19,7 @@
 #include <xmmintrin.h>
 #include "project_version.h"
 #include "app.h"
+#include "thread.h"
 
 #define MRTRIX_UPDATED_API
 
@@ -43,11 +44,10 @@ extern "C" void R_main (int* cmdline_argc, char** cmdline_argv)
   } 
   catch (MR::Exception& E) { 
     E.display(); 
-    return; 
   } 
   catch (int retval) { 
-    return; 
   } 
+  ::MR::Thread::write_queue_trace();
 } 
 
 extern "C" void R_usage (char** output) 
@@ -78,6 +78,7 @@ int main (int cmdline_argc, char** cmdline_argv)
 #ifdef MRTRIX_PROJECT_VERSION
   ::MR::App::project_version = MRTRIX_PROJECT_VERSION;
 #endif
+  int exit_code = 0;
   try {
 #ifdef __gui_app_h__
     ::MR::GUI::App app (cmdline_argc, cmdline_argv);
@@ -90,12 +91,13 @@ int main (int cmdline_argc, char** cmdline_argv)
   } 
   catch (::MR::Exception& E) {
     E.display(); 
-    return 1;
+    exit_code = 1;
   } 
   catch (int retval) { 
-    return retval; 
+    exit_code = retval; 
   } 
-  return 0; 
+  ::MR::Thread::write_queue_trace();
+  return exit_code; 
 }
 
 #endif
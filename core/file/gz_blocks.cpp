@@ -0,0 +1,243 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <atomic>
+#include <zlib.h>
+
+#include "thread.h"
+#include "file/config.h"
+#include "file/gz_blocks.h"
+
+// size of the gzip member header written for each block, including the
+// FEXTRA field holding the block index entry:
+#define GZ_BLOCK_HEADER_SIZE 24
+#define GZ_BLOCK_TRAILER_SIZE 8
+
+namespace MR
+{
+  namespace File
+  {
+    namespace GZBlocks
+    {
+
+      namespace {
+
+        inline void put_LE16 (uint8_t* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+        inline void put_LE32 (uint8_t* p, uint32_t v) { for (size_t n = 0; n < 4; ++n) p[n] = (v >> (8*n)) & 0xFF; }
+        inline uint16_t get_LE16 (const uint8_t* p) { return uint16_t (p[0]) | (uint16_t (p[1]) << 8); }
+        inline uint32_t get_LE32 (const uint8_t* p) { return uint32_t (p[0]) | (uint32_t (p[1]) << 8) | (uint32_t (p[2]) << 16) | (uint32_t (p[3]) << 24); }
+
+
+
+        // compress the contents of block.in into a self-contained gzip member.
+        // The member header carries an "MR" extra subfield holding the
+        // compressed size of the member and the size of its uncompressed
+        // contents, which serves as the block index on reading:
+        class BlockDeflate { NOMEMALIGN
+          public:
+            BlockDeflate (Block* blocks, size_t num, std::atomic<size_t>& next, const std::string& filename) :
+              blocks (blocks), num (num), next (next), filename (filename) { }
+
+            void execute () {
+              size_t n;
+              while ((n = next++) < num)
+                compress (blocks[n]);
+            }
+
+          protected:
+            Block* blocks;
+            const size_t num;
+            std::atomic<size_t>& next;
+            const std::string& filename;
+
+            void compress (Block& block) const {
+              z_stream strm;
+              memset (&strm, 0, sizeof (strm));
+              if (deflateInit2 (&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                throw Exception ("error initialising zlib compression stream");
+
+              block.buffer.resize (GZ_BLOCK_HEADER_SIZE + deflateBound (&strm, block.in_size) + GZ_BLOCK_TRAILER_SIZE);
+              strm.next_in = const_cast<Bytef*> (block.in);
+              strm.avail_in = block.in_size;
+              strm.next_out = block.buffer.data() + GZ_BLOCK_HEADER_SIZE;
+              strm.avail_out = block.buffer.size() - GZ_BLOCK_HEADER_SIZE - GZ_BLOCK_TRAILER_SIZE;
+              const int retval = deflate (&strm, Z_FINISH);
+              const size_t deflated_size = strm.total_out;
+              deflateEnd (&strm);
+              if (retval != Z_STREAM_END)
+                throw Exception ("error compressing data for image \"" + filename + "\"");
+
+              block.out_size = GZ_BLOCK_HEADER_SIZE + deflated_size + GZ_BLOCK_TRAILER_SIZE;
+              block.buffer.resize (block.out_size);
+
+              uint8_t* p = block.buffer.data();
+              p[0] = 0x1f; p[1] = 0x8b; // gzip magic number
+              p[2] = Z_DEFLATED;         // compression method
+              p[3] = 0x04;               // flags: FEXTRA
+              put_LE32 (p+4, 0);         // modification time: not set
+              p[8] = 0;                  // extra flags
+              p[9] = 0xFF;               // OS: unknown
+              put_LE16 (p+10, 12);       // XLEN
+              p[12] = 'M'; p[13] = 'R';  // subfield ID
+              put_LE16 (p+14, 8);        // subfield length
+              put_LE32 (p+16, block.out_size);
+              put_LE32 (p+20, block.in_size);
+
+              p += GZ_BLOCK_HEADER_SIZE + deflated_size;
+              put_LE32 (p, crc32 (crc32 (0L, Z_NULL, 0), block.in, block.in_size));
+              put_LE32 (p+4, block.in_size);
+            }
+        };
+
+
+
+        // decompress the gzip member at block.in into block.out:
+        void inflate_block (const Block& block, const std::string& filename)
+        {
+          z_stream strm;
+          memset (&strm, 0, sizeof (strm));
+          if (inflateInit2 (&strm, -MAX_WBITS) != Z_OK)
+            throw Exception ("error initialising zlib decompression stream");
+
+          strm.next_in = const_cast<Bytef*> (block.in) + GZ_BLOCK_HEADER_SIZE;
+          strm.avail_in = block.in_size - GZ_BLOCK_HEADER_SIZE - GZ_BLOCK_TRAILER_SIZE;
+          strm.next_out = block.out;
+          strm.avail_out = block.out_size;
+          const int retval = inflate (&strm, Z_FINISH);
+          const size_t inflated_size = strm.total_out;
+          inflateEnd (&strm);
+
+          const uint8_t* trailer = block.in + block.in_size - GZ_BLOCK_TRAILER_SIZE;
+          if (retval != Z_STREAM_END || inflated_size != block.out_size ||
+              get_LE32 (trailer+4) != uint32_t (block.out_size) ||
+              get_LE32 (trailer) != crc32 (crc32 (0L, Z_NULL, 0), block.out, block.out_size))
+            throw Exception ("corrupted data block in compressed image \"" + filename + "\"");
+        }
+
+
+
+        class BlockInflate { NOMEMALIGN
+          public:
+            BlockInflate (Block* blocks, size_t num, std::atomic<size_t>& next, const std::string& filename) :
+              blocks (blocks), num (num), next (next), filename (filename) { }
+
+            void execute () {
+              size_t n;
+              while ((n = next++) < num)
+                inflate_block (blocks[n], filename);
+            }
+
+          protected:
+            Block* blocks;
+            const size_t num;
+            std::atomic<size_t>& next;
+            const std::string& filename;
+        };
+
+
+
+        // process the blocks in batches of a few blocks per thread, so as to
+        // limit memory usage and allow the progress bar to be updated:
+        template <class Functor>
+          void run_blocks (vector<Block>& blocks, const std::string& filename, ProgressBar& progress, size_t& bytes_processed, size_t bytes_per_increment)
+          {
+            const size_t nthreads = std::max (Thread::number_of_threads(), size_t(1));
+            for (size_t n = 0; n < blocks.size(); n += 4*nthreads) {
+              const size_t num = std::min (4*nthreads, blocks.size() - n);
+              std::atomic<size_t> next (0);
+              Functor functor (&blocks[n], num, next, filename);
+              if (num > 1 && nthreads > 1)
+                Thread::run (Thread::multi (functor, std::min (nthreads, num)), "gzip block processing").wait();
+              else
+                functor.execute();
+
+              for (size_t i = n; i < n+num; ++i) {
+                const size_t previous = bytes_processed / bytes_per_increment;
+                bytes_processed += std::max (blocks[i].in_size, blocks[i].out_size);
+                for (size_t k = previous; k < bytes_processed / bytes_per_increment; ++k)
+                  ++progress;
+              }
+            }
+          }
+
+      }
+
+
+
+
+
+      //CONF option: GZBlockSize
+      //CONF default: 1048576
+      //CONF The size (in bytes) of the independently compressed blocks used
+      //CONF when writing GZip-compressed images (.nii.gz, .mif.gz), and of
+      //CONF the chunks of chunked MRtrix images (.mifz). Each block is
+      //CONF stored as a separate gzip member, so that the resulting file
+      //CONF remains readable by any gzip-compliant software, while allowing
+      //CONF MRtrix3 to compress and uncompress the image using multiple
+      //CONF threads. Set to 0 to revert to a single gzip stream (chunked
+      //CONF images then use the default size).
+      size_t block_size ()
+      {
+        static const int size = File::Config::get_int ("GZBlockSize", 1048576);
+        return size > 0 ? size : 0;
+      }
+
+
+
+
+      bool get_index (const uint8_t* data, size_t size, vector<Block>& index)
+      {
+        size_t pos = 0;
+        while (pos < size) {
+          const uint8_t* p = data + pos;
+          if (size - pos < GZ_BLOCK_HEADER_SIZE + GZ_BLOCK_TRAILER_SIZE)
+            return false;
+          if (p[0] != 0x1f || p[1] != 0x8b || p[2] != Z_DEFLATED || p[3] != 0x04 ||
+              get_LE16 (p+10) != 12 || p[12] != 'M' || p[13] != 'R' || get_LE16 (p+14) != 8)
+            return false;
+          const size_t member_size = get_LE32 (p+16);
+          if (member_size < GZ_BLOCK_HEADER_SIZE + GZ_BLOCK_TRAILER_SIZE || member_size > size - pos)
+            return false;
+          index.push_back (Block (p, member_size, nullptr, get_LE32 (p+20)));
+          pos += member_size;
+        }
+        return index.size();
+      }
+
+
+
+
+      void compress (vector<Block>& blocks, const std::string& filename,
+          ProgressBar& progress, size_t& bytes_processed, size_t bytes_per_increment)
+      {
+        run_blocks<BlockDeflate> (blocks, filename, progress, bytes_processed, bytes_per_increment);
+      }
+
+
+      void uncompress (vector<Block>& blocks, const std::string& filename,
+          ProgressBar& progress, size_t& bytes_processed, size_t bytes_per_increment)
+      {
+        run_blocks<BlockInflate> (blocks, filename, progress, bytes_processed, bytes_per_increment);
+      }
+
+
+      void uncompress (const Block& block, const std::string& filename)
+      {
+        inflate_block (block, filename);
+      }
+
+    }
+  }
+}
+
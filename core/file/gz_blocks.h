@@ -0,0 +1,85 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#ifndef __file_gz_blocks_h__
+#define __file_gz_blocks_h__
+
+#include "types.h"
+#include "progressbar.h"
+
+namespace MR
+{
+  namespace File
+  {
+
+    //! functions to handle data stored as a series of independent gzip members
+    /*! Each block of data is compressed into a self-contained gzip member,
+     * whose header carries an 'MR' extra subfield holding the compressed size
+     * of the member and the size of its uncompressed contents. A sequence of
+     * such blocks is a valid (multi-member) gzip stream, but the chain of
+     * member headers also acts as an index into the data, allowing the
+     * blocks to be located without uncompressing them, and processed in
+     * parallel. */
+    namespace GZBlocks
+    {
+
+      //! a single block of data
+      /*! For compression, \c in & \c in_size refer to the uncompressed data,
+       * and the gzip member is written to \c buffer (\c out_size is set to
+       * its size). For decompression, \c in & \c in_size refer to the gzip
+       * member, and the data are uncompressed to \c out, which must be able
+       * to hold \c out_size bytes. */
+      class Block { NOMEMALIGN
+        public:
+          Block (const uint8_t* in = nullptr, size_t in_size = 0, uint8_t* out = nullptr, size_t out_size = 0) :
+            in (in), in_size (in_size), out (out), out_size (out_size) { }
+
+          const uint8_t* in;
+          size_t in_size;
+          uint8_t* out;
+          size_t out_size;
+          vector<uint8_t> buffer;
+      };
+
+
+      //! the size of the blocks to use when compressing, as set by the GZBlockSize config file option
+      /*! returns zero if block-wise compression has been disabled. */
+      size_t block_size ();
+
+      //! parse the chain of gzip members held in \a data
+      /*! On success, the location and uncompressed size of each member are
+       * appended to \a index. Returns false if any part of the data does not
+       * consist of blocks in the expected format. */
+      bool get_index (const uint8_t* data, size_t size, vector<Block>& index);
+
+      //! compress \a blocks using multiple threads
+      /*! \a progress is incremented once per \a bytes_per_increment bytes
+       * processed, with the running total held in \a bytes_processed. */
+      void compress (vector<Block>& blocks, const std::string& filename,
+          ProgressBar& progress, size_t& bytes_processed, size_t bytes_per_increment);
+
+      //! uncompress \a blocks using multiple threads
+      /*! \sa compress() */
+      void uncompress (vector<Block>& blocks, const std::string& filename,
+          ProgressBar& progress, size_t& bytes_processed, size_t bytes_per_increment);
+
+      //! uncompress a single \a block within the calling thread
+      void uncompress (const Block& block, const std::string& filename);
+
+    }
+  }
+}
+
+#endif
+
@@ -36,16 +36,63 @@
 
 #include "debug.h"
 
+#define MMAP_HUGE_PAGE_MIN_SIZE 33554432
+
 namespace MR
 {
   namespace File
   {
 
-    MMap::MMap (const Entry& entry, bool readwrite, bool preload, int64_t mapped_size) :
-      Entry (entry), addr (NULL), first (NULL), msize (mapped_size), readwrite (readwrite)
+    namespace {
+
+      MMap::Access __default_access = MMap::Access::Normal;
+
+      //CONF option: MMapPopulate
+      //CONF default: 0 (false)
+      //CONF If true, memory-mapped files will be read in their entirety at
+      //CONF the point of mapping (using MAP_POPULATE, where supported),
+      //CONF rather than on demand as the data are accessed. This can speed
+      //CONF up subsequent processing where most of the file will be
+      //CONF accessed, at the expense of a delay when the file is opened.
+      bool populate ()
+      {
+        static const bool value = File::Config::get_bool ("MMapPopulate", false);
+        return value;
+      }
+
+      //CONF option: MMapHugePages
+      //CONF default: 0 (false)
+      //CONF If true, request that large memory mappings (32MB or more) be
+      //CONF backed by transparent huge pages, to reduce the overhead of
+      //CONF address translation for large images. This only has an effect
+      //CONF for files on filesystems that support huge pages for file-backed
+      //CONF memory (e.g. tmpfs), and may increase memory usage.
+      bool use_huge_pages ()
+      {
+        static const bool value = File::Config::get_bool ("MMapHugePages", false);
+        return value;
+      }
+
+    }
+
+
+
+    void MMap::set_default_access (Access access)
+    {
+      __default_access = access == Access::Default ? Access::Normal : access;
+    }
+
+
+
+
+    MMap::MMap (const Entry& entry, bool readwrite, bool preload, int64_t mapped_size, Access access) :
+      Entry (entry), fd (-1), addr (NULL), first (NULL), msize (mapped_size), readwrite (readwrite), writeback (false)
     {
       DEBUG ("memory-mapping file \"" + Entry::name + "\"...");
 
+      if (access == Access::Default)
+        access = __default_access;
+
       struct stat sbuf;
       if (stat (Entry::name.c_str(), &sbuf))
         throw Exception ("cannot stat file \"" + Entry::name + "\": " + strerror (errno));
@@ -58,6 +105,9 @@ namespace MR
       else if (start + msize > sbuf.st_size) 
         throw Exception ("file \"" + Entry::name + "\" is smaller than expected");
 
+      if (start + msize == 0)
+        throw Exception ("cannot map empty file \"" + Entry::name + "\"");
+
       bool delayed_writeback = false;
       if (readwrite) {
 
@@ -123,6 +173,7 @@ namespace MR
 #endif
 
         if (delayed_writeback) {
+          writeback = true;
           try {
             first = new uint8_t [msize];
             if (!first) throw 1;
@@ -163,8 +214,13 @@ namespace MR
         if (!addr) throw 0;
         CloseHandle (handle);
 #else
+        int flags = MAP_SHARED;
+# ifdef MAP_POPULATE
+        if (populate())
+          flags |= MAP_POPULATE;
+# endif
         addr = static_cast<uint8_t*> (mmap ( (char*) 0, start + msize,
-              ( readwrite ? PROT_WRITE | PROT_READ : PROT_READ ), MAP_SHARED, fd, 0));
+              ( readwrite ? PROT_WRITE | PROT_READ : PROT_READ ), flags, fd, 0));
         if (addr == MAP_FAILED) throw 0;
 #endif
       }
@@ -174,6 +230,7 @@ namespace MR
         throw Exception ("memory-mapping failed for file \"" + Entry::name + "\": " + strerror (errno));
       }
       first = addr + start;
+      advise (access);
 
       DEBUG ("file \"" + Entry::name + "\" mapped at " + str ( (void*) addr) + ", size " + str (msize)
           + " (read-" + (readwrite ? "write" : "only") + ")");
@@ -186,27 +243,74 @@ namespace MR
     MMap::~MMap() noexcept (false)
     {
       if (!first) return;
+      if (writeback && readwrite) {
+        INFO ("writing back contents of mapped file \"" + Entry::name + "\"...");
+        File::OFStream out (Entry::name, std::ios::in | std::ios::out | std::ios::binary);
+        out.seekp (start, out.beg);
+        out.write ((char*) first, msize);
+        if (!out.good())
+          throw Exception ("error writing back contents of file \"" + Entry::name + "\": " + strerror(errno));
+      }
       if (addr) {
         DEBUG ("unmapping file \"" + Entry::name + "\"");
 #ifdef MRTRIX_WINDOWS
         if (!UnmapViewOfFile ( (LPVOID) addr))
 #else
-          if (munmap (addr, msize))
+          if (munmap (addr, (first - addr) + msize))
 #endif
             WARN ("error unmapping file \"" + Entry::name + "\": " + strerror (errno));
-        close (fd);
+        if (fd >= 0)
+          close (fd);
       }
-      else {
-        if (readwrite) {
-          INFO ("writing back contents of mapped file \"" + Entry::name + "\"...");
-          File::OFStream out (Entry::name, std::ios::in | std::ios::out | std::ios::binary);
-          out.seekp (start, out.beg);
-          out.write ((char*) first, msize);
-          if (!out.good())
-            throw Exception ("error writing back contents of file \"" + Entry::name + "\": " + strerror(errno));
-        }
+      else
         delete [] first;
+    }
+
+
+
+
+    void MMap::advise (Access access)
+    {
+#ifndef MRTRIX_WINDOWS
+      const size_t length = (first - addr) + msize;
+      int madvice = -1;
+# ifdef POSIX_FADV_NORMAL
+      int fadvice = -1;
+# endif
+      switch (access) {
+        case Access::Sequential:
+          madvice = MADV_SEQUENTIAL;
+# ifdef POSIX_FADV_NORMAL
+          fadvice = POSIX_FADV_SEQUENTIAL;
+# endif
+          break;
+        case Access::Random:
+          madvice = MADV_RANDOM;
+# ifdef POSIX_FADV_NORMAL
+          fadvice = POSIX_FADV_RANDOM;
+# endif
+          break;
+        case Access::WillNeed:
+          madvice = MADV_WILLNEED;
+# ifdef POSIX_FADV_NORMAL
+          fadvice = POSIX_FADV_WILLNEED;
+# endif
+          break;
+        default:
+          break;
       }
+
+      if (madvice >= 0 && madvise (addr, length, madvice))
+        DEBUG ("madvise() failed for file \"" + Entry::name + "\": " + strerror (errno));
+# ifdef POSIX_FADV_NORMAL
+      if (fadvice >= 0 && fd >= 0 && posix_fadvise (fd, start, msize, fadvice))
+        DEBUG ("posix_fadvise() failed for file \"" + Entry::name + "\"");
+# endif
+# ifdef MADV_HUGEPAGE
+      if (use_huge_pages() && length >= MMAP_HUGE_PAGE_MIN_SIZE && madvise (addr, length, MADV_HUGEPAGE))
+        DEBUG ("huge pages not available for file \"" + Entry::name + "\": " + strerror (errno));
+# endif
+#endif
     }
 
 
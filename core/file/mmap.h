@@ -29,6 +29,27 @@ namespace MR
 
     class MMap : protected Entry { NOMEMALIGN
       public:
+        //! hints as to how the mapped data will be accessed
+        /*! These are passed to the operating system (via \c madvise() and
+         * \c posix_fadvise() where available) to tune its readahead and
+         * caching policy:
+         * - \c Normal: no particular access pattern;
+         * - \c Sequential: the data will be accessed in order, once;
+         * - \c Random: the data will be accessed in no particular order, so
+         *   readahead is disabled;
+         * - \c WillNeed: all of the data will be needed soon, so should be
+         *   read in the background straight away.
+         *
+         * \c Default selects the process-wide default, as set using
+         * set_default_access() (\c Normal unless otherwise specified). */
+        enum class Access { Default, Normal, Sequential, Random, WillNeed };
+
+        //! set the access hint used by all subsequent mappings requesting Access::Default
+        /*! This allows commands to specify the access pattern expected for
+         * all their images (e.g. random access for streamlines tractography),
+         * without modifying the image handling code. */
+        static void set_default_access (Access access);
+
         //! create a new memory-mapping to file in \a entry
         /*! map file in \a entry at the offset in \a entry. By default, the
          * file will be mapped read-only. If \a readwrite is set to true,
@@ -48,9 +69,12 @@ namespace MR
          *
          * By default, the whole file is mapped. If \a mapped_size is
          * non-zero, then only the region of size \a mapped_size starting from
-         * the byte offset specified in \a entry will be mapped. 
+         * the byte offset specified in \a entry will be mapped. The mapped
+         * region must not be empty.
+         *
+         * The \a access hint is applied to all regular memory-mappings.
          */
-        MMap (const Entry& entry, bool readwrite = false, bool preload = true, int64_t mapped_size = -1);
+        MMap (const Entry& entry, bool readwrite = false, bool preload = true, int64_t mapped_size = -1, Access access = Access::Default);
         ~MMap () noexcept (false);
 
         std::string name () const {
@@ -85,11 +109,13 @@ namespace MR
         int64_t   msize;       /**< The size of the file. */
         time_t    mtime;       /**< The modification time of the file at the last check. */
         bool      readwrite;
+        bool      writeback;   /**< Whether the contents are held in a buffer to be written back on closing. */
 
         void map ();
+        void advise (Access access);
 
       private:
-        MMap (const MMap& mmap) : Entry (mmap), fd (0), addr (NULL), first (NULL), msize (0), mtime (0), readwrite (false) {
+        MMap (const MMap& mmap) : Entry (mmap), fd (0), addr (NULL), first (NULL), msize (0), mtime (0), readwrite (false), writeback (false) {
           assert (0);
         }
     };
@@ -163,11 +163,15 @@ namespace MR
 
 
 
-    inline std::string create_tempfile (int64_t size = 0, const char* suffix = NULL)
+    //! create a uniquely-named temporary file
+    /*! the file is created within \a directory if specified, and within
+     * the directory specified by the TmpFileDir config file option
+     * otherwise. */
+    inline std::string create_tempfile (int64_t size = 0, const char* suffix = NULL, const std::string& directory = std::string())
     {
       DEBUG ("creating temporary file of size " + str (size));
 
-      std::string filename (Path::join (tmpfile_dir(), tmpfile_prefix()) + "XXXXXX.");
+      std::string filename (Path::join (directory.size() ? directory : tmpfile_dir(), tmpfile_prefix()) + "XXXXXX.");
       int rand_index = filename.size() - 7;
       if (suffix) filename += suffix;
 
@@ -179,7 +183,7 @@ namespace MR
       } while (fid < 0 && errno == EEXIST);
 
       if (fid < 0)
-        throw Exception (std::string ("error creating temporary file in current working directory: ") + strerror (errno));
+        throw Exception ("error creating temporary file \"" + filename + "\": " + strerror (errno));
 
 
 
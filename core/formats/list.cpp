@@ -27,6 +27,7 @@ namespace MR
     Pipe          pipe_handler;
     MRtrix        mrtrix_handler;
     MRtrix_GZ     mrtrix_gz_handler;
+    MRtrix_Chunked mrtrix_chunked_handler;
     MRI           mri_handler;
     NIfTI1        nifti1_handler;
     NIfTI2        nifti2_handler;
@@ -51,6 +52,7 @@ namespace MR
       &dicom_handler,
       &mrtrix_handler,
       &mrtrix_gz_handler,
+      &mrtrix_chunked_handler,
       &nifti1_handler,
       &nifti2_handler,
       &nifti1_gz_handler,
@@ -73,6 +75,7 @@ namespace MR
       ".mih",
       ".mif",
       ".mif.gz",
+      ".mifz",
       ".img",
       ".nii",
       ".nii.gz",
@@ -0,0 +1,128 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "header.h"
+#include "stride.h"
+#include "image_io/chunked.h"
+#include "formats/list.h"
+#include "formats/mrtrix_utils.h"
+#include "file/gz_blocks.h"
+#include "file/key_value.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "file/utils.h"
+
+namespace MR
+{
+  namespace Formats
+  {
+
+    // extension is:
+    // mifz: MRtrix Image File, stored as independently compressed chunks
+
+    namespace {
+
+      // produce the header text to write to file, padded up to the data offset:
+      std::string chunked_header (const Header& H)
+      {
+        std::stringstream header;
+        header << "mrtrix image\n";
+        write_mrtrix_header (H, header);
+
+        int64_t offset = header.tellp() + int64_t(24);
+        offset += ((4 - (offset % 4)) % 4);
+        header << "file: . " << offset << "\nEND\n";
+        while (header.tellp() < offset)
+          header << '\0';
+        return header.str();
+      }
+
+
+      // chunk boundaries are aligned with the outermost axis in storage
+      // order where possible (e.g. whole volumes for typical 4D images), so
+      // that each chunk holds a set of complete slabs of data:
+      size_t chunk_size (const Header& H)
+      {
+        const size_t target = File::GZBlocks::block_size() ? File::GZBlocks::block_size() : 1048576;
+        const size_t outer_axis = Stride::order (H).back();
+        const int64_t slab_bits = H.datatype().bits() * voxel_count (H, 0, outer_axis) * voxel_count (H, outer_axis+1);
+        if (slab_bits % 8)
+          return target;
+        const size_t slab_size = slab_bits / 8;
+        if (slab_size > 4*target)
+          return target;
+        return slab_size * std::max (size_t (1), size_t (std::round (default_type (target) / slab_size)));
+      }
+
+    }
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_Chunked::read (Header& H) const
+    {
+      if (!Path::has_suffix (H.name(), ".mifz"))
+        return std::unique_ptr<ImageIO::Base>();
+
+      File::KeyValue kv (H.name(), "mrtrix image");
+      read_mrtrix_header (H, kv);
+
+      std::string fname;
+      size_t offset;
+      get_mrtrix_file_path (H, "file", fname, offset);
+      if (fname != H.name())
+        throw Exception ("chunked MRtrix format images must have image data within the same file as the header");
+
+      std::unique_ptr<ImageIO::Base> io_handler (new ImageIO::Chunked (H, chunked_header (H), chunk_size (H)));
+      io_handler->files.push_back (File::Entry (H.name(), offset));
+
+      return io_handler;
+    }
+
+
+
+
+
+    bool MRtrix_Chunked::check (Header& H, size_t num_axes) const
+    {
+      if (!Path::has_suffix (H.name(), ".mifz"))
+        return false;
+
+      H.ndim() = num_axes;
+      for (size_t i = 0; i < H.ndim(); i++)
+        if (H.size (i) < 1)
+          H.size(i) = 1;
+
+      return true;
+    }
+
+
+
+
+
+    std::unique_ptr<ImageIO::Base> MRtrix_Chunked::create (Header& H) const
+    {
+      const std::string header = chunked_header (H);
+      File::OFStream out (H.name(), std::ios::out | std::ios::binary);
+      out.write (header.c_str(), header.size());
+      out.close();
+
+      std::unique_ptr<ImageIO::Base> io_handler (new ImageIO::Chunked (H, header, chunk_size (H)));
+      io_handler->files.push_back (File::Entry (H.name(), header.size()));
+
+      return io_handler;
+    }
+
+  }
+}
+
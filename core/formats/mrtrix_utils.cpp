@@ -113,6 +113,32 @@ namespace MR
     }
 
 
+    bool next_keyvalue (std::istream& in, std::string& key, std::string& value)
+    {
+      key.clear(); value.clear();
+      std::string line;
+      if (!std::getline (in, line))
+        throw Exception ("unexpected end of input while reading image header (broken pipe?)");
+      line = strip (line.substr (0, line.find_first_of ('#')));
+      if (line.empty() || line == "END")
+        return false;
+
+      size_t colon = line.find_first_of (':');
+      if (colon == std::string::npos) {
+        INFO ("malformed key/value entry (\"" + line + "\") in input stream - ignored");
+      } else {
+        key   = strip (line.substr (0, colon));
+        value = strip (line.substr (colon+1));
+        if (key.empty() || value.empty()) {
+          INFO ("malformed key/value entry (\"" + line + "\") in input stream - ignored");
+          key.clear();
+          value.clear();
+        }
+      }
+      return true;
+    }
+
+
 
 
 
@@ -40,6 +40,7 @@ namespace MR
     //   or from a GZipped file (where the getline() function must be used explicitly)
     bool next_keyvalue (File::KeyValue&, std::string&, std::string&);
     bool next_keyvalue (File::GZ&,       std::string&, std::string&);
+    bool next_keyvalue (std::istream&,   std::string&, std::string&);
 
     // Get the path to a file - use same function for image data and sparse data
     // Note that the 'file' and 'sparse_file' fields are read in as entries in the map<string, string>
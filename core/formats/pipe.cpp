@@ -13,22 +13,62 @@
 
 
 #include "signal_handler.h"
+#include "file/config.h"
 #include "file/utils.h"
 #include "file/path.h"
 #include "header.h"
 #include "image_io/pipe.h"
 #include "formats/list.h"
+#include "formats/mrtrix_utils.h"
 
 namespace MR
 {
   namespace Formats
   {
 
+    namespace {
+
+      //CONF option: PipeStreaming
+      //CONF default: 0 (false)
+      //CONF If true, images written to standard output (i.e. using `-` as the
+      //CONF output image name) are streamed directly down the pipe, rather
+      //CONF than being written to a temporary file whose name is then passed
+      //CONF to the next command. This avoids any filesystem traffic between
+      //CONF the stages of a pipeline, at the expense of each command holding
+      //CONF its own copy of the entire image in memory: a command may access
+      //CONF the voxels of its input in any order, and its output is only
+      //CONF complete once processing has finished, so neither can be
+      //CONF processed one block at a time as it passes through the pipe. For
+      //CONF images that do not comfortably fit in RAM, the default temporary
+      //CONF file approach should be used instead. Commands reading from
+      //CONF standard input detect either form automatically. Note that this
+      //CONF option can also be set using the `MRTRIX_PIPE_STREAMING`
+      //CONF environment variable, without editing the config file.
+      bool pipe_streaming ()
+      {
+        static const bool streaming = [] {
+          const char* from_env = getenv ("MRTRIX_PIPE_STREAMING");
+          if (from_env) return to<bool> (from_env);
+          return File::Config::get_bool ("PipeStreaming", false);
+        }();
+        return streaming;
+      }
+
+    }
+
+
+
+
     std::unique_ptr<ImageIO::Base> Pipe::read (Header& H) const
     {
       if (H.name() == "-") {
         std::string name;
         getline (std::cin, name);
+        if (name == "mrtrix image") {
+          read_mrtrix_header (H, std::cin);
+          H.keyval().erase ("file");
+          return std::unique_ptr<ImageIO::Base> (new ImageIO::PipeStream (H));
+        }
         H.name() = name;
       }
       else {
@@ -58,6 +98,14 @@ namespace MR
       if (H.name() != "-")
         return false;
 
+      if (pipe_streaming()) {
+        H.ndim() = num_axes;
+        for (size_t i = 0; i < H.ndim(); i++)
+          if (H.size (i) < 1)
+            H.size(i) = 1;
+        return true;
+      }
+
       H.name() = File::create_tempfile (0, "mif");
 
       SignalHandler::mark_file_for_deletion (H.name());
@@ -70,6 +118,9 @@ namespace MR
 
     std::unique_ptr<ImageIO::Base> Pipe::create (Header& H) const
     {
+      if (H.name() == "-")
+        return std::unique_ptr<ImageIO::Base> (new ImageIO::PipeStream (H));
+
       std::unique_ptr<ImageIO::Base> original_handler (mrtrix_handler.create (H));
       std::unique_ptr<ImageIO::Pipe> io_handler (new ImageIO::Pipe (std::move (*original_handler)));
       return std::move (io_handler);
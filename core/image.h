@@ -23,6 +23,7 @@
 #include "header.h"
 #include "image_io/fetch_store.h"
 #include "image_helpers.h"
+#include "adapter/base.h"
 #include "formats/mrtrix_utils.h"
 #include "algo/copy.h"
 #include "algo/threaded_copy.h"
@@ -252,6 +253,74 @@ namespace MR
 
 
 
+  //! indirect IO access to an Image, with the on-disk datatype fixed at compile-time
+  /*! This provides the same interface as the Image it wraps, but fetches &
+   * stores values using the conversion kernel \a Kernel (one of the
+   * ImageIO::FetchStore::Typed classes) directly, rather than via the
+   * std::function held by the Image::Buffer. This class should not be
+   * instantiated directly: use with_typed_io() instead. */
+  template <typename ValueType, class Kernel>
+    class TypedImage :
+      public Adapter::Base<TypedImage<ValueType,Kernel>, Image<ValueType>>
+  { MEMALIGN (TypedImage<ValueType,Kernel>)
+    public:
+      using base_type = Adapter::Base<TypedImage<ValueType,Kernel>, Image<ValueType>>;
+      using value_type = ValueType;
+
+      TypedImage (const Image<ValueType>& image) :
+        base_type (image),
+        data (image.buffer->get_io()->segment (0)),
+        intensity_offset (image.buffer->intensity_offset()),
+        intensity_scale (image.buffer->intensity_scale()) { }
+
+      FORCE_INLINE ValueType get_value () const {
+        return Kernel::fetch (data, parent().offset(), intensity_offset, intensity_scale);
+      }
+      FORCE_INLINE void set_value (ValueType val) {
+        Kernel::store (val, data, parent().offset(), intensity_offset, intensity_scale);
+      }
+
+    protected:
+      using base_type::parent;
+      void* data;
+      const default_type intensity_offset, intensity_scale;
+  };
+
+
+
+  //! invoke \a functor with the fastest available means of accessing \a image
+  /*! For images using indirect IO whose data reside in a single segment
+   * (the most common case for scaled or byte-swapped data), \a functor is
+   * invoked with a TypedImage, which selects the conversion kernel
+   * appropriate for the image datatype once, rather than on every voxel
+   * access. In all other cases, it is invoked with \a image itself. \a functor
+   * should therefore provide a templated operator() able to accept any of
+   * these types. For example:
+   * \code
+   * struct CopyFunctor {
+   *   Image<float>& out;
+   *   template <class ImageType>
+   *     void operator() (ImageType& in) { threaded_copy (in, out); }
+   * };
+   *
+   * with_typed_io (in, CopyFunctor { out });
+   * \endcode
+   *
+   * \note each call to this function instantiates \a functor for every
+   * supported datatype, which will increase compile times; it should
+   * therefore only be used for the performance-critical parts of the code.
+   */
+  template <typename ValueType, class Functor>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type
+    with_typed_io (Image<ValueType>& image, Functor&& functor);
+
+  template <typename ValueType, class Functor>
+    typename std::enable_if<!is_data_type<ValueType>::value, void>::type
+    with_typed_io (Image<ValueType>& image, Functor&& functor) { functor (image); }
+
+
+
+
 
 
 
@@ -297,6 +366,16 @@ namespace MR
     
     CHECK_MEM_ALIGN (TmpImage<float>);
 
+
+    template <typename ValueType>
+      struct __PreloadFunctor { NOMEMALIGN
+        __PreloadFunctor (TmpImage<ValueType>& dest, const std::string& message) : dest (dest), message (message) { }
+        template <class ImageType>
+          void operator() (ImageType& src) { threaded_copy_with_progress_message (message, src, dest); }
+        TmpImage<ValueType>& dest;
+        const std::string message;
+      };
+
   }
 
 
@@ -400,6 +479,43 @@ namespace MR
 
 
 
+
+
+  //! \cond skip
+  namespace
+  {
+    template <typename ValueType, class Functor>
+      class __TypedIODispatch { NOMEMALIGN
+        public:
+          __TypedIODispatch (Image<ValueType>& image, Functor& functor) : image (image), functor (functor) { }
+          template <class Kernel>
+            void operator() (Kernel) {
+              TypedImage<ValueType,Kernel> typed (image);
+              functor (typed);
+            }
+        protected:
+          Image<ValueType>& image;
+          Functor& functor;
+      };
+  }
+  //! \endcond
+
+  template <typename ValueType, class Functor>
+    typename std::enable_if<is_data_type<ValueType>::value, void>::type
+    with_typed_io (Image<ValueType>& image, Functor&& functor)
+    {
+      const ImageIO::Base* io = image.buffer->get_io();
+      if (image.is_direct_io() || !io || !io->is_file_backed() || io->nsegments() != 1) {
+        functor (image);
+        return;
+      }
+      ImageIO::FetchStore::dispatch<ValueType> (image.buffer->datatype(), 
+          __TypedIODispatch<ValueType,typename std::remove_reference<Functor>::type> (image, functor));
+    }
+
+
+
+
   template <typename ValueType>
     Image<ValueType> Image<ValueType>::with_direct_io (Stride::List with_strides)
     {
@@ -410,7 +526,7 @@ namespace MR
       if (!buffer.unique())
         throw Exception ("FIXME: don't invoke 'with_direct_io()' on images if other copies exist!");
 
-      bool preload = ( buffer->datatype() != DataType::from<ValueType>() ) || ( buffer->get_io()->files.size() > 1 );
+      bool preload = ( buffer->datatype() != DataType::from<ValueType>() ) || ( buffer->get_io()->files.size() > 1 ) || ( buffer->get_io()->nsegments() > 1 );
       if (with_strides.size()) {
         auto new_strides = Stride::get_actual (Stride::get_nearest_match (*this, with_strides), *this);
         preload |= ( new_strides != Stride::get (*this) );
@@ -435,7 +551,7 @@ namespace MR
       else {
         auto src (*this);
         TmpImage<ValueType> dest = { *buffer, buffer->data_buffer.get(), vector<ssize_t> (ndim(), 0), with_strides, Stride::offset (with_strides, *this) };
-        threaded_copy_with_progress_message ("preloading data for \"" + name() + "\"", src, dest); 
+        with_typed_io (src, __PreloadFunctor<ValueType> (dest, "preloading data for \"" + name() + "\""));
       }
 
       return Image (buffer, with_strides);
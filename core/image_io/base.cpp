@@ -51,6 +51,7 @@ namespace MR
       unload (header);
       DEBUG ("image \"" + header.name() + "\" unloaded");
       addresses.clear();
+      pending_segments.reset();
     }
 
 
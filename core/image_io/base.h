@@ -15,6 +15,7 @@
 #ifndef __image_io_base_h__
 #define __image_io_base_h__
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <unistd.h>
@@ -73,6 +74,8 @@ namespace MR
 
         uint8_t* segment (size_t n) const {
           assert (n < addresses.size());
+          if (pending_segments && pending_segments[n].load (std::memory_order_acquire))
+            load_segment (n);
           return addresses[n].get();
         }
         size_t nsegments () const {
@@ -103,6 +106,14 @@ namespace MR
         vector<std::unique_ptr<uint8_t[]>> addresses;
         bool is_new, writable;
 
+        //! flags for segments whose contents have not yet been read
+        /*! Handlers that only read each segment on first access should
+         * allocate one flag per segment, initially set, and override
+         * load_segment() to fill the segment and then clear its flag. This
+         * may be invoked concurrently from multiple threads. */
+        std::unique_ptr<std::atomic<bool>[]> pending_segments;
+        virtual void load_segment (size_t) const { assert (0); }
+
         void check () const {
           assert (addresses.size());
         }
@@ -0,0 +1,158 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <limits>
+
+#include "header.h"
+#include "progressbar.h"
+#include "thread.h"
+#include "image_io/chunked.h"
+#include "file/ofstream.h"
+
+#define BYTES_PER_PROGRESS_INCREMENT 524288
+
+namespace MR
+{
+  namespace ImageIO
+  {
+
+
+    void Chunked::load (const Header& header, size_t)
+    {
+      if (files.size() != 1)
+        throw Exception ("chunked image \"" + header.name() + "\" must be stored in a single file");
+
+      data_size = (header.datatype().bits() * segsize + 7) / 8;
+      if (double (data_size) >= double (std::numeric_limits<size_t>::max()))
+        throw Exception ("image \"" + header.name() + "\" is larger than maximum accessible memory");
+
+      DEBUG ("loading chunked image \"" + header.name() + "\"...");
+
+      if (is_new) {
+        addresses.resize (1);
+        addresses[0].reset (new uint8_t [data_size]);
+        Thread::zero_fill (addresses[0].get(), data_size);
+        segsize = std::numeric_limits<size_t>::max();
+        return;
+      }
+
+      mmap.reset (new File::MMap (files[0], false, false, -1, File::MMap::Access::Random));
+      chunk_index.clear();
+      if (!File::GZBlocks::get_index (mmap->address(), mmap->size(), chunk_index))
+        throw Exception ("invalid or corrupted data in chunked image \"" + header.name() + "\"");
+
+      int64_t total = 0;
+      for (const auto& chunk : chunk_index)
+        total += chunk.out_size;
+      if (total != data_size)
+        throw Exception ("chunked image \"" + header.name() + "\" is " + ( total > data_size ? "larger" : "smaller" ) + " than expected");
+
+      // chunks can each be held in a segment of their own if they all hold
+      // the same whole number of voxels (except possibly the last):
+      const size_t chunk_bytes = chunk_index[0].out_size;
+      bool deferred = chunk_index.size() > 1 && (8 * chunk_bytes) % header.datatype().bits() == 0;
+      for (size_t n = 0; deferred && n < chunk_index.size(); ++n)
+        deferred = (chunk_index[n].out_size == chunk_bytes) || (n == chunk_index.size()-1 && chunk_index[n].out_size < chunk_bytes);
+
+      if (deferred) {
+        DEBUG ("image \"" + header.name() + "\" will be uncompressed on demand from " + str(chunk_index.size()) + " chunks");
+        addresses.resize (chunk_index.size());
+        pending_segments.reset (new std::atomic<bool> [chunk_index.size()]);
+        chunk_mutexes.reset (new std::mutex [chunk_index.size()]);
+        for (size_t n = 0; n < chunk_index.size(); ++n) {
+          addresses[n].reset (new uint8_t [chunk_index[n].out_size]);
+          chunk_index[n].out = addresses[n].get();
+          pending_segments[n] = true;
+        }
+        segsize = (8 * chunk_bytes) / header.datatype().bits();
+        return;
+      }
+
+      addresses.resize (1);
+      addresses[0].reset (new uint8_t [data_size]);
+      uint8_t* address = addresses[0].get();
+      for (auto& chunk : chunk_index) {
+        chunk.out = address;
+        address += chunk.out_size;
+      }
+
+      DEBUG ("uncompressing image \"" + header.name() + "\" from " + str(chunk_index.size()) + " chunks");
+      ProgressBar progress ("uncompressing image \"" + header.name() + "\"", data_size / BYTES_PER_PROGRESS_INCREMENT);
+      size_t bytes_processed = 0;
+      File::GZBlocks::uncompress (chunk_index, header.name(), progress, bytes_processed, BYTES_PER_PROGRESS_INCREMENT);
+      chunk_index.clear();
+      mmap.reset();
+      segsize = std::numeric_limits<size_t>::max();
+    }
+
+
+
+    void Chunked::load_segment (size_t n) const
+    {
+      std::lock_guard<std::mutex> lock (chunk_mutexes[n]);
+      if (!pending_segments[n].load (std::memory_order_acquire))
+        return;
+      File::GZBlocks::uncompress (chunk_index[n], files[0].name);
+      pending_segments[n].store (false, std::memory_order_release);
+    }
+
+
+
+    void Chunked::unload (const Header& header)
+    {
+      if (addresses.empty() || !writable) {
+        mmap.reset();
+        return;
+      }
+
+      assert (addresses[0]);
+      assert (files[0].start == int64_t (lead_in.size()));
+
+      // where each existing chunk is held in its own segment, these must all
+      // be uncompressed before the file is overwritten, and are then written
+      // back as the same chunks:
+      const int64_t segment_bytes = addresses.size() > 1 ? int64_t (chunk_index[0].out_size) : data_size;
+      for (size_t n = 0; n < addresses.size(); ++n)
+        segment (n);
+      mmap.reset();
+
+      File::OFStream out (files[0].name, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+      out.write (lead_in.c_str(), lead_in.size());
+
+      ProgressBar progress ("compressing image \"" + header.name() + "\"", data_size / BYTES_PER_PROGRESS_INCREMENT);
+      size_t bytes_processed = 0;
+      const size_t chunks_per_batch = 4 * std::max (Thread::number_of_threads(), size_t(1));
+      const int64_t max_size = addresses.size() > 1 ? segment_bytes : int64_t (chunk_size);
+      vector<File::GZBlocks::Block> chunks;
+      for (int64_t offset = 0; offset < data_size; ) {
+        const size_t size = std::min (max_size, data_size - offset);
+        const size_t n = offset / segment_bytes;
+        chunks.push_back (File::GZBlocks::Block (addresses[n].get() + (offset - n*segment_bytes), size));
+        offset += size;
+        if (chunks.size() >= chunks_per_batch || offset >= data_size) {
+          File::GZBlocks::compress (chunks, header.name(), progress, bytes_processed, BYTES_PER_PROGRESS_INCREMENT);
+          for (const auto& chunk : chunks)
+            out.write (reinterpret_cast<const char*> (chunk.buffer.data()), chunk.out_size);
+          if (!out.good())
+            throw Exception ("error writing to file \"" + files[0].name + "\": " + strerror (errno));
+          chunks.clear();
+        }
+      }
+    }
+
+
+  }
+}
+
+
@@ -0,0 +1,71 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#ifndef __image_io_chunked_h__
+#define __image_io_chunked_h__
+
+#include <mutex>
+
+#include "image_io/base.h"
+#include "file/gz_blocks.h"
+#include "file/mmap.h"
+
+namespace MR
+{
+
+  namespace ImageIO
+  {
+
+    //! Image IO handler for images stored as independently compressed chunks
+    /*! The file consists of an uncompressed header, followed (at the offset
+     * specified in the corresponding File::Entry) by the image data, split
+     * into chunks of \a chunk_size bytes, each stored as a separate gzip
+     * member as described in File::GZBlocks. Since each chunk records its own
+     * compressed and uncompressed size, the chunks can be located without
+     * uncompressing the data. Each chunk is then held in its own segment,
+     * and is only uncompressed the first time any voxel within it is
+     * accessed, so that reading a sub-region of the image does not require
+     * uncompressing the whole file. Files whose chunks do not all have the
+     * same size (or do not hold a whole number of voxels) are instead
+     * uncompressed in parallel into a single buffer when opened. */
+    class Chunked : public Base
+    { NOMEMALIGN
+      public:
+        Chunked (Chunked&&) = default;
+        Chunked (const Header& header, const std::string& file_header, size_t chunk_size) :
+          Base (header),
+          lead_in (file_header),
+          chunk_size (chunk_size) { }
+
+      protected:
+        const std::string lead_in;
+        const size_t chunk_size;
+        int64_t data_size;
+
+        // location and size of each chunk within the mapped file:
+        std::unique_ptr<File::MMap> mmap;
+        vector<File::GZBlocks::Block> chunk_index;
+        std::unique_ptr<std::mutex[]> chunk_mutexes;
+
+        virtual void load (const Header&, size_t);
+        virtual void unload (const Header&);
+        virtual void load_segment (size_t n) const;
+    };
+
+  }
+}
+
+#endif
+
+
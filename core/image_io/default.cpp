@@ -16,6 +16,7 @@
 
 #include "app.h"
 #include "header.h"
+#include "thread.h"
 #include "file/ofstream.h"
 #include "image_io/default.h"
 
@@ -96,10 +97,10 @@ namespace MR
       if (!addresses[0]) 
         throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
 
-      if (is_new) memset (addresses[0].get(), 0, files.size() * bytes_per_segment);
+      if (is_new) Thread::zero_fill (addresses[0].get(), files.size() * bytes_per_segment);
       else {
         for (size_t n = 0; n < files.size(); n++) {
-          File::MMap file (files[n], false, false, bytes_per_segment);
+          File::MMap file (files[n], false, false, bytes_per_segment, File::MMap::Access::Sequential);
           memcpy (addresses[0].get() + n*bytes_per_segment, file.address(), bytes_per_segment);
         }
       }
@@ -21,102 +21,30 @@ namespace MR
   namespace
   {
 
-    // rounding to be applied during conversion:
-
-    // any -> floating-point
-    template <typename TypeOUT, typename TypeIN>
-      inline typename std::enable_if<std::is_floating_point<TypeOUT>::value, TypeOUT>::type 
-      round_func (TypeIN in, typename std::enable_if<std::is_arithmetic<TypeIN>::value>::type* = nullptr) {
-        return in;
-      }
-
-    // integer -> integer
-    template <typename TypeOUT, typename TypeIN>
-      inline typename std::enable_if<std::is_integral<TypeOUT>::value, TypeOUT>::type 
-      round_func (TypeIN in, typename std::enable_if<std::is_integral<TypeIN>::value>::type* = nullptr) {
-        return in;
-      }
-
-    // floating-point -> integer
-    template <typename TypeOUT, typename TypeIN>
-      inline typename std::enable_if<std::is_integral<TypeOUT>::value, TypeOUT>::type 
-      round_func (TypeIN in, typename std::enable_if<std::is_floating_point<TypeIN>::value>::type* = nullptr) {
-        return std::isfinite (in) ? std::round (in) : TypeOUT (0);
-      }
-
-    // complex -> complex
-    template <typename TypeOUT, typename TypeIN>
-      inline typename std::enable_if<std::is_same<std::complex<typename TypeOUT::value_type>, TypeOUT>::value, TypeOUT>::type 
-      round_func (TypeIN in, typename std::enable_if<std::is_same<std::complex<typename TypeIN::value_type>, TypeIN>::value>::type* = nullptr) {
-        return TypeOUT (in);
-      }
-
-    // real -> complex
-    template <typename TypeOUT, typename TypeIN>
-      inline typename std::enable_if<std::is_same<std::complex<typename TypeOUT::value_type>, TypeOUT>::value, TypeOUT>::type 
-      round_func (TypeIN in, typename std::enable_if<std::is_arithmetic<TypeIN>::value>::type* = nullptr) {
-        return round_func<typename TypeOUT::value_type> (in);
-      }
-
-    // complex -> real
-    template <typename TypeOUT, typename TypeIN>
-      inline typename std::enable_if<std::is_arithmetic<TypeOUT>::value, TypeOUT>::type 
-      round_func (TypeIN in, typename std::enable_if<std::is_same<std::complex<typename TypeIN::value_type>, TypeIN>::value>::type* = nullptr) {
-        return round_func<TypeOUT> (in.real());
-      }
-
-
-
-    // apply scaling from storage:
-    template <typename DiskType>
-      inline typename std::enable_if<std::is_arithmetic<DiskType>::value, default_type>::type 
-      scale_from_storage (DiskType val, default_type offset, default_type scale) {
-        return offset + scale * val;
-      }
-
-    template <typename DiskType>
-      inline typename std::enable_if<std::is_same<std::complex<typename DiskType::value_type>, DiskType>::value, DiskType>::type 
-      scale_from_storage (DiskType val, default_type offset, default_type scale) {
-        return typename DiskType::value_type (offset) + typename DiskType::value_type (scale) * val;
-      }
-
-    // apply scaling to storage:
-    template <typename DiskType>
-      inline typename std::enable_if<std::is_arithmetic<DiskType>::value, default_type>::type 
-      scale_to_storage (DiskType val, default_type offset, default_type scale) {
-        return (val - offset) / scale;
-      }
-
-    template <typename DiskType>
-      inline typename std::enable_if<std::is_same<std::complex<typename DiskType::value_type>, DiskType>::value, DiskType>::type 
-      scale_to_storage (DiskType val, default_type offset, default_type scale) {
-        return (val - typename DiskType::value_type (offset)) / typename DiskType::value_type (scale);
-      }
-
-
+    using namespace ImageIO::FetchStore;
 
     // for single-byte types:
 
     template <typename RAMType, typename DiskType> 
       RAMType __fetch (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch<DiskType> (data, i), offset, scale)); 
+        return Typed<RAMType,DiskType,ImageIO::FetchStore::ByteOrder::Native>::fetch (data, i, offset, scale);
       }
 
     template <typename RAMType, typename DiskType> 
       void __store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i); 
+        Typed<RAMType,DiskType,ImageIO::FetchStore::ByteOrder::Native>::store (val, data, i, offset, scale);
       }
 
     // for little-endian multi-byte types:
 
     template <typename RAMType, typename DiskType> 
       RAMType __fetch_LE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_LE<DiskType> (data, i), offset, scale));
+        return Typed<RAMType,DiskType,ImageIO::FetchStore::ByteOrder::LE>::fetch (data, i, offset, scale);
       }
 
     template <typename RAMType, typename DiskType> 
       void __store_LE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_LE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+        Typed<RAMType,DiskType,ImageIO::FetchStore::ByteOrder::LE>::store (val, data, i, offset, scale);
       }
 
 
@@ -124,15 +52,14 @@ namespace MR
 
     template <typename RAMType, typename DiskType> 
       RAMType __fetch_BE (const void* data, size_t i, default_type offset, default_type scale) {
-        return round_func<RAMType> (scale_from_storage (Raw::fetch_BE<DiskType> (data, i), offset, scale));
+        return Typed<RAMType,DiskType,ImageIO::FetchStore::ByteOrder::BE>::fetch (data, i, offset, scale);
       }
 
     template <typename RAMType, typename DiskType> 
       void __store_BE (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
-        return Raw::store_BE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+        Typed<RAMType,DiskType,ImageIO::FetchStore::ByteOrder::BE>::store (val, data, i, offset, scale);
       }
 
-
   }
 
 
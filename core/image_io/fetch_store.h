@@ -21,6 +21,174 @@
 namespace MR
 {
 
+  namespace ImageIO
+  {
+
+    //! compile-time conversion of voxel values to/from their storage type
+    /*! These provide the same functionality as the fetch & store functions
+     * used by Image::Buffer for indirect IO, but with the datatype and
+     * byte order specified as template parameters. This allows the relevant
+     * kernel to be selected once (via dispatch()), rather than
+     * invoked through a std::function for every voxel access. */
+    namespace FetchStore
+    {
+
+      // rounding to be applied during conversion:
+
+      // any -> floating-point
+      template <typename TypeOUT, typename TypeIN>
+        inline typename std::enable_if<std::is_floating_point<TypeOUT>::value, TypeOUT>::type 
+        round_func (TypeIN in, typename std::enable_if<std::is_arithmetic<TypeIN>::value>::type* = nullptr) {
+          return in;
+        }
+
+      // integer -> integer
+      template <typename TypeOUT, typename TypeIN>
+        inline typename std::enable_if<std::is_integral<TypeOUT>::value, TypeOUT>::type 
+        round_func (TypeIN in, typename std::enable_if<std::is_integral<TypeIN>::value>::type* = nullptr) {
+          return in;
+        }
+
+      // floating-point -> integer
+      template <typename TypeOUT, typename TypeIN>
+        inline typename std::enable_if<std::is_integral<TypeOUT>::value, TypeOUT>::type 
+        round_func (TypeIN in, typename std::enable_if<std::is_floating_point<TypeIN>::value>::type* = nullptr) {
+          return std::isfinite (in) ? std::round (in) : TypeOUT (0);
+        }
+
+      // complex -> complex
+      template <typename TypeOUT, typename TypeIN>
+        inline typename std::enable_if<std::is_same<std::complex<typename TypeOUT::value_type>, TypeOUT>::value, TypeOUT>::type 
+        round_func (TypeIN in, typename std::enable_if<std::is_same<std::complex<typename TypeIN::value_type>, TypeIN>::value>::type* = nullptr) {
+          return TypeOUT (in);
+        }
+
+      // real -> complex
+      template <typename TypeOUT, typename TypeIN>
+        inline typename std::enable_if<std::is_same<std::complex<typename TypeOUT::value_type>, TypeOUT>::value, TypeOUT>::type 
+        round_func (TypeIN in, typename std::enable_if<std::is_arithmetic<TypeIN>::value>::type* = nullptr) {
+          return round_func<typename TypeOUT::value_type> (in);
+        }
+
+      // complex -> real
+      template <typename TypeOUT, typename TypeIN>
+        inline typename std::enable_if<std::is_arithmetic<TypeOUT>::value, TypeOUT>::type 
+        round_func (TypeIN in, typename std::enable_if<std::is_same<std::complex<typename TypeIN::value_type>, TypeIN>::value>::type* = nullptr) {
+          return round_func<TypeOUT> (in.real());
+        }
+
+
+
+      // apply scaling from storage:
+      template <typename DiskType>
+        inline typename std::enable_if<std::is_arithmetic<DiskType>::value, default_type>::type 
+        scale_from_storage (DiskType val, default_type offset, default_type scale) {
+          return offset + scale * val;
+        }
+
+      template <typename DiskType>
+        inline typename std::enable_if<std::is_same<std::complex<typename DiskType::value_type>, DiskType>::value, DiskType>::type 
+        scale_from_storage (DiskType val, default_type offset, default_type scale) {
+          return typename DiskType::value_type (offset) + typename DiskType::value_type (scale) * val;
+        }
+
+      // apply scaling to storage:
+      template <typename DiskType>
+        inline typename std::enable_if<std::is_arithmetic<DiskType>::value, default_type>::type 
+        scale_to_storage (DiskType val, default_type offset, default_type scale) {
+          return (val - offset) / scale;
+        }
+
+      template <typename DiskType>
+        inline typename std::enable_if<std::is_same<std::complex<typename DiskType::value_type>, DiskType>::value, DiskType>::type 
+        scale_to_storage (DiskType val, default_type offset, default_type scale) {
+          return (val - typename DiskType::value_type (offset)) / typename DiskType::value_type (scale);
+        }
+
+
+
+      enum class ByteOrder { Native, LE, BE };
+
+      template <typename RAMType, typename DiskType, ByteOrder Order> class Typed;
+
+      template <typename RAMType, typename DiskType>
+        class Typed<RAMType,DiskType,ByteOrder::Native> { NOMEMALIGN
+          public:
+            using disk_type = DiskType;
+            static FORCE_INLINE RAMType fetch (const void* data, size_t i, default_type offset, default_type scale) {
+              return round_func<RAMType> (scale_from_storage (Raw::fetch<DiskType> (data, i), offset, scale));
+            }
+            static FORCE_INLINE void store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
+              Raw::store<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+            }
+        };
+
+      template <typename RAMType, typename DiskType>
+        class Typed<RAMType,DiskType,ByteOrder::LE> { NOMEMALIGN
+          public:
+            using disk_type = DiskType;
+            static FORCE_INLINE RAMType fetch (const void* data, size_t i, default_type offset, default_type scale) {
+              return round_func<RAMType> (scale_from_storage (Raw::fetch_LE<DiskType> (data, i), offset, scale));
+            }
+            static FORCE_INLINE void store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
+              Raw::store_LE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+            }
+        };
+
+      template <typename RAMType, typename DiskType>
+        class Typed<RAMType,DiskType,ByteOrder::BE> { NOMEMALIGN
+          public:
+            using disk_type = DiskType;
+            static FORCE_INLINE RAMType fetch (const void* data, size_t i, default_type offset, default_type scale) {
+              return round_func<RAMType> (scale_from_storage (Raw::fetch_BE<DiskType> (data, i), offset, scale));
+            }
+            static FORCE_INLINE void store (RAMType val, void* data, size_t i, default_type offset, default_type scale) {
+              Raw::store_BE<DiskType> (round_func<DiskType> (scale_to_storage (val, offset, scale)), data, i);
+            }
+        };
+
+
+
+      //! invoke \a functor with the Typed kernel corresponding to \a datatype
+      /*! \a functor will be invoked with a default-constructed object of
+       * type Typed<RAMType,DiskType,Order> as its only argument, and
+       * should therefore provide a templated operator() able to accept
+       * any of these types. */
+      template <typename RAMType, class Functor>
+        void dispatch (DataType datatype, Functor&& functor)
+        {
+          switch (datatype()) {
+            case DataType::Bit:        functor (Typed<RAMType,bool,ByteOrder::Native>()); return;
+            case DataType::Int8:       functor (Typed<RAMType,int8_t,ByteOrder::Native>()); return;
+            case DataType::UInt8:      functor (Typed<RAMType,uint8_t,ByteOrder::Native>()); return;
+            case DataType::Int16LE:    functor (Typed<RAMType,int16_t,ByteOrder::LE>()); return;
+            case DataType::UInt16LE:   functor (Typed<RAMType,uint16_t,ByteOrder::LE>()); return;
+            case DataType::Int16BE:    functor (Typed<RAMType,int16_t,ByteOrder::BE>()); return;
+            case DataType::UInt16BE:   functor (Typed<RAMType,uint16_t,ByteOrder::BE>()); return;
+            case DataType::Int32LE:    functor (Typed<RAMType,int32_t,ByteOrder::LE>()); return;
+            case DataType::UInt32LE:   functor (Typed<RAMType,uint32_t,ByteOrder::LE>()); return;
+            case DataType::Int32BE:    functor (Typed<RAMType,int32_t,ByteOrder::BE>()); return;
+            case DataType::UInt32BE:   functor (Typed<RAMType,uint32_t,ByteOrder::BE>()); return;
+            case DataType::Int64LE:    functor (Typed<RAMType,int64_t,ByteOrder::LE>()); return;
+            case DataType::UInt64LE:   functor (Typed<RAMType,uint64_t,ByteOrder::LE>()); return;
+            case DataType::Int64BE:    functor (Typed<RAMType,int64_t,ByteOrder::BE>()); return;
+            case DataType::UInt64BE:   functor (Typed<RAMType,uint64_t,ByteOrder::BE>()); return;
+            case DataType::Float32LE:  functor (Typed<RAMType,float,ByteOrder::LE>()); return;
+            case DataType::Float32BE:  functor (Typed<RAMType,float,ByteOrder::BE>()); return;
+            case DataType::Float64LE:  functor (Typed<RAMType,double,ByteOrder::LE>()); return;
+            case DataType::Float64BE:  functor (Typed<RAMType,double,ByteOrder::BE>()); return;
+            case DataType::CFloat32LE: functor (Typed<RAMType,cfloat,ByteOrder::LE>()); return;
+            case DataType::CFloat32BE: functor (Typed<RAMType,cfloat,ByteOrder::BE>()); return;
+            case DataType::CFloat64LE: functor (Typed<RAMType,cdouble,ByteOrder::LE>()); return;
+            case DataType::CFloat64BE: functor (Typed<RAMType,cdouble,ByteOrder::BE>()); return;
+            default:
+              throw Exception ("invalid data type in image header");
+          }
+        }
+
+    }
+  }
+
 
   template <typename ValueType>
     typename std::enable_if<!is_data_type<ValueType>::value, void>::type __set_fetch_store_functions (
@@ -17,8 +17,12 @@
 #include "app.h"
 #include "progressbar.h"
 #include "header.h"
+#include "thread.h"
 #include "image_io/gz.h"
 #include "file/gz.h"
+#include "file/gz_blocks.h"
+#include "file/mmap.h"
+#include "file/ofstream.h"
 
 #define BYTES_PER_ZCALL 524288
 
@@ -27,6 +31,95 @@ namespace MR
   namespace ImageIO
   {
 
+    bool GZ::load_blocks (const File::Entry& entry, uint8_t* address, ProgressBar& progress, size_t& bytes_processed)
+    {
+      File::MMap mmap (File::Entry (entry.name, 0), false, true, -1, File::MMap::Access::WillNeed);
+      vector<File::GZBlocks::Block> index;
+      if (!File::GZBlocks::get_index (mmap.address(), mmap.size(), index))
+        return false;
+
+      DEBUG ("uncompressing image \"" + entry.name + "\" from " + str(index.size()) + " independent blocks");
+
+      // identify the blocks that overlap with the image data, and where
+      // their contents need to go:
+      vector<File::GZBlocks::Block> blocks;
+      vector<std::pair<size_t,size_t>> partial;
+      const size_t data_start = entry.start, data_end = entry.start + bytes_per_segment;
+      size_t offset = 0;
+      for (auto& block : index) {
+        const size_t block_start = offset, block_end = offset + block.out_size;
+        offset = block_end;
+        if (block_end <= data_start || block_start >= data_end || !block.out_size)
+          continue;
+        if (block_start >= data_start && block_end <= data_end)
+          block.out = address + block_start - data_start;
+        else {
+          block.buffer.resize (block.out_size);
+          block.out = block.buffer.data();
+          partial.push_back ({ blocks.size(), block_start });
+        }
+        blocks.push_back (std::move (block));
+      }
+      if (offset < data_end)
+        throw Exception ("compressed image \"" + entry.name + "\" is smaller than expected");
+
+      File::GZBlocks::uncompress (blocks, entry.name, progress, bytes_processed, BYTES_PER_ZCALL);
+
+      // copy across data from blocks that straddle the start or end of the image data:
+      for (const auto& p : partial) {
+        const File::GZBlocks::Block& block (blocks[p.first]);
+        const size_t from = std::max (data_start, p.second), to = std::min (data_end, p.second + block.out_size);
+        memcpy (address + from - data_start, block.out + from - p.second, to - from);
+      }
+
+      return true;
+    }
+
+
+
+
+    void GZ::unload_blocks (const File::Entry& entry, const uint8_t* address, ProgressBar& progress, size_t& bytes_processed)
+    {
+      const size_t block_size = File::GZBlocks::block_size();
+      const size_t blocks_per_batch = 4 * std::max (Thread::number_of_threads(), size_t(1));
+      File::OFStream out (entry.name, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+
+      vector<File::GZBlocks::Block> blocks;
+      auto add_block = [&] (const uint8_t* in, size_t in_size) {
+        blocks.push_back (File::GZBlocks::Block (in, in_size));
+      };
+
+      auto write_blocks = [&] () {
+        File::GZBlocks::compress (blocks, entry.name, progress, bytes_processed, BYTES_PER_ZCALL);
+        for (const auto& block : blocks)
+          out.write (reinterpret_cast<const char*> (block.buffer.data()), block.out_size);
+        if (!out.good())
+          throw Exception ("error writing to file \"" + entry.name + "\": " + strerror (errno));
+        blocks.clear();
+      };
+
+      if (lead_in)
+        add_block (lead_in.get(), lead_in_size);
+
+      for (int64_t offset = 0; offset < bytes_per_segment; ) {
+        const size_t size = std::min (int64_t (block_size), bytes_per_segment - offset);
+        add_block (address + offset, size);
+        offset += size;
+        if (blocks.size() >= blocks_per_batch)
+          write_blocks();
+      }
+
+      if (lead_out)
+        add_block (lead_out.get(), lead_out_size);
+      write_blocks();
+    }
+
+
+
+
+
+
+
     void GZ::load (const Header& header, size_t)
     {
       if (files.empty())
@@ -44,14 +137,17 @@ namespace MR
         throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
 
       if (is_new)
-        memset (addresses[0].get(), 0, files.size() * bytes_per_segment);
+        Thread::zero_fill (addresses[0].get(), files.size() * bytes_per_segment);
       else {
         ProgressBar progress ("uncompressing image \"" + header.name() + "\"",
             files.size() * bytes_per_segment / BYTES_PER_ZCALL);
+        size_t bytes_processed = 0;
         for (size_t n = 0; n < files.size(); n++) {
+          uint8_t* address = addresses[0].get() + n*bytes_per_segment;
+          if (load_blocks (files[n], address, progress, bytes_processed))
+            continue;
           File::GZ zf (files[n].name, "rb");
           zf.seek (files[n].start);
-          uint8_t* address = addresses[0].get() + n*bytes_per_segment;
           uint8_t* last = address + bytes_per_segment - BYTES_PER_ZCALL;
           while (address < last) {
             zf.read (reinterpret_cast<char*> (address), BYTES_PER_ZCALL);
@@ -81,12 +177,17 @@ namespace MR
         if (writable) {
           ProgressBar progress ("compressing image \"" + header.name() + "\"",
               files.size() * bytes_per_segment / BYTES_PER_ZCALL);
+          size_t bytes_processed = 0;
           for (size_t n = 0; n < files.size(); n++) {
             assert (files[n].start == int64_t (lead_in_size));
+            uint8_t* address = addresses[0].get() + n*bytes_per_segment;
+            if (File::GZBlocks::block_size()) {
+              unload_blocks (files[n], address, progress, bytes_processed);
+              continue;
+            }
             File::GZ zf (files[n].name, "wb");
             if (lead_in)
               zf.write (reinterpret_cast<const char*> (lead_in.get()), lead_in_size);
-            uint8_t* address = addresses[0].get() + n*bytes_per_segment;
             uint8_t* last = address + bytes_per_segment - BYTES_PER_ZCALL;
             while (address < last) {
               zf.write (reinterpret_cast<const char*> (address), BYTES_PER_ZCALL);
@@ -108,5 +209,3 @@ namespace MR
 
   }
 }
-
-
@@ -17,6 +17,7 @@
 
 #include "image_io/base.h"
 #include "file/mmap.h"
+#include "progressbar.h"
 
 namespace MR
 {
@@ -24,6 +25,13 @@ namespace MR
   namespace ImageIO
   {
 
+    //! Image IO handler for GZip-compressed images
+    /*! By default, images are written as a series of independently
+     * compressed blocks, each stored as a separate gzip member whose header
+     * records the compressed and uncompressed size of the block (see the
+     * GZBlockSize configuration file option). This remains a valid gzip file,
+     * but allows the blocks to be compressed and uncompressed in parallel.
+     * Files not written in this way are uncompressed as a single stream. */
     class GZ : public Base
     { NOMEMALIGN
       public:
@@ -50,6 +58,9 @@ namespace MR
 
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
+
+        bool load_blocks (const File::Entry& entry, uint8_t* address, ProgressBar& progress, size_t& bytes_processed);
+        void unload_blocks (const File::Entry& entry, const uint8_t* address, ProgressBar& progress, size_t& bytes_processed);
     };
 
   }
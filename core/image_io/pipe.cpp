@@ -17,7 +17,12 @@
 
 #include "signal_handler.h"
 #include "header.h"
+#include "progressbar.h"
+#include "thread.h"
 #include "image_io/pipe.h"
+#include "formats/mrtrix_utils.h"
+
+#define PIPE_STREAM_SLAB_SIZE 4194304
 
 namespace MR
 {
@@ -59,6 +64,67 @@ namespace MR
 
     }
 
+
+
+
+
+
+
+    void PipeStream::load (const Header& header, size_t)
+    {
+      bytes_per_segment = (header.datatype().bits() * segsize + 7) / 8;
+      if (double (bytes_per_segment) >= double (std::numeric_limits<size_t>::max()))
+        throw Exception ("image \"" + header.name() + "\" is larger than maximum accessible memory");
+
+      addresses.resize (1);
+      addresses[0].reset (new uint8_t [bytes_per_segment]);
+      if (!addresses[0])
+        throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
+
+      if (is_new) {
+        Thread::zero_fill (addresses[0].get(), bytes_per_segment);
+        return;
+      }
+
+      DEBUG ("reading streamed image data from standard input...");
+      ProgressBar progress ("reading image from standard input", (bytes_per_segment + PIPE_STREAM_SLAB_SIZE - 1) / PIPE_STREAM_SLAB_SIZE);
+      char* address = reinterpret_cast<char*> (addresses[0].get());
+      for (int64_t offset = 0; offset < bytes_per_segment; offset += PIPE_STREAM_SLAB_SIZE) {
+        const std::streamsize size = std::min (int64_t (PIPE_STREAM_SLAB_SIZE), bytes_per_segment - offset);
+        std::cin.read (address + offset, size);
+        if (std::cin.gcount() != size)
+          throw Exception ("unexpected end of image data on standard input (broken pipe?)");
+        ++progress;
+      }
+    }
+
+
+
+    void PipeStream::unload (const Header& header)
+    {
+      if (addresses.empty())
+        return;
+
+      if (is_new) {
+        DEBUG ("writing streamed image data to standard output...");
+        std::cout << "mrtrix image\n";
+        Formats::write_mrtrix_header (header, std::cout);
+        std::cout << "file: -\nEND\n";
+
+        ProgressBar progress ("writing image to standard output", (bytes_per_segment + PIPE_STREAM_SLAB_SIZE - 1) / PIPE_STREAM_SLAB_SIZE);
+        const char* address = reinterpret_cast<const char*> (addresses[0].get());
+        for (int64_t offset = 0; offset < bytes_per_segment; offset += PIPE_STREAM_SLAB_SIZE) {
+          std::cout.write (address + offset, std::min (int64_t (PIPE_STREAM_SLAB_SIZE), bytes_per_segment - offset));
+          ++progress;
+        }
+        std::cout.flush();
+        if (!std::cout.good())
+          throw Exception ("error writing image data to standard output (broken pipe?)");
+      }
+
+      addresses[0].reset();
+    }
+
   }
 }
 
@@ -36,6 +36,33 @@ namespace MR
         virtual void unload (const Header&);
     };
 
+
+
+    //! Image IO handler for images streamed directly over standard input / output
+    /*! Rather than passing the name of a temporary file down the pipe, the
+     * producer writes the header text, followed immediately by the raw image
+     * data, to standard output, in a series of slabs. The consumer reads the
+     * header from standard input, and the data into its own memory buffer,
+     * so that no intermediate file is ever written to the filesystem.
+     *
+     * Note that the entire image is held in RAM on both sides of the pipe:
+     * the producer may write its output voxels in any order, and so can only
+     * send them once processing is complete; the consumer may likewise
+     * access its input in any order (or more than once), and so must retain
+     * all of it. The data are nonetheless transferred in slabs of
+     * PIPE_STREAM_SLAB_SIZE bytes, so no additional copy is ever needed. */
+    class PipeStream : public Base
+    { NOMEMALIGN
+      public:
+        PipeStream (const Header& header) : Base (header), bytes_per_segment (0) { }
+
+      protected:
+        int64_t bytes_per_segment;
+
+        virtual void load (const Header&, size_t);
+        virtual void unload (const Header&);
+    };
+
   }
 }
 
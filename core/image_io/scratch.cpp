@@ -16,6 +16,7 @@
 
 #include "image_io/scratch.h"
 #include "header.h"
+#include "thread.h"
 
 namespace MR
 {
@@ -30,7 +31,7 @@ namespace MR
       DEBUG ("allocating scratch buffer for image \"" + header.name() + "\"...");
       try {
         addresses.push_back (std::unique_ptr<uint8_t[]> (new uint8_t [buffer_size]));
-        memset (addresses[0].get(), 0, buffer_size);
+        Thread::zero_fill (addresses[0].get(), buffer_size);
       } catch (...) {
         throw Exception ("Error allocating memory for scratch buffer");
       }
@@ -243,6 +243,48 @@ namespace MR
           return coeff_matrix * factors;
         }
 
+        //! Read interpolated values from all volumes along axis 3 in a single pass
+        /*! This is equivalent to row (3), but requires the parent image to
+         * use direct IO with its volumes contiguous in memory (i.e. stride
+         * of 1 along axis 3, as provided by with_direct_io (3)); use
+         * row_is_contiguous() to check this. The data for each of the 8
+         * neighbouring voxels are then accessed directly as contiguous
+         * vectors and blended using vectorised operations, with those of
+         * zero weight skipped altogether, rather than interpolating each
+         * volume separately. */
+        void contiguous_row (Eigen::Matrix<value_type, Eigen::Dynamic, 1>& values) {
+          assert (row_is_contiguous());
+          const ssize_t num_volumes = ImageType::size (3);
+          if (Base<ImageType>::out_of_bounds) {
+            values.setConstant (num_volumes, Base<ImageType>::out_of_bounds_value);
+            return;
+          }
+
+          ssize_t c[] = { ssize_t (std::floor (P[0])), ssize_t (std::floor (P[1])), ssize_t (std::floor (P[2])) };
+
+          values.setZero (num_volumes);
+          ImageType::index(3) = 0;
+
+          size_t i(0);
+          for (ssize_t z = 0; z < 2; ++z) {
+            ImageType::index(2) = clamp (c[2] + z, ImageType::size (2));
+            for (ssize_t y = 0; y < 2; ++y) {
+              ImageType::index(1) = clamp (c[1] + y, ImageType::size (1));
+              for (ssize_t x = 0; x < 2; ++x, ++i) {
+                if (factors[i]) {
+                  ImageType::index(0) = clamp (c[0] + x, ImageType::size (0));
+                  values += factors[i] * Eigen::Map<const Eigen::Matrix<value_type, Eigen::Dynamic, 1>> (ImageType::address(), num_volumes);
+                }
+              }
+            }
+          }
+        }
+
+        //! whether contiguous_row() can be used with the parent image
+        bool row_is_contiguous () const {
+          return ImageType::ndim() == 4 && ImageType::is_direct_io() && ImageType::stride (3) == 1;
+        }
+
       protected:
         Eigen::Matrix<coef_type, 8, 1> factors;
     };
@@ -464,6 +464,35 @@ namespace MR
               return v;
             }
 
+          //! compute the SH basis functions along \a unit_dir
+          /*! This writes the NforL (lmax) values of the basis functions into
+           * \a dest, such that the inner product of these with a vector of SH
+           * coefficients yields the same result as value(). */
+          template <class UnitVectorType>
+            void basis (ValueType* dest, const UnitVectorType& unit_dir) const {
+              PrecomputedFraction<ValueType> f;
+              set (f, std::acos (unit_dir[2]));
+              ValueType rxy = std::sqrt ( pow2(unit_dir[1]) + pow2(unit_dir[0]) );
+              ValueType cp = (rxy) ? unit_dir[0]/rxy : 1.0;
+              ValueType sp = (rxy) ? unit_dir[1]/rxy : 0.0;
+              for (int l = 0; l <= lmax; l+=2)
+                dest[index (l,0)] = get (f,l,0);
+              ValueType c0 (1.0), s0 (0.0);
+              for (int m = 1; m <= lmax; m++) {
+                ValueType c = c0 * cp - s0 * sp;
+                ValueType s = s0 * cp + c0 * sp;
+                for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2) {
+                  const ValueType al = get (f,l,m);
+                  dest[index (l,m)] = al * c;
+                  dest[index (l,-m)] = al * s;
+                }
+                c0 = c;
+                s0 = s;
+              }
+            }
+
+          int get_lmax () const { return lmax; }
+
         protected:
           int lmax, ndir, nAL;
           ValueType inc;
@@ -474,6 +503,115 @@ namespace MR
 
 
 
+      //! evaluate SH series along many directions at once
+      /*! The SH basis functions are computed once for each of the directions
+       * supplied to set_directions(), and stored as the columns of a
+       * matrix. Amplitudes can then be computed either for a single SH
+       * series along all of these directions (a matrix-vector product), or
+       * for a set of SH series each along its own direction (a column-wise
+       * inner product), in both cases as a single vectorised operation.
+       * If a PrecomputedAL object is provided, it will be used to compute the
+       * basis functions, with the same trade-off in accuracy as in
+       * PrecomputedAL::value().
+       *
+       * For example:
+       * \code
+       * Math::SH::BatchEvaluator<float> batch (lmax);
+       * batch.set_directions (directions);
+       * Eigen::VectorXf amplitudes;
+       * batch.values (amplitudes, SH_coefs);
+       * \endcode */
+      template <typename ValueType>
+      class BatchEvaluator { MEMALIGN(BatchEvaluator<ValueType>)
+        public:
+          using value_type = ValueType;
+          using matrix_type = Eigen::Matrix<ValueType, Eigen::Dynamic, Eigen::Dynamic>;
+
+          BatchEvaluator (int lmax, const PrecomputedAL<ValueType>* precomputer = nullptr) :
+            lmax (lmax),
+            precomputer (precomputer && *precomputer ? precomputer : nullptr),
+            AL (lmax+1) {
+              assert (!this->precomputer || this->precomputer->get_lmax() == lmax);
+            }
+
+          //! compute the basis functions along the first \a num directions in \a unit_dirs
+          /*! \a unit_dirs can be any container of unit vectors supporting
+           * operator[] and size(); if \a num is not specified, all
+           * directions are used. */
+          template <class DirectionsType>
+            void set_directions (const DirectionsType& unit_dirs, size_t num = std::numeric_limits<size_t>::max()) {
+              num = std::min (num, size_t (unit_dirs.size()));
+              B.resize (NforL (lmax), num);
+              for (size_t n = 0; n < num; ++n) {
+                if (precomputer)
+                  precomputer->basis (B.col(n).data(), unit_dirs[n]);
+                else
+                  basis (B.col(n).data(), unit_dirs[n]);
+              }
+            }
+
+          //! the amplitude of SH series \a coefs along each direction
+          template <class VectorType1, class VectorType2>
+            void values (VectorType1& amplitudes, const VectorType2& coefs) const {
+              amplitudes.noalias() = B.transpose() * coefs.head (B.rows());
+            }
+
+          //! the amplitude of each column of \a coefs along the corresponding direction
+          template <class VectorType, class MatrixType>
+            void paired_values (VectorType& amplitudes, const MatrixType& coefs) const {
+              assert (coefs.cols() == B.cols());
+              amplitudes = B.cwiseProduct (coefs.topRows (B.rows())).colwise().sum().transpose();
+            }
+
+          //! the amplitude of SH series \a coefs along the direction at index \a n
+          template <class VectorType>
+            value_type value (size_t n, const VectorType& coefs) const {
+              return B.col (n).dot (coefs.head (B.rows()));
+            }
+
+          //! the current basis functions, with one column per direction
+          const matrix_type& basis_matrix () const { return B; }
+          size_t num_directions () const { return B.cols(); }
+
+        protected:
+          const int lmax;
+          const PrecomputedAL<ValueType>* precomputer;
+          matrix_type B;
+          Eigen::Matrix<ValueType,Eigen::Dynamic,1,0,64> AL;
+
+          // equivalent to value(), with the coefficients factored out:
+          template <class UnitVectorType>
+            void basis (ValueType* dest, const UnitVectorType& unit_dir) {
+              ValueType rxy = std::sqrt ( pow2(unit_dir[1]) + pow2(unit_dir[0]) );
+              ValueType cp = (rxy) ? unit_dir[0]/rxy : 1.0;
+              ValueType sp = (rxy) ? unit_dir[1]/rxy : 0.0;
+              Legendre::Plm_sph (AL, lmax, 0, ValueType (unit_dir[2]));
+              for (int l = 0; l <= lmax; l+=2)
+                dest[index (l,0)] = AL[l];
+              ValueType c0 (1.0), s0 (0.0);
+              for (int m = 1; m <= lmax; m++) {
+                Legendre::Plm_sph (AL, lmax, m, ValueType (unit_dir[2]));
+                ValueType c = c0 * cp - s0 * sp;
+                ValueType s = s0 * cp + c0 * sp;
+                for (int l = ( (m&1) ? m+1 : m); l <= lmax; l+=2) {
+#ifndef USE_NON_ORTHONORMAL_SH_BASIS
+                  dest[index (l,m)]  = AL[l] * Math::sqrt2 * c;
+                  dest[index (l,-m)] = AL[l] * Math::sqrt2 * s;
+#else
+                  dest[index (l,m)]  = AL[l] * c;
+                  dest[index (l,-m)] = AL[l] * s;
+#endif
+                }
+                c0 = c;
+                s0 = s;
+              }
+            }
+      };
+
+
+
+
+
 
       //! estimate direction & amplitude of SH peak
       /*! find a peak of an SH series using Gauss-Newton optimisation, modified
@@ -556,11 +694,19 @@ namespace MR
 
           dSH_del = dSH_daz = d2SH_del2 = d2SH_deldaz = d2SH_daz2 = 0.0;
           VLA_MAX (AL, value_type, NforL_mpos (lmax), 64);
+          std::fill_n (AL, NforL_mpos (lmax), value_type (0.0));
 
           if (precomputer) {
             PrecomputedFraction<value_type> f;
             precomputer->set (f, elevation);
             precomputer->get (AL, f);
+#ifndef USE_NON_ORTHONORMAL_SH_BASIS
+            // the precomputed values include the scale factor for m != 0,
+            // which is applied to the azimuthal terms below:
+            for (int l = 2; l <= lmax; l+=2)
+              for (int m = 1; m <= l; m++)
+                AL[index_mpos (l,m)] /= Math::sqrt2;
+#endif
           }
           else {
             Eigen::Matrix<value_type,Eigen::Dynamic,1,0,64> buf (lmax+1);
@@ -623,6 +769,248 @@ namespace MR
 
 
 
+      //! find the peaks of a packet of SH series at once
+      /*! This performs the same Gauss-Newton search as get_peak(), but for
+       * up to \a Lanes SH series in lock-step, with the arithmetic
+       * vectorised across the series in the packet. The trigonometric
+       * functions of the elevation and azimuth are obtained directly from
+       * the current direction, and those of multiples of the azimuth by
+       * recurrence, so that results agree with get_peak() to within
+       * floating-point precision. Each series in the packet is updated until
+       * it has converged, after which its direction is left unchanged while
+       * the search continues for the others.
+       *
+       * For example:
+       * \code
+       * Math::SH::PeakFinder<float> finder (lmax, precomputer);
+       * for (int n = 0; n < num; ++n) {
+       *   finder.coefficients().row(n) = SH_coefs[n].transpose();
+       *   dirs.row(n) = init_dirs[n].transpose();
+       * }
+       * finder (dirs, amplitudes, num);
+       * \endcode */
+      template <typename ValueType, int Lanes = 8>
+      class PeakFinder
+      { MEMALIGN(PeakFinder<ValueType,Lanes>)
+        public:
+          using lane_type = Eigen::Array<ValueType,Lanes,1>;
+          using mask_type = Eigen::Array<bool,Lanes,1>;
+          using coefs_type = Eigen::Array<ValueType,Lanes,Eigen::Dynamic>;
+          using dirs_type = Eigen::Array<ValueType,Lanes,3>;
+
+          PeakFinder (int lmax, const PrecomputedAL<ValueType>* precomputer = nullptr) :
+              lmax (lmax),
+              precomputer (precomputer && *precomputer ? precomputer : nullptr),
+              coefs (Lanes, NforL (lmax)),
+              AL (Lanes, NforL_mpos (lmax)),
+              scale (NforL_mpos (lmax)),
+              buffer (NforL_mpos (lmax)),
+              Plm (lmax+1)
+          {
+            assert (!this->precomputer || this->precomputer->get_lmax() == lmax);
+            coefs.setZero();
+            AL.setZero();
+            // the precomputed values include the scale factor for m != 0,
+            // which is applied to the azimuthal terms instead:
+            for (int l = 0; l <= lmax; l += 2) {
+              for (int m = 0; m <= l; ++m)
+#ifndef USE_NON_ORTHONORMAL_SH_BASIS
+                scale[index_mpos (l,m)] = (this->precomputer && m) ? ValueType (1.0 / Math::sqrt2) : ValueType (1.0);
+#else
+                scale[index_mpos (l,m)] = 1.0;
+#endif
+            }
+
+            for (int l = 2; l <= lmax; l += 2) {
+              Zonal t;
+              t.v = index (l,0);
+              t.a0 = index_mpos (l,0);
+              t.a1 = index_mpos (l,1);
+              t.a2 = index_mpos (l,2);
+              t.k1 = std::sqrt (l*(l+1.0));
+              t.k2 = 0.5 * std::sqrt (l*(l+1.0)*(l-1.0)*(l+2.0));
+              t.k0 = 0.5 * l*(l+1.0);
+              zonal.push_back (t);
+            }
+
+            for (int m = 1; m <= lmax; ++m) {
+              for (int l = ((m&1) ? m+1 : m); l <= lmax; l += 2) {
+                Term t;
+                t.m = m;
+                t.vp = index (l,m);
+                t.vm = index (l,-m);
+                t.a0 = index_mpos (l,m);
+                t.am1 = index_mpos (l,m-1);
+                t.ap1 = l > m ? index_mpos (l,m+1) : t.a0;
+                t.am2 = m == 1 ? index_mpos (l,1) : index_mpos (l,m-2);
+                t.ap2 = l > m+1 ? index_mpos (l,m+2) : t.a0;
+                t.k_m1 = -0.5 * std::sqrt ((l+m) * (l-m+1.0));
+                t.k_p1 = l > m ? 0.5 * std::sqrt ((l-m) * (l+m+1.0)) : 0.0;
+                t.k2_0 = -0.25 * ((l+m) * (l-m+1.0) + (l-m) * (l+m+1.0));
+                t.k2_m2 = (m == 1 ? -0.25 : 0.25) * std::sqrt ((l+m) * (l-m+1.0) * (l+m-1.0) * (l-m+2.0));
+                t.k2_p2 = l > m+1 ? 0.25 * std::sqrt ((l-m) * (l+m+1.0) * (l-m-1.0) * (l+m+2.0)) : 0.0;
+                terms.push_back (t);
+              }
+            }
+          }
+
+          //! the SH coefficients of each series in the packet, one per row
+          coefs_type& coefficients () { return coefs; }
+
+          //! find the peaks of the first \a num_lanes series in the packet
+          /*! On input, each row of \a dirs holds the initial (unit) search
+           * direction for the corresponding series; on output, it holds the
+           * direction of the peak found, and \a amplitudes the amplitude of
+           * the series along that direction. As for get_peak(), both are
+           * set to NaN if the search fails to converge. */
+          void operator() (dirs_type& dirs, lane_type& amplitudes, int num_lanes = Lanes)
+          {
+            assert (num_lanes <= Lanes);
+            mask_type done;
+            for (int n = 0; n < Lanes; ++n)
+              done[n] = n >= num_lanes;
+
+            for (int iter = 0; iter < 50; ++iter) {
+              const lane_type x (dirs.col(0)), y (dirs.col(1)), z (dirs.col(2));
+              const lane_type rxy = (x.square() + y.square()).sqrt();
+              const lane_type cel = z, sel = rxy;
+              const lane_type caz = (rxy > ValueType(0.0)).select (x / rxy, lane_type::Ones());
+              const lane_type saz = (rxy > ValueType(0.0)).select (y / rxy, lane_type::Zero());
+              const mask_type atpole = sel < ValueType(1e-4);
+
+              for (int n = 0; n < num_lanes; ++n)
+                if (!done[n])
+                  get_AL (n, z[n]);
+
+              lane_type amplitude, dSH_del, dSH_daz, dSH_daz_pole, d2SH_del2, d2SH_deldaz, d2SH_daz2;
+              amplitude = coefs.col(0) * AL.col(0);
+              dSH_del = dSH_daz = dSH_daz_pole = d2SH_del2 = d2SH_deldaz = d2SH_daz2 = lane_type::Zero();
+
+              for (const auto& t : zonal) {
+                const lane_type v (coefs.col (t.v));
+                amplitude += v * AL.col (t.a0);
+                dSH_del += t.k1 * v * AL.col (t.a1);
+                d2SH_del2 += v * (t.k2 * AL.col (t.a2) - t.k0 * AL.col (t.a0));
+              }
+
+              lane_type c0 = lane_type::Ones(), s0 = lane_type::Zero(), c (c0), s (s0);
+              int m = 0;
+              for (const auto& t : terms) {
+                if (t.m != m) {
+                  c = c0 * caz - s0 * saz;
+                  s = s0 * caz + c0 * saz;
+                  c0 = c;
+                  s0 = s;
+                  m = t.m;
+#ifndef USE_NON_ORTHONORMAL_SH_BASIS
+                  c *= ValueType (Math::sqrt2);
+                  s *= ValueType (Math::sqrt2);
+#endif
+                }
+                const lane_type vp (coefs.col (t.vp)), vm (coefs.col (t.vm));
+                const lane_type cos_term = vp*c + vm*s;
+                const lane_type sin_term = vm*c - vp*s;
+                const lane_type tmp = t.k_m1 * AL.col (t.am1) + t.k_p1 * AL.col (t.ap1);
+                const lane_type tmp2 = t.k2_0 * AL.col (t.a0) + t.k2_m2 * AL.col (t.am2) + t.k2_p2 * AL.col (t.ap2);
+                amplitude += cos_term * AL.col (t.a0);
+                dSH_del += cos_term * tmp;
+                d2SH_del2 += cos_term * tmp2;
+                dSH_daz_pole += sin_term * tmp;
+                d2SH_deldaz += ValueType (m) * sin_term * tmp;
+                dSH_daz += ValueType (m) * sin_term * AL.col (t.a0);
+                d2SH_daz2 -= ValueType (m*m) * cos_term * AL.col (t.a0);
+              }
+
+              dSH_daz = atpole.select (dSH_daz_pole, dSH_daz / sel);
+              d2SH_deldaz = atpole.select (lane_type::Zero(), d2SH_deldaz / sel);
+              d2SH_daz2 = atpole.select (lane_type::Zero(), d2SH_daz2 / sel.square());
+
+              lane_type del = (dSH_del.square() + dSH_daz.square()).sqrt();
+              const mask_type nonzero = del != ValueType(0.0);
+              lane_type daz = nonzero.select (dSH_daz / del, lane_type::Zero());
+              del = nonzero.select (dSH_del / del, lane_type::Zero());
+
+              const lane_type dSH_dt = daz*dSH_daz + del*dSH_del;
+              const lane_type d2SH_dt2 = daz.square()*d2SH_daz2 + ValueType(2.0)*daz*del*d2SH_deldaz + del.square()*d2SH_del2;
+              const lane_type dt = (d2SH_dt2 != ValueType(0.0)).select (-dSH_dt / d2SH_dt2, lane_type::Zero()).abs().min (ValueType (MAX_DIR_CHANGE));
+
+              del *= dt;
+              daz *= dt;
+              lane_type nx = x + del*caz*cel - daz*saz;
+              lane_type ny = y + del*saz*cel + daz*caz;
+              lane_type nz = z - del*sel;
+              const lane_type norm = (nx.square() + ny.square() + nz.square()).sqrt();
+              dirs.col(0) = done.select (x, nx / norm);
+              dirs.col(1) = done.select (y, ny / norm);
+              dirs.col(2) = done.select (z, nz / norm);
+
+              bool all_done = true;
+              for (int n = 0; n < num_lanes; ++n) {
+                if (!done[n] && dt[n] < ValueType (ANGLE_TOLERANCE)) {
+                  amplitudes[n] = amplitude[n];
+                  done[n] = true;
+                }
+                all_done = all_done && done[n];
+              }
+              if (all_done)
+                return;
+            }
+
+            for (int n = 0; n < num_lanes; ++n) {
+              if (!done[n]) {
+                dirs.row(n).setConstant (NaN);
+                amplitudes[n] = NaN;
+                DEBUG ("failed to find SH peak!");
+              }
+            }
+          }
+
+        protected:
+          class Zonal { NOMEMALIGN
+            public:
+              int v, a0, a1, a2;
+              ValueType k1, k2, k0;
+          };
+          class Term { NOMEMALIGN
+            public:
+              int m, vp, vm, a0, am1, ap1, am2, ap2;
+              ValueType k_m1, k_p1, k2_0, k2_m2, k2_p2;
+          };
+
+          const int lmax;
+          const PrecomputedAL<ValueType>* precomputer;
+          coefs_type coefs;
+          Eigen::Array<ValueType,Lanes,Eigen::Dynamic> AL;
+          vector<ValueType> scale, buffer;
+          Eigen::Matrix<ValueType,Eigen::Dynamic,1,0,64> Plm;
+          vector<Zonal> zonal;
+          vector<Term> terms;
+
+          // the associated Legendre functions at the elevation of unit direction with z-component cos_el:
+          void get_AL (int lane, ValueType cos_el)
+          {
+            if (precomputer) {
+              PrecomputedFraction<ValueType> f;
+              precomputer->set (f, std::acos (cos_el));
+              precomputer->get (buffer.data(), f);
+            }
+            else {
+              for (int m = 0; m <= lmax; m++) {
+                Legendre::Plm_sph (Plm, lmax, m, cos_el);
+                for (int l = ((m&1) ? m+1 : m); l <= lmax; l+=2)
+                  buffer[index_mpos (l,m)] = Plm[l];
+              }
+            }
+            for (size_t i = 0; i < buffer.size(); ++i)
+              AL(lane,i) = buffer[i] * scale[i];
+          }
+      };
+
+
+
+
+
+
       //! a class to hold the coefficients for an apodised point-spread function.
       template <typename ValueType> class aPSF
       { MEMALIGN(aPSF<ValueType>)
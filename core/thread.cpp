@@ -14,10 +14,21 @@
 
 #include <thread>
 #include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+
+#ifdef __linux__
+# include <pthread.h>
+# include <sched.h>
+#endif
 
 #include "app.h"
 #include "thread.h"
 #include "file/config.h"
+#include "file/json.h"
+#include "file/ofstream.h"
 #include "thread_queue.h"
 
 namespace MR
@@ -29,8 +40,255 @@ namespace MR
 
       size_t __number_of_threads = 0;
 
+
+
+      // pin the calling thread to the index'th CPU available to the process
+      // (modulo the number of CPUs), so that the memory it first touches
+      // remains local to it:
+      void pin_to_cpu (size_t index)
+      {
+#ifdef __linux__
+        cpu_set_t available;
+        if (sched_getaffinity (0, sizeof (available), &available))
+          return;
+        const size_t num_cpus = CPU_COUNT (&available);
+        if (!num_cpus)
+          return;
+        index %= num_cpus;
+        for (size_t cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+          if (CPU_ISSET (cpu, &available) && !(index--)) {
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            CPU_SET (cpu, &set);
+            if (pthread_setaffinity_np (pthread_self(), sizeof (set), &set))
+              DEBUG ("failed to set affinity of worker thread to CPU " + str(cpu));
+            return;
+          }
+        }
+#endif
+      }
+
+
+
+      // process-wide pool of persistent worker threads. Workers are only
+      // ever added, when a task is submitted and no idle worker is available
+      // to take it; the pool therefore grows to the maximum number of
+      // concurrently running tasks, and its threads are then re-used
+      // throughout the lifetime of the process.
+      class __WorkerPool { NOMEMALIGN
+        public:
+          __WorkerPool () : idle (0), num_workers (0) { }
+
+          std::future<void> launch (std::packaged_task<void()>&& task) {
+            auto future = task.get_future();
+            std::lock_guard<std::mutex> lock (mutex);
+            tasks.push_back (std::move (task));
+            if (tasks.size() > idle) {
+              DEBUG ("adding worker thread to pool");
+              std::thread (&__WorkerPool::worker, this, num_workers++).detach();
+            }
+            else
+              cond.notify_one();
+            return future;
+          }
+
+        protected:
+          std::mutex mutex;
+          std::condition_variable cond;
+          std::deque<std::packaged_task<void()>> tasks;
+          size_t idle, num_workers;
+
+          void worker (size_t index) {
+            if (numa_aware())
+              pin_to_cpu (index);
+            std::unique_lock<std::mutex> lock (mutex);
+            while (true) {
+              while (tasks.empty()) {
+                ++idle;
+                cond.wait (lock);
+                --idle;
+              }
+              auto task = std::move (tasks.front());
+              tasks.pop_front();
+              lock.unlock();
+              task();
+              lock.lock();
+            }
+          }
+      };
+
+      // intentionally never destroyed: idle workers remain blocked on the
+      // pool's condition variable until the process exits
+      __WorkerPool& worker_pool ()
+      {
+        static __WorkerPool* pool = new __WorkerPool;
+        return *pool;
+      }
+
     }
 
+
+
+    std::future<void> __launch (std::packaged_task<void()>&& task)
+    {
+      return worker_pool().launch (std::move (task));
+    }
+
+
+
+
+    //CONF option: NUMAAware
+    //CONF default: 0 (false)
+    //CONF If true, worker threads are each pinned to a single CPU core, and
+    //CONF large image buffers are initialised in parallel by these threads,
+    //CONF so that their memory pages are distributed over the NUMA nodes of
+    //CONF the system rather than all residing on the node of the main thread.
+    //CONF This can improve performance on multi-socket systems.
+    bool numa_aware ()
+    {
+      static const bool value = File::Config::get_bool ("NUMAAware", false);
+      return value;
+    }
+
+
+
+    namespace {
+      class __FirstTouch { NOMEMALIGN
+        public:
+          uint8_t* address;
+          size_t size, block_size;
+          std::atomic<size_t>& next;
+          void execute () {
+            size_t block;
+            while ((block = next++) * block_size < size)
+              memset (address + block * block_size, 0, std::min (block_size, size - block * block_size));
+          }
+      };
+    }
+
+    void first_touch (uint8_t* address, size_t size)
+    {
+      const size_t nthreads = number_of_threads();
+      if (nthreads < 2) {
+        memset (address, 0, size);
+        return;
+      }
+      // page-aligned blocks, one per thread on average, claimed in turn by
+      // whichever thread is next available:
+      const size_t block_size = ((size / nthreads + 4095) / 4096) * 4096;
+      std::atomic<size_t> next (0);
+      __FirstTouch functor = { address, size, std::max (block_size, size_t (4096)), next };
+      run (multi (functor, nthreads), "first touch").wait();
+    }
+
+
+
+    void zero_fill (uint8_t* address, size_t size)
+    {
+      if (numa_aware() && size >= MRTRIX_FIRST_TOUCH_MIN_SIZE)
+        first_touch (address, size);
+      else
+        memset (address, 0, size);
+    }
+
+
+
+
+    namespace {
+
+      const char* queue_trace_file ()
+      {
+        static const char* filename = getenv ("MRTRIX_QUEUE_TRACE");
+        return filename;
+      }
+
+      bool queue_stats_requested ()
+      {
+        static const bool requested = getenv ("MRTRIX_QUEUE_STATS");
+        return requested;
+      }
+
+      // collects the events to be written to the trace file, until they
+      // are written out in Chrome trace event format by write_queue_trace():
+      class __QueueTrace { NOMEMALIGN
+        public:
+          __QueueTrace () : start (std::chrono::steady_clock::now()) { }
+
+          void add (const std::string& queue, const char* event,
+              std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+            using namespace std::chrono;
+            std::lock_guard<std::mutex> lock (mutex);
+            auto thread = threads.insert (std::make_pair (std::this_thread::get_id(), threads.size()+1)).first;
+            nlohmann::json entry;
+            entry["name"] = event;
+            entry["cat"] = queue;
+            entry["ph"] = "X";
+            entry["pid"] = 1;
+            entry["tid"] = thread->second;
+            entry["ts"] = int64_t (duration_cast<microseconds> (from - start).count());
+            entry["dur"] = int64_t (duration_cast<microseconds> (to - from).count());
+            events.push_back (std::move (entry));
+          }
+
+          void write () {
+            std::lock_guard<std::mutex> lock (mutex);
+            if (events.empty())
+              return;
+            nlohmann::json trace;
+            trace["traceEvents"] = events;
+            events.clear();
+            File::OFStream out (queue_trace_file());
+            out << trace << "\n";
+          }
+
+        protected:
+          const std::chrono::steady_clock::time_point start;
+          std::mutex mutex;
+          std::map<std::thread::id,size_t> threads;
+          vector<nlohmann::json> events;
+      };
+
+      __QueueTrace queue_trace;
+
+    }
+
+
+
+    bool __queue_instrumentation ()
+    {
+      return App::log_level >= 3 || queue_stats_requested() || queue_trace_file();
+    }
+
+    void __queue_report (const std::string& message)
+    {
+      if (queue_stats_requested()) {
+        CONSOLE (message);
+      }
+      else {
+        DEBUG (message);
+      }
+    }
+
+    void __queue_trace (const std::string& queue, const char* event,
+        std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+    {
+      if (queue_trace_file())
+        queue_trace.add (queue, event, start, end);
+    }
+
+    void write_queue_trace ()
+    {
+      if (!queue_trace_file())
+        return;
+      try {
+        queue_trace.write();
+      }
+      catch (Exception& E) {
+        E.display();
+      }
+    }
+
+
     //CONF option: NumberOfThreads
     //CONF default: number of threads provided by hardware
     //CONF Set the default number of CPU threads to use for multi-threading.
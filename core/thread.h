@@ -23,6 +23,8 @@
 #include "mrtrix.h"
 #include "exception.h"
 
+#define MRTRIX_FIRST_TOUCH_MIN_SIZE 16777216
+
 /** \defgroup thread_classes Multi-threading
  * \brief functions to provide support for multi-threading
  *
@@ -90,6 +92,18 @@ namespace MR
     };
 
 
+    //! launch \a task on a thread drawn from the persistent worker pool
+    /*! Worker threads are created on demand, and return to the pool once
+     * their task has completed, so that they can be re-used for subsequent
+     * tasks rather than being joined and destroyed. A task is always handed
+     * to an idle worker if one exists, or to a freshly created worker
+     * otherwise: tasks are never queued behind one another, so tasks that
+     * block on each other (as in a Thread::run_queue() pipeline) cannot
+     * deadlock. Any exception thrown by the task is stored in the returned
+     * future. */
+    std::future<void> __launch (std::packaged_task<void()>&& task);
+
+
     namespace {
 
       class __thread_base { NOMEMALIGN
@@ -112,7 +126,8 @@ namespace MR
             __thread_base (name) { 
               DEBUG ("launching thread \"" + name + "\"...");
               using F = typename std::remove_reference<Functor>::type;
-              thread = std::async (std::launch::async, &F::execute, &functor);
+              F* f = &functor;
+              thread = __launch (std::packaged_task<void()> ([f] { f->execute(); }));
             }
           __single_thread (const __single_thread&) = delete;
           __single_thread (__single_thread&&) = default;
@@ -143,9 +158,10 @@ namespace MR
                 DEBUG ("launching " + str (nthreads) + " threads \"" + name + "\"...");
                 using F = typename std::remove_reference<Functor>::type;
                 threads.reserve (nthreads);
+                auto launch = [] (F* f) { return __launch (std::packaged_task<void()> ([f] { f->execute(); })); };
                 for (auto& f : functors) 
-                  threads.push_back (std::async (std::launch::async, &F::execute, &f));
-                threads.push_back (std::async (std::launch::async, &F::execute, &functor));
+                  threads.push_back (launch (&f));
+                threads.push_back (launch (&functor));
               }
 
             __multi_thread (const __multi_thread&) = delete;
@@ -242,6 +258,36 @@ namespace MR
     size_t number_of_threads ();
 
 
+    //! whether NUMA-aware operation has been requested
+    /*! This is set using the NUMAAware config file option. If set, worker
+     * threads are pinned to individual CPU cores, and zero_fill() initialises
+     * large buffers using multiple threads. */
+    bool numa_aware ();
+
+    //! zero-fill a buffer using all available threads
+    /*! The buffer is split into as many page-aligned blocks as there are
+     * threads, which are handed out to the threads dynamically: a thread
+     * that finishes early may zero more than one block, and another none.
+     * On NUMA systems (and provided the memory has not already been
+     * touched), each block will then be allocated on the node local to
+     * whichever thread zeroed it. This spreads the buffer over the nodes in
+     * use, but does not match blocks to the threads that will later process
+     * them, since ThreadedLoop also distributes its work dynamically. */
+    void first_touch (uint8_t* address, size_t size);
+
+    //! zero-fill a newly allocated buffer
+    /*! This invokes first_touch() if NUMA-aware operation has been requested
+     * and the buffer is large, and a plain memset() otherwise. */
+    void zero_fill (uint8_t* address, size_t size);
+
+    //! write out the queue trace file, if one was requested
+    /*! If the MRTRIX_QUEUE_TRACE environment variable is set, the stalls
+     * recorded by instrumented queues up to this point are written to the
+     * corresponding file in Chrome trace event format. This is invoked by
+     * main() once the command has completed (successfully or otherwise). */
+    void write_queue_trace ();
+
+
 
     //! used to request multiple threads of the corresponding functor
     /*! This function is used in combination with Thread::run or
@@ -15,7 +15,8 @@
 #ifndef __mrtrix_thread_queue_h__
 #define __mrtrix_thread_queue_h__
 
-#include <stack>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 
 #include "memory.h"
@@ -23,6 +24,7 @@
 
 #define MRTRIX_QUEUE_DEFAULT_CAPACITY 128
 #define MRTRIX_QUEUE_DEFAULT_BATCH_SIZE 128
+#define MRTRIX_QUEUE_SPIN_COUNT 64
 
 namespace MR
 {
@@ -31,6 +33,23 @@ namespace MR
 
 
     //* \cond skip
+
+    // support for instrumentation of Thread::Queue, implemented in thread.cpp:
+
+    //! whether queues should record their statistics
+    /*! This is the case if the application is running at debug log level,
+     * or if either of the MRTRIX_QUEUE_STATS or MRTRIX_QUEUE_TRACE environment
+     * variables is set. */
+    bool __queue_instrumentation ();
+
+    //! report the statistics for a queue, as DEBUG or CONSOLE output
+    void __queue_report (const std::string& message);
+
+    //! add an event to the trace file (if requested)
+    void __queue_trace (const std::string& queue, const char* event,
+        std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+
     namespace {
 
       /********************************************************************
@@ -122,8 +141,8 @@ namespace MR
      *
      * By default, items are push to and pulled from the queue one by one. In
      * situations where the amount of processing per item is small, items can
-     * be sent in batches to reduce the overhead of thread management (mutex
-     * locking/unlocking, etc). 
+     * be sent in batches to reduce the overhead of thread management (atomic
+     * operations, waking up of blocked threads, etc). 
      *
      * The simplest way to use this functionality is via the
      * Thread::run_queue() and associated Thread::multi() and Thread::batch()
@@ -342,6 +361,20 @@ namespace MR
      * pointers, and ensuring the Queue itself is responsible for all
      * allocation and deallocation of items as needed.
      *
+     * \section thread_queue_instrumentation Instrumentation
+     *
+     * To help identify the bottleneck in a pipeline, each queue can record
+     * the number of items passed through it, the mean number of items
+     * waiting in the queue, and the total time its writers spent stalled
+     * waiting for space, and its readers stalled waiting for data. These
+     * statistics are reported when the queue is destroyed. This is enabled
+     * when running at debug log level (i.e. with the \c -debug option), or by
+     * setting the \c MRTRIX_QUEUE_STATS environment variable, in which case
+     * the report is shown on the console at the normal log level. If the
+     * \c MRTRIX_QUEUE_TRACE environment variable is set to a file name, each
+     * stall is additionally recorded as an event in that file, in the Chrome
+     * trace event JSON format (viewable using e.g. chrome://tracing). 
+     *
      * \sa Thread::run_queue()
      */
     template <class T> class Queue { NOMEMALIGN
@@ -355,33 +388,38 @@ namespace MR
          * MRTRIX_QUEUE_DEFAULT_CAPACITY items.
          */
         Queue (const std::string& description = "unnamed", size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY) :
-          buffer (new T* [buffer_size]),
-          front (buffer),
-          back (buffer),
-          capacity (buffer_size),
+          slots (std::max (buffer_size, size_t (2))),
+          capacity (slots.size()),
+          head (0),
+          tail (0),
           writer_count (0),
           reader_count (0),
-          name (description) {
-          assert (capacity > 0);
+          writers_waiting (0),
+          readers_waiting (0),
+          name (description),
+          instrumented (__queue_instrumentation()),
+          num_writers (0),
+          num_readers (0),
+          items_pushed (0),
+          occupancy (0),
+          writer_stall (0),
+          reader_stall (0),
+          created (std::chrono::steady_clock::now()) {
+          assert (buffer_size > 0);
+          for (size_t n = 0; n < capacity; ++n)
+            slots[n].sequence.store (n, std::memory_order_relaxed);
         }
 
         //! needed for Thread::run_queue()
         Queue (const T& /*item_type*/, const std::string& description = "unnamed", size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY) :
-          buffer (new T* [buffer_size]),
-          front (buffer),
-          back (buffer),
-          capacity (buffer_size),
-          writer_count (0),
-          reader_count (0),
-          name (description) {
-          assert (capacity > 0);
-        }
-
+          Queue (description, buffer_size) { }
 
         ~Queue () {
-          delete [] buffer;
+          if (instrumented)
+            report();
         }
 
+
         //! This class is used to register a writer with the queue
         /*! Items cannot be written directly onto a Thread::Queue queue. An
          * object of this class must first be instanciated to notify the queue
@@ -521,102 +559,232 @@ namespace MR
                     << reader_count << " reader" << (reader_count > 1 ? "s" : "") << ", items waiting: " << size() << "\n";
         }
 
+        //! Report the statistics gathered over the lifetime of the queue
+        /*! This is invoked automatically on destruction of the queue if
+         * instrumentation is enabled. The time spent stalled is totalled over
+         * all writer or reader threads, and also expressed as a fraction of
+         * the total time available to those threads. Writers stalled waiting
+         * for space indicate that the downstream stage is the bottleneck;
+         * readers stalled waiting for data indicate the upstream stage is. */
+        void report () const {
+          const double elapsed = std::chrono::duration<double> (std::chrono::steady_clock::now() - created).count();
+          const uint64_t count = items_pushed;
+          auto stalled = [&] (uint64_t ns, size_t nthreads) {
+            const double seconds = 1.0e-9 * ns;
+            return str(seconds, 4) + " s (" + str (nthreads ? 100.0 * seconds / (nthreads * elapsed) : 0.0, 3) + "%)";
+          };
+          __queue_report ("Thread::Queue \"" + name + "\": " + str(count) + " items in " + str(elapsed, 4) + " s ("
+              + str(elapsed > 0.0 ? count / elapsed : 0.0, 4) + " items/s), mean occupancy "
+              + str(count ? double (occupancy) / count : 0.0, 3) + " / " + str(capacity) + "; "
+              + str(num_writers) + " writer(s) stalled waiting for space for " + stalled (writer_stall, num_writers) + ", "
+              + str(num_readers) + " reader(s) stalled waiting for data for " + stalled (reader_stall, num_readers));
+        }
+
 
       private:
+        // each slot of the ring buffer carries a sequence number, which
+        // indicates whether it is ready to be written to (sequence equal to
+        // the write position) or read from (sequence one past the read
+        // position). This allows writers and readers to claim slots using a
+        // single atomic compare-and-swap on the tail and head positions
+        // respectively, with no need for a lock.
+        class Slot { NOMEMALIGN
+          public:
+            Slot () : item (nullptr) { }
+            Slot (const Slot&) : item (nullptr) { }
+            std::atomic<size_t> sequence;
+            T* item;
+        };
+
+        // note the ring buffer requires at least two slots for the
+        // sequence numbers to distinguish full from empty slots:
+        vector<Slot> slots;
+        const size_t capacity;
+        // keep the read and write positions on separate cache lines:
+        char __pad0[64];
+        std::atomic<size_t> head;
+        char __pad1[64];
+        std::atomic<size_t> tail;
+        char __pad2[64];
+        std::atomic<size_t> writer_count, reader_count;
+        std::atomic<size_t> writers_waiting, readers_waiting;
         std::mutex mutex;
         std::condition_variable more_data, more_space;
-        T** buffer;
-        T** front;
-        T** back;
-        size_t capacity;
-        size_t writer_count, reader_count;
-        std::stack<T*,vector<T*> > item_stack;
         vector<std::unique_ptr<T>> items;
         std::string name;
 
+        // statistics, only recorded if instrumented is set:
+        const bool instrumented;
+        std::atomic<size_t> num_writers, num_readers;
+        std::atomic<uint64_t> items_pushed, occupancy;
+        std::atomic<uint64_t> writer_stall, reader_stall;
+        const std::chrono::steady_clock::time_point created;
+
         Queue (const Queue&) = delete;
         Queue& operator= (const Queue&) = delete;
 
         void register_writer ()   {
-          std::lock_guard<std::mutex> lock (mutex);
           ++writer_count;
+          if (instrumented)
+            ++num_writers;
         }
         void unregister_writer () {
-          std::lock_guard<std::mutex> lock (mutex);
           assert (writer_count);
-          --writer_count;
-          if (!writer_count) {
+          if (!(--writer_count)) {
             DEBUG ("no writers left on queue \"" + name + "\"");
+            std::lock_guard<std::mutex> lock (mutex);
             more_data.notify_all();
           }
         }
         void register_reader ()   {
-          std::lock_guard<std::mutex> lock (mutex);
           ++reader_count;
+          if (instrumented)
+            ++num_readers;
         }
         void unregister_reader () {
-          std::lock_guard<std::mutex> lock (mutex);
           assert (reader_count);
-          --reader_count;
-          if (!reader_count) {
+          if (!(--reader_count)) {
             DEBUG ("no readers left on queue \"" + name + "\"");
+            std::lock_guard<std::mutex> lock (mutex);
             more_space.notify_all();
           }
         }
 
-        FORCE_INLINE bool empty () const {
-          return (front == back);
-        }
-        FORCE_INLINE bool full () const {
-          return (inc (back) == front);
-        }
         FORCE_INLINE size_t size () const {
-          return ( (back < front ? back+capacity : back) - front);
+          const size_t h = head.load (std::memory_order_relaxed);
+          const size_t t = tail.load (std::memory_order_relaxed);
+          return t > h ? t - h : 0;
         }
 
-        FORCE_INLINE T* get_item () {
+        // items are only ever allocated when a writer receives an empty slot
+        // back in exchange for the item it has just pushed, so the total
+        // number of items is bounded by the capacity of the queue plus the
+        // number of active readers & writers:
+        T* get_item () {
           std::lock_guard<std::mutex> lock (mutex);
           T* item (new T);
           items.push_back (std::unique_ptr<T> (item));
           return item;
         }
 
-        FORCE_INLINE bool push (T*& item) {
-          std::unique_lock<std::mutex> lock (mutex);
-          more_space.wait (lock, [this]{ return !(full() && reader_count); });
-          if (!reader_count) return false;
-          *back = item;
-          back = inc (back);
-          if (item_stack.empty()) {
-            item = new T;
-            items.push_back (std::unique_ptr<T> (item));
+        // attempt to push the item into the next free slot, swapping it with
+        // the (previously consumed) item held in that slot:
+        FORCE_INLINE bool try_push (T*& item) {
+          size_t pos = tail.load (std::memory_order_relaxed);
+          while (true) {
+            Slot& slot (slots[pos % capacity]);
+            const size_t sequence = slot.sequence.load (std::memory_order_acquire);
+            const ssize_t diff = ssize_t (sequence) - ssize_t (pos);
+            if (diff == 0) {
+              if (tail.compare_exchange_weak (pos, pos+1, std::memory_order_relaxed)) {
+                std::swap (slot.item, item);
+                slot.sequence.store (pos+1, std::memory_order_release);
+                return true;
+              }
+            }
+            else if (diff < 0)
+              return false;
+            else
+              pos = tail.load (std::memory_order_relaxed);
+          }
+        }
+
+        // attempt to pop the item from the next filled slot, leaving the
+        // previously read item in its place for re-use by the writers:
+        FORCE_INLINE bool try_pop (T*& item) {
+          size_t pos = head.load (std::memory_order_relaxed);
+          while (true) {
+            Slot& slot (slots[pos % capacity]);
+            const size_t sequence = slot.sequence.load (std::memory_order_acquire);
+            const ssize_t diff = ssize_t (sequence) - ssize_t (pos+1);
+            if (diff == 0) {
+              if (head.compare_exchange_weak (pos, pos+1, std::memory_order_relaxed)) {
+                std::swap (slot.item, item);
+                slot.sequence.store (pos+capacity, std::memory_order_release);
+                return true;
+              }
+            }
+            else if (diff < 0)
+              return false;
+            else
+              pos = head.load (std::memory_order_relaxed);
           }
-          else {
-            item = item_stack.top();
-            item_stack.pop();
+        }
+
+        // wake up one thread waiting on the condition, if there are any. The
+        // fence ensures that either the waiting thread sees the update just
+        // made, or this thread sees its waiting count:
+        FORCE_INLINE void notify (std::atomic<size_t>& waiting, std::condition_variable& condition) {
+          std::atomic_thread_fence (std::memory_order_seq_cst);
+          if (waiting.load (std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock (mutex);
+            condition.notify_one();
           }
-          more_data.notify_one();
-          return true;
         }
 
-        FORCE_INLINE bool pop (T*& item) {
-          std::unique_lock<std::mutex> lock (mutex);
-          if (item)
-            item_stack.push (item);
-          item = nullptr;
-          more_data.wait (lock, [this]{ return !(empty() && writer_count); });
-          if (empty() && !writer_count)
+        // spin briefly in case the condition resolves quickly, then park the
+        // thread on the condition variable until notified:
+        template <class Attempt, class Done>
+          FORCE_INLINE bool wait_for (Attempt&& attempt, Done&& done, std::atomic<size_t>& waiting, std::condition_variable& condition) {
+            for (size_t n = 0; n < MRTRIX_QUEUE_SPIN_COUNT; ++n) {
+              if (attempt())
+                return true;
+              if (done())
+                return false;
+              std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lock (mutex);
+            ++waiting;
+            std::atomic_thread_fence (std::memory_order_seq_cst);
+            bool success = false;
+            condition.wait (lock, [&] { return (success = attempt()) || done(); });
+            --waiting;
+            return success;
+          }
+
+        // as wait_for(), recording the time spent if instrumented:
+        template <class Attempt, class Done>
+          bool stall (Attempt&& attempt, Done&& done, std::atomic<size_t>& waiting, std::condition_variable& condition,
+              std::atomic<uint64_t>& total, const char* event) {
+            if (!instrumented)
+              return wait_for (attempt, done, waiting, condition);
+            const auto start = std::chrono::steady_clock::now();
+            const bool success = wait_for (attempt, done, waiting, condition);
+            const auto end = std::chrono::steady_clock::now();
+            total += std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count();
+            __queue_trace (name, event, start, end);
+            return success;
+          }
+
+        FORCE_INLINE bool push (T*& item) {
+          if (!reader_count)
             return false;
-          item = *front;
-          front = inc (front);
-          more_space.notify_one();
+          if (!try_push (item) &&
+              !stall ([&] { return try_push (item); }, [this] { return !reader_count; },
+                writers_waiting, more_space, writer_stall, "waiting for space"))
+            return false;
+          if (instrumented) {
+            items_pushed.fetch_add (1, std::memory_order_relaxed);
+            occupancy.fetch_add (size(), std::memory_order_relaxed);
+          }
+          notify (readers_waiting, more_data);
+          if (!item)
+            item = get_item();
           return true;
         }
 
-        FORCE_INLINE T** inc (T** p) const {
-          ++p;
-          if (p >= buffer + capacity) p = buffer;
-          return p;
+        // once all writers have finished, one final attempt is made to
+        // ensure any items they pushed beforehand are not missed:
+        FORCE_INLINE bool pop (T*& item) {
+          if (!try_pop (item) &&
+              !stall ([&] { return try_pop (item); }, [this] { return !writer_count; },
+                readers_waiting, more_data, reader_stall, "waiting for data") &&
+              !try_pop (item)) {
+            item = nullptr;
+            return false;
+          }
+          notify (writers_waiting, more_space);
+          return true;
         }
     };
 
@@ -634,7 +802,7 @@ namespace MR
 
       public:
         Queue (const __Batch<T>& item_type, const std::string& description = "unnamed", size_t buffer_size = MRTRIX_QUEUE_DEFAULT_CAPACITY) :
-          batch_queue (description, buffer_size),
+          batch_queue (description + " (batches of " + str(item_type.num) + ")", buffer_size),
           batch_size (item_type.num) { }
 
 
@@ -0,0 +1,6 @@
+
+namespace MR { 
+  namespace App { 
+    const char* mrtrix_version = "2fb42150";
+  } 
+}
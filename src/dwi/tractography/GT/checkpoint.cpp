@@ -0,0 +1,216 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <unordered_map>
+
+#include "file/config.h"
+#include "file/ofstream.h"
+
+#include "dwi/tractography/GT/checkpoint.h"
+
+
+#define GT_CHECKPOINT_FIRST_LINE "mrtrix global tractography checkpoint"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace GT {
+        
+        // Particles are stored after the header in binary form (native byte
+        // order), as position, direction and the indices of the predecessor 
+        // and successor particles (-1 if unconnected).
+        struct ParticleRecord
+        { NOMEMALIGN
+          float pos[3], dir[3];
+          int64_t pred, succ;
+        };
+        
+        
+        Checkpoint::Checkpoint(const std::string& path, Stats& s, ParticleGrid& pgrid)
+          : path(path), stats(s), pGrid(pgrid), is_pending(false), active(0), waiting(0), generation(0)
+        {
+          //CONF option: TckglobalCheckpointInterval
+          //CONF default: 600
+          //CONF The interval (in seconds) between successive checkpoints
+          //CONF written by tckglobal when the -checkpoint option is used.
+          interval = File::Config::get_float("TckglobalCheckpointInterval", 600.0);
+        }
+        
+        
+        void Checkpoint::load(EnergyComputer* E)
+        {
+          std::ifstream in (path.c_str(), std::ios::in | std::ios::binary);
+          if (!in)
+            throw Exception("failed to open global tractography checkpoint \"" + path + "\": " + strerror(errno));
+          std::string line;
+          std::getline(in, line);
+          if (line != GT_CHECKPOINT_FIRST_LINE)
+            throw Exception("file \"" + path + "\" is not a global tractography checkpoint");
+          
+          size_t count = 0;
+          while (std::getline(in, line) && line != "END") {
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos)
+              continue;
+            const std::string key = strip(line.substr(0, colon)), value = strip(line.substr(colon+1));
+            if (key == "length") {
+              if (std::abs(to<float>(value) - Particle::L) > 1e-6 * Particle::L)
+                throw Exception("particle length in checkpoint \"" + path + "\" does not match");
+            }
+            else if (key == "max_iterations") {
+              if (to<uint64_t>(value) != stats.getMaxIter())
+                throw Exception("number of iterations in checkpoint \"" + path + "\" does not match");
+            }
+            else if (key == "count")
+              count = to<size_t>(value);
+            else if (!stats.load(key, value))
+              INFO("unknown entry \"" + key + "\" in global tractography checkpoint ignored");
+          }
+          
+          // Stats::load() has restored the energy totals; these are not to
+          // be modified as the energy computers are updated below:
+          const double Eext = stats.getEextTotal(), Eint = stats.getEintTotal();
+          
+          vector<ParticleRecord> records (count);
+          in.read(reinterpret_cast<char*>(records.data()), count * sizeof(ParticleRecord));
+          if (!in)
+            throw Exception("unexpected end of global tractography checkpoint \"" + path + "\"");
+          
+          ProgressBar progress ("restoring particles from checkpoint", count);
+          ParticleGrid::ParticleVectorType particles (count);
+          for (size_t i = 0; i != count; ++i) {
+            const Point_t pos (records[i].pos[0], records[i].pos[1], records[i].pos[2]);
+            const Point_t dir (records[i].dir[0], records[i].dir[1], records[i].dir[2]);
+            E->stageAdd(pos, dir);
+            E->acceptChanges();
+            particles[i] = pGrid.add(pos, dir);
+            ++progress;
+          }
+          
+          // each connection is listed at both ends; restore it once:
+          for (size_t i = 0; i != count; ++i) {
+            for (int end = 0; end != 2; ++end) {
+              const int64_t j = end ? records[i].succ : records[i].pred;
+              if (j < 0 || size_t(j) <= i)
+                continue;
+              if (size_t(j) >= count)
+                throw Exception("invalid connection in global tractography checkpoint \"" + path + "\"");
+              const int a = (records[j].succ == int64_t(i)) ? 1 : -1;
+              if (end)
+                particles[i]->connectSuccessor(particles[j], a);
+              else
+                particles[i]->connectPredecessor(particles[j], a);
+            }
+          }
+          
+          stats.incEextTotal(Eext - stats.getEextTotal());
+          stats.incEintTotal(Eint - stats.getEintTotal());
+          INFO("restored " + str(count) + " particles at iteration " + str(stats.getIter()));
+        }
+        
+        
+        void Checkpoint::save()
+        {
+          ParticleGrid::ParticleVectorType particles;
+          pGrid.getParticles(particles);
+          std::unordered_map<const Particle*, int64_t> index;
+          for (size_t i = 0; i != particles.size(); ++i)
+            index[particles[i]] = i;
+          
+          const std::string temp_path = path + ".tmp";
+          {
+            File::OFStream out (temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+            out << GT_CHECKPOINT_FIRST_LINE << "\n";
+            out << "length: " << std::setprecision(9) << Particle::L << "\n";
+            out << "max_iterations: " << stats.getMaxIter() << "\n";
+            stats.save(out);
+            out << "count: " << particles.size() << "\n";
+            out << "END\n";
+            for (const Particle* par : particles) {
+              ParticleRecord record;
+              const Point_t pos = par->getPosition(), dir = par->getDirection();
+              for (size_t k = 0; k != 3; ++k) {
+                record.pos[k] = pos[k];
+                record.dir[k] = dir[k];
+              }
+              record.pred = par->hasPredecessor() ? index[par->getPredecessor()] : -1;
+              record.succ = par->hasSuccessor() ? index[par->getSuccessor()] : -1;
+              out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+            }
+            if (!out.good())
+              throw Exception("error writing global tractography checkpoint \"" + temp_path + "\": " + strerror(errno));
+          }
+          if (std::rename(temp_path.c_str(), path.c_str()))
+            throw Exception("error replacing global tractography checkpoint \"" + path + "\": " + strerror(errno));
+          DEBUG("global tractography checkpoint saved at iteration " + str(stats.getIter()));
+        }
+        
+        
+        void Checkpoint::enter()
+        {
+          std::unique_lock<std::mutex> lock (mutex);
+          cond.wait(lock, [&] { return !is_pending; });
+          ++active;
+        }
+        
+        
+        void Checkpoint::leave()
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          --active;
+          if (is_pending && waiting == active)
+            release();
+        }
+        
+        
+        void Checkpoint::sync()
+        {
+          std::unique_lock<std::mutex> lock (mutex);
+          is_pending = true;
+          if (++waiting == active) {
+            release();
+          }
+          else {
+            const size_t current = generation;
+            cond.wait(lock, [&] { return generation != current; });
+          }
+        }
+        
+        
+        void Checkpoint::release()
+        {
+          try {
+            save();
+          }
+          catch (Exception& e) {
+            e.display();
+            WARN("global tractography checkpoint not saved");
+          }
+          waiting = 0;
+          is_pending = false;
+          ++generation;
+          timer.start();
+          cond.notify_all();
+        }
+        
+
+      }
+    }
+  }
+}
@@ -0,0 +1,102 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+
+#ifndef __gt_checkpoint_h__
+#define __gt_checkpoint_h__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "timer.h"
+
+#include "dwi/tractography/GT/gt.h"
+#include "dwi/tractography/GT/energy.h"
+#include "dwi/tractography/GT/particlegrid.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace GT {
+        
+        /**
+         * @brief The Checkpoint class periodically saves the particle
+         *        configuration and sampler state to file, such that an
+         *        interrupted run can be resumed.
+         * 
+         * Saving requires a consistent state, so all sampler threads are
+         * paused between proposals while the checkpoint is written.
+         */
+        class Checkpoint
+        { MEMALIGN(Checkpoint)
+        public:
+          
+          Checkpoint(const std::string& path, Stats& s, ParticleGrid& pgrid);
+          
+          Checkpoint(const Checkpoint&) = delete;
+          Checkpoint& operator=(const Checkpoint&) = delete;
+          
+          /**
+           * @brief Restore particles, connections and the temperature
+           *        schedule; energy computer E is updated accordingly.
+           */
+          void load(EnergyComputer* E);
+          
+          void save();
+          
+          // thread synchronisation --------------------------------------------
+          
+          void enter();
+          void leave();
+          
+          inline bool pending() const {
+            return is_pending.load(std::memory_order_relaxed);
+          }
+          
+          inline bool due() {
+            return timer.elapsed() > interval;
+          }
+          
+          // wait until all sampler threads have paused; the last one to
+          // arrive saves the checkpoint and releases the others.
+          void sync();
+          
+          
+        protected:
+          
+          std::string path;
+          Stats& stats;
+          ParticleGrid& pGrid;
+          
+          float interval;
+          Timer timer;
+          
+          std::mutex mutex;
+          std::condition_variable cond;
+          std::atomic<bool> is_pending;
+          size_t active, waiting, generation;
+          
+          void release();
+          
+        };
+        
+
+      }
+    }
+  }
+}
+
+#endif // __gt_checkpoint_h__
@@ -12,6 +12,8 @@
  */
 
 
+#include <iomanip>
+
 #include "dwi/tractography/GT/gt.h"
 
 
@@ -20,12 +22,52 @@ namespace MR {
     namespace Tractography {
       namespace GT {
 
+        void Stats::save(std::ostream& o) const
+        {
+          o << std::setprecision(17);
+          o << "iterations: " << n_iter << "\n";
+          o << "temperature: " << Tint << "\n";
+          o << "energy_ext: " << EextTot << "\n";
+          o << "energy_int: " << EintTot << "\n";
+          o << "proposals: " << n_gen[0] << "," << n_gen[1] << "," << n_gen[2] << "," << n_gen[3] << "," << n_gen[4] << "\n";
+          o << "accepted: " << n_acc[0] << "," << n_acc[1] << "," << n_acc[2] << "," << n_acc[3] << "," << n_acc[4] << "\n";
+        }
+        
+        
+        bool Stats::load(const std::string& key, const std::string& value)
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          if (key == "iterations") {
+            n_iter = to<unsigned long>(value);
+            // catch up with the progress bar:
+            for (unsigned long k = 0; k != n_iter/ITER_BIGSTEP; ++k)
+              progress++;
+          }
+          else if (key == "temperature")
+            Tint = to<double>(value);
+          else if (key == "energy_ext")
+            EextTot = to<double>(value);
+          else if (key == "energy_int")
+            EintTot = to<double>(value);
+          else if (key == "proposals" || key == "accepted") {
+            auto counts = split(value, ",");
+            if (counts.size() != 5)
+              throw Exception("malformed entry \"" + key + "\" in global tractography checkpoint");
+            for (int k = 0; k != 5; k++)
+              (key == "proposals" ? n_gen : n_acc)[k] = to<unsigned long>(counts[k]);
+          }
+          else
+            return false;
+          return true;
+        }
+        
+        
         std::ostream& operator<< (std::ostream& o, Stats const& stats)
         {
           return o << stats.Tint << ", " << stats.EextTot << ", " << stats.EintTot << ", " <<
                       stats.getAcceptanceRate('b') << ", " << stats.getAcceptanceRate('d') << ", " <<
                       stats.getAcceptanceRate('r') << ", " << stats.getAcceptanceRate('o') << ", " <<
-                      stats.getAcceptanceRate('c');
+                      stats.getAcceptanceRate('c') << ", " << stats.getProposalRate();
         }
 
       }
@@ -25,6 +25,7 @@
 #include <Eigen/Dense>
 
 #include "progressbar.h"
+#include "timer.h"
 #include "types.h"
 
 
@@ -67,7 +68,7 @@ namespace MR {
         public:
           
           Stats(const double T0, const double T1, const uint64_t maxiter) 
-            : Text(T1), Tint(T0), EextTot(0.0), EintTot(0.0), n_iter(0), n_max(maxiter), 
+            : Text(T1), Tint(T0), EextTot(0.0), EintTot(0.0), n_iter(0), n_start(0), n_max(maxiter), 
               progress("running MH sampler", n_max/ITER_BIGSTEP)
           {
             for (int k = 0; k != 5; k++)
@@ -80,9 +81,9 @@ namespace MR {
           }
           
           
-          void open_stream(const std::string& file) {
+          void open_stream(const std::string& file, const bool append = false) {
             out.close();
-            out.open(file.c_str(), std::ofstream::out);
+            out.open(file.c_str(), append ? std::ofstream::app : std::ofstream::out);
           }
           
           
@@ -92,6 +93,7 @@ namespace MR {
             if (n_iter % ITER_BIGSTEP == 0) {
               if ((n_iter >= n_max/FRAC_BURNIN) && (n_iter < n_max - n_max/FRAC_PHASEOUT))
                 Tint *= alpha;
+              progress.set_text("running MH sampler (" + str(uint64_t(getProposalRate())) + " proposals/s)");
               progress++;
               out << *this << std::endl;
             }
@@ -191,6 +193,40 @@ namespace MR {
           }
           
           
+          uint64_t getIter() const {
+            return n_iter;
+          }
+          
+          uint64_t getMaxIter() const {
+            return n_max;
+          }
+          
+          
+          // proposal rate ----------------------------------------------------
+          
+          // restart the measurement of the proposal rate from the current iteration
+          void startTimer() {
+            std::lock_guard<std::mutex> lock (mutex);
+            n_start = n_iter;
+            timer.start();
+          }
+          
+          // mean no. proposals per second since the last call to startTimer()
+          double getProposalRate() const {
+            return (n_iter - n_start) / timer.elapsed();
+          }
+          
+          
+          // checkpointing ----------------------------------------------------
+          
+          // write the sampler state as key-value pairs
+          void save(std::ostream& o) const;
+          
+          // restore the sampler state from a key-value pair written by save();
+          // returns false if the key is not recognised
+          bool load(const std::string& key, const std::string& value);
+          
+          
           friend std::ostream& operator<< (std::ostream& o, Stats const& stats);
           
 
@@ -202,8 +238,9 @@ namespace MR {
 
           unsigned long n_gen[5];
           unsigned long n_acc[5];
-          unsigned long n_iter;
+          unsigned long n_iter, n_start;
           const uint64_t n_max;
+          mutable Timer timer;
           
           ProgressBar progress;
           std::ofstream out;
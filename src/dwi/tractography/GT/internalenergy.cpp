@@ -44,6 +44,8 @@ namespace MR {
           normalization = 1.0;
           
           Point_t ep = p->getEndPoint(alpha0);
+          const Point_t pos0 = p->getPosition();
+          const Point_t dir0 = p->getDirection();
           size_t x, y, z;
           pGrid.pos2xyz(ep, x, y, z);
           
@@ -55,29 +57,34 @@ namespace MR {
           for (int i = -1; i <= 1; i++) {
             for (int j = -1; j <= 1; j++) {
               for (int k = -1; k <= 1; k++) {
-                const ParticleGrid::ParticleVectorType* pvec = pGrid.at(x+i, y+j, z+k);
-                if (pvec == NULL)
+                const ParticleGrid::Cell* cell = pGrid.at(x+i, y+j, z+k);
+                if (cell == NULL)
                   continue;
                 
-                for (ParticleGrid::ParticleVectorType::const_iterator it = pvec->begin(); it != pvec->end(); ++it) 
+                // The thresholds are evaluated using the positions and directions stored
+                // within the cell; the particle itself is only accessed for candidates.
+                for (size_t n = 0; n != cell->size(); ++n)
                 {
-                  pe.par = *it;
-                  if (pe.par == p)
-                    continue;
-                  d1 = (ep - pe.par->getEndPoint(-1)).squaredNorm();
-                  d2 = (ep - pe.par->getEndPoint(+1)).squaredNorm();
+                  const Point_t& pos = cell->getPosition(n);
+                  const Point_t& dir = cell->getDirection(n);
+                  d1 = (ep - (pos - Particle::L*dir)).squaredNorm();
+                  d2 = (ep - (pos + Particle::L*dir)).squaredNorm();
                   d = (d1 < d2) ? d1 : d2;
                   pe.alpha = (d1 < d2) ? -1 : 1;
+                  if (d >= tolerance2)
+                    continue;
+                  ct = (-alpha0*pe.alpha) * dir0.dot(dir);
+                  if (ct <= costheta)
+                    continue;
+                  pe.par = cell->getParticle(n);
+                  if (pe.par == p)
+                    continue;
                   if ( (pe.alpha == -1) ? (pe.par->hasPredecessor() && pe.par->getPredecessor() != p) : (pe.par->hasSuccessor() && pe.par->getSuccessor() != p) )		// Exclude connected endpoints, unless they are connected to the current particle.
                     continue;
-                  ct = (-alpha0*pe.alpha) * p->getDirection().dot(pe.par->getDirection());
-                  if (d < tolerance2 && ct > costheta)
-                  {
-                    pe.e_conn = calcEnergy(p, alpha0, pe.par, pe.alpha);
-                    pe.p_suc = exp(-pe.e_conn/currTemp);
-                    normalization += pe.p_suc;
-                    neighbourhood.push_back(pe);
-                  }
+                  pe.e_conn = calcEnergy(pos0, ep, pos, pos + pe.alpha*Particle::L*dir);
+                  pe.p_suc = exp(-pe.e_conn/currTemp);
+                  normalization += pe.p_suc;
+                  neighbourhood.push_back(pe);
                 }
                 
               }
@@ -25,11 +25,17 @@ namespace MR {
         // RUNTIME METHODS --------------------------------------------------------------
         
         void MHSampler::execute()
-        {          
+        {
+          if (checkpoint)
+            checkpoint->enter();
           do {
             next();
+            // only query the timer occasionally, to minimise overhead:
+            if (checkpoint && (checkpoint->pending() || (++n_since_check % 1000 == 0 && checkpoint->due())))
+              checkpoint->sync();
           } while (stats.next());
-          
+          if (checkpoint)
+            checkpoint->leave();
         }
         
         
@@ -21,6 +21,7 @@
 #include "math/rng.h"
 
 #include "dwi/tractography/GT/gt.h"
+#include "dwi/tractography/GT/checkpoint.h"
 #include "dwi/tractography/GT/particle.h"
 #include "dwi/tractography/GT/particlegrid.h"
 #include "dwi/tractography/GT/energy.h"
@@ -43,19 +44,22 @@ namespace MR {
             : props(p), stats(s), pGrid(pgrid), E(e), T(dwi), 
               dims{size_t(dwi.size(0)), size_t(dwi.size(1)), size_t(dwi.size(2))}, 
               mask(m), lock(make_shared<SpatialLock<float>>(5*Particle::L)), 
-              sigpos(Particle::L / 8.), sigdir(0.2)
+              sigpos(Particle::L / 8.), sigdir(0.2), n_since_check(0)
           {
             DEBUG("Initialise Metropolis Hastings sampler.");
           }
           
           MHSampler(const MHSampler& other)
             : props(other.props), stats(other.stats), pGrid(other.pGrid), E(other.E->clone()), 
-              T(other.T), dims(other.dims), mask(other.mask), lock(other.lock), rng_uniform(), rng_normal(), sigpos(other.sigpos), sigdir(other.sigdir)
+              T(other.T), dims(other.dims), mask(other.mask), lock(other.lock), rng_uniform(), rng_normal(), sigpos(other.sigpos), sigdir(other.sigdir),
+              checkpoint(other.checkpoint), n_since_check(0)
           {
             DEBUG("Copy Metropolis Hastings sampler.");
           }
           
           ~MHSampler() { delete E; }
+          
+          void setCheckpoint(std::shared_ptr<Checkpoint> c) { checkpoint = c; }
                     
           void execute();
           
@@ -84,6 +88,9 @@ namespace MR {
           Math::RNG::Normal<float> rng_normal;
           float sigpos, sigdir;
           
+          std::shared_ptr<Checkpoint> checkpoint;
+          size_t n_since_check;
+          
           
           Point_t getRandPosInMask();
           
@@ -20,27 +20,68 @@ namespace MR {
       namespace GT {
         
         
-        void ParticleGrid::add(const Point_t &pos, const Point_t &dir)
+        void ParticleGrid::Cell::add(Particle* p)
+        {
+          particles.push_back(p);
+          positions.push_back(p->getPosition());
+          directions.push_back(p->getDirection());
+        }
+        
+        void ParticleGrid::Cell::update(const Particle* p)
+        {
+          size_t i = find(p);
+          positions[i] = p->getPosition();
+          directions[i] = p->getDirection();
+        }
+        
+        void ParticleGrid::Cell::remove(const Particle* p)
+        {
+          // move the last particle into the vacated slot, to keep the arrays contiguous:
+          size_t i = find(p);
+          particles[i] = particles.back();
+          positions[i] = positions.back();
+          directions[i] = directions.back();
+          particles.pop_back();
+          positions.pop_back();
+          directions.pop_back();
+        }
+        
+        size_t ParticleGrid::Cell::find(const Particle* p) const
+        {
+          for (size_t i = 0; i != particles.size(); ++i) {
+            if (particles[i] == p)
+              return i;
+          }
+          throw Exception ("particle not found in its grid cell");
+        }
+        
+        
+        Particle* ParticleGrid::add(const Point_t &pos, const Point_t &dir)
         {
           Particle* p = pool.create(pos, dir);
           size_t gidx = pos2idx(pos);
-          grid[gidx].push_back(p);
+          grid[gidx].add(p);
+          return p;
         }
         
         void ParticleGrid::shift(Particle *p, const Point_t& pos, const Point_t& dir)
         {
           size_t gidx0 = pos2idx(p->getPosition());
           size_t gidx1 = pos2idx(pos);
-          std::remove (grid[gidx0].begin(), grid[gidx0].end(), p);
           p->setPosition(pos);
           p->setDirection(dir);
-          grid[gidx1].push_back(p);
+          if (gidx0 == gidx1) {
+            grid[gidx0].update(p);
+          } else {
+            grid[gidx0].remove(p);
+            grid[gidx1].add(p);
+          }
         }
         
         void ParticleGrid::remove(Particle* p)
         {
           size_t gidx0 = pos2idx(p->getPosition());
-          std::remove (grid[gidx0].begin(), grid[gidx0].end(), p);
+          grid[gidx0].remove(p);
           pool.destroy(p);
         }
         
@@ -50,7 +91,7 @@ namespace MR {
           pool.clear();
         }
         
-        const ParticleGrid::ParticleVectorType* ParticleGrid::at(const ssize_t x, const ssize_t y, const ssize_t z) const
+        const ParticleGrid::Cell* ParticleGrid::at(const ssize_t x, const ssize_t y, const ssize_t z) const
         {
           if ((x < 0) || (size_t(x) >= dims[0]) || (y < 0) || (size_t(y) >= dims[1]) || (z < 0) || (size_t(z) >= dims[2]))  // out of bounds
             return nullptr;
@@ -66,10 +107,11 @@ namespace MR {
           int alpha = 0;
           vector<Point_t> track;
           // Loop through all unvisited particles
-          for (ParticleVectorType& gridvox : grid)
+          for (const Cell& cell : grid)
           {
-            for (Particle* par0 : gridvox) 
+            for (size_t i = 0; i != cell.size(); ++i)
             {
+              Particle* par0 = cell.getParticle(i);
               par = par0;
               if (!par->isVisited())
               {
@@ -106,9 +148,9 @@ namespace MR {
             }
           }
           // Free all particle locks
-          for (ParticleVectorType& gridvox : grid) {
-            for (Particle* par : gridvox) {
-                par->setVisited(false);
+          for (const Cell& cell : grid) {
+            for (size_t i = 0; i != cell.size(); ++i) {
+                cell.getParticle(i)->setVisited(false);
             }
           }
         }
@@ -40,6 +40,47 @@ namespace MR {
           
           using ParticleVectorType = vector<Particle*>;
           
+          /**
+           * @brief The particles within a single grid cell. Their positions
+           *        and directions are stored in contiguous arrays, so that
+           *        the neighbourhood search does not need to access the
+           *        particles themselves unless they are candidates for a
+           *        connection.
+           */
+          class Cell
+          { MEMALIGN(Cell)
+          public:
+            
+            inline size_t size() const {
+              return particles.size();
+            }
+            
+            inline Particle* getParticle(const size_t i) const {
+              return particles[i];
+            }
+            
+            inline const Point_t& getPosition(const size_t i) const {
+              return positions[i];
+            }
+            
+            inline const Point_t& getDirection(const size_t i) const {
+              return directions[i];
+            }
+            
+            void add(Particle* p);
+            
+            void update(const Particle* p);
+            
+            void remove(const Particle* p);
+            
+          protected:
+            ParticleVectorType particles;
+            vector<Point_t> positions;
+            vector<Point_t> directions;
+            
+            size_t find(const Particle* p) const;
+          };
+          
           template <class HeaderType>
           ParticleGrid(const HeaderType& image)
           {
@@ -69,7 +110,7 @@ namespace MR {
             return pool.size();
           }
           
-          void add(const Point_t& pos, const Point_t& dir);
+          Particle* add(const Point_t& pos, const Point_t& dir);
           
           void shift(Particle* p, const Point_t& pos, const Point_t& dir);
           
@@ -77,7 +118,7 @@ namespace MR {
           
           void clear();
           
-          const ParticleVectorType* at(const ssize_t x, const ssize_t y, const ssize_t z) const;
+          const Cell* at(const ssize_t x, const ssize_t y, const ssize_t z) const;
           
           inline Particle* getRandom() {
             return pool.random();
@@ -85,11 +126,15 @@ namespace MR {
           
           void exportTracks(Tractography::Writer<float>& writer);
           
+          inline void getParticles(ParticleVectorType& particles) {
+            pool.getAlive(particles);
+          }
+          
           
         protected:
           std::mutex mutex;
           ParticlePool pool;
-          vector<ParticleVectorType> grid;
+          vector<Cell> grid;
           Math::RNG rng;
           transform_type T_s2g;
           size_t dims[3];
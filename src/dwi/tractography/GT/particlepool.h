@@ -91,6 +91,17 @@ namespace MR {
             return nullptr;
           }
           
+          /**
+           * @brief Collect all live particles, in order of creation.
+           */
+          void getAlive(vector<Particle*>& particles) {
+            std::lock_guard<std::mutex> lock (mutex);
+            for (Particle& p : pool) {
+              if (p.isAlive())
+                particles.push_back(&p);
+            }
+          }
+          
           /**
            * @brief Clear pool.
            */
@@ -16,11 +16,15 @@
 #define __gt_spatiallock_h__
 
 #include <Eigen/Dense>
+#include <algorithm>
 #include <mutex>
 
 #include "types.h"
 
 
+#define GT_SPATIALLOCK_STRIPES 4096
+
+
 namespace MR {
   namespace DWI {
     namespace Tractography {
@@ -28,6 +32,12 @@ namespace MR {
         
         /**
          * @brief SpatialLock manages a mutex lock on n positions in 3D space.
+         *
+         * Lock centres are stored in a table of striped mutexes, indexed by a
+         * spatial hash of a grid with cells of twice the lock threshold. The
+         * region locked around any position therefore overlaps at most two
+         * cells along each axis, and only the stripes of these cells need to
+         * be locked and checked, rather than every active lock centre.
          */
         template <typename T = float >
         class SpatialLock
@@ -36,37 +46,36 @@ namespace MR {
           using value_type = T;
           using point_type = Eigen::Matrix<value_type, 3, 1>;
           
-          SpatialLock() : _tx(0), _ty(0), _tz(0) { }
-          SpatialLock(const value_type t) : _tx(t), _ty(t), _tz(t) { }
-          SpatialLock(const value_type tx, const value_type ty, const value_type tz) : _tx(tx), _ty(ty), _tz(tz) { }
-          
-          ~SpatialLock() {
-            lockcentres.clear();
-          }
+          SpatialLock() : stripes (GT_SPATIALLOCK_STRIPES) { setThreshold(0); }
+          SpatialLock(const value_type t) : stripes (GT_SPATIALLOCK_STRIPES) { setThreshold(t); }
+          SpatialLock(const value_type tx, const value_type ty, const value_type tz) : stripes (GT_SPATIALLOCK_STRIPES) { setThreshold(tx, ty, tz); }
           
           void setThreshold(const value_type t) {
-            _tx = _ty = _tz = t;
+            setThreshold(t, t, t);
           }
           
           void setThreshold(const value_type tx, const value_type ty, const value_type tz) {
-            _tx = tx;
-            _ty = ty;
-            _tz = tz;
+            threshold = point_type (tx, ty, tz);
+            for (size_t i = 0; i != 3; ++i)
+              inv_cell_size[i] = threshold[i] > 0 ? 0.5 / threshold[i] : 0;
           }
 
 
           struct Guard
           { NOMEMALIGN
           public:
-            Guard(SpatialLock& l) : lock(l), idx(-1) { }
+            Guard(SpatialLock& l) : lock(l), idx(-1), pos(point_type::Zero()) { }
 
             ~Guard() {
               if (idx >= 0)
-                lock.unlock(idx);
+                lock.unlock(idx, pos);
             }
 
-            bool try_lock(const point_type& pos) {
-              return lock.try_lock(pos, idx);
+            bool try_lock(const point_type& p) {
+              if (!lock.try_lock(p, idx))
+                return false;
+              pos = p;
+              return true;
             }
 
             bool operator!() const {
@@ -76,42 +85,74 @@ namespace MR {
           private:
             SpatialLock& lock;
             ssize_t idx;
+            point_type pos;
 
           };
 
           
         protected:
-          std::mutex mutex;
-          vector< std::pair<point_type, bool> > lockcentres;
-          value_type _tx, _ty, _tz;
+          class Stripe
+          { NOMEMALIGN
+          public:
+            std::mutex mutex;
+            vector<point_type> lockcentres;
+          };
+
+          vector<Stripe> stripes;
+          point_type threshold, inv_cell_size;
+
+          size_t stripe_index(const Eigen::Array3i& cell) const {
+            return (uint32_t(cell[0]) * 73856093u ^ uint32_t(cell[1]) * 19349663u ^ uint32_t(cell[2]) * 83492791u) % stripes.size();
+          }
+
+          Eigen::Array3i cell(const point_type& pos) const {
+            return pos.cwiseProduct(inv_cell_size).array().floor().template cast<int>();
+          }
 
           bool try_lock(const point_type& pos, ssize_t& idx) {
-            std::lock_guard<std::mutex> lock (mutex);
             idx = -1;
-            ssize_t i = 0;
-            point_type d;
-            for (auto& x : lockcentres) {
-              if (x.second) {
-                d = x.first - pos;
-                if ((std::fabs(d[0]) < _tx) && (std::fabs(d[1]) < _ty) && (std::fabs(d[2]) < _tz))
-                  return false;
-              } else {
-                idx = i;
+            // find the stripes of all cells overlapping the region to be locked, in order
+            const Eigen::Array3i lo = cell(pos - threshold), hi = cell(pos + threshold);
+            size_t indices[27], n = 0;
+            for (int z = lo[2]; z <= hi[2]; ++z)
+              for (int y = lo[1]; y <= hi[1]; ++y)
+                for (int x = lo[0]; x <= hi[0]; ++x)
+                  if (n < 27)
+                    indices[n++] = stripe_index(Eigen::Array3i(x, y, z));
+            std::sort(indices, indices+n);
+            n = std::unique(indices, indices+n) - indices;
+
+            for (size_t i = 0; i != n; ++i)
+              stripes[indices[i]].mutex.lock();
+            bool conflict = false;
+            for (size_t i = 0; i != n && !conflict; ++i) {
+              for (const auto& x : stripes[indices[i]].lockcentres) {
+                const point_type d = x - pos;
+                if ((std::fabs(d[0]) < threshold[0]) && (std::fabs(d[1]) < threshold[1]) && (std::fabs(d[2]) < threshold[2])) {
+                  conflict = true;
+                  break;
+                }
               }
-              i++;
             }
-            if (idx == -1) {
-              idx = lockcentres.size();
-              lockcentres.emplace_back(pos, true);
-            } else {
-              lockcentres[idx].first = pos;
-              lockcentres[idx].second = true;
+            if (!conflict) {
+              idx = stripe_index(cell(pos));
+              stripes[idx].lockcentres.push_back(pos);
             }
-            return true;
+            for (size_t i = n; i-- > 0; )
+              stripes[indices[i]].mutex.unlock();
+            return !conflict;
           }
 
-          void unlock(const size_t idx) {
-            lockcentres[idx].second = false;
+          void unlock(const size_t idx, const point_type& pos) {
+            std::lock_guard<std::mutex> lock (stripes[idx].mutex);
+            auto& centres = stripes[idx].lockcentres;
+            for (auto& x : centres) {
+              if (x == pos) {
+                x = centres.back();
+                centres.pop_back();
+                return;
+              }
+            }
           }
 
 
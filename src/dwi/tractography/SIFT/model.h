@@ -69,7 +69,7 @@ namespace MR
           }
           Model (const Model& that) = delete;
 
-          virtual ~Model ();
+          virtual ~Model () { }
 
 
           // Over-rides the function defined in ModelBase; need to build contributions member also
@@ -90,7 +90,7 @@ namespace MR
 
         protected:
           std::string tck_file_path;
-          vector<TrackContribution*> contributions;
+          TrackContributions contributions;
 
           using Fixel_map<Fixel>::accessor;
           using Fixel_map<Fixel>::begin;
@@ -109,20 +109,26 @@ namespace MR
               MappedTrackReceiver (Model& i) :
                 master (i),
                 mutex (new std::mutex),
+                buffer (master.contributions.create_buffer()),
                 TD_sum (0.0),
-                fixel_TDs (master.fixels.size(), 0.0) { }
+                fixel_TDs (master.fixels.size(), 0.0),
+                fixel_counts (master.fixels.size(), 0) { }
               MappedTrackReceiver (const MappedTrackReceiver& that) :
                 master (that.master),
                 mutex (that.mutex),
+                buffer (master.contributions.create_buffer()),
                 TD_sum (0.0),
-                fixel_TDs (master.fixels.size(), 0.0) { }
+                fixel_TDs (master.fixels.size(), 0.0),
+                fixel_counts (master.fixels.size(), 0) { }
               ~MappedTrackReceiver();
               bool operator() (const Mapping::SetDixel&);
             private:
               Model& master;
               std::shared_ptr<std::mutex> mutex;
+              TrackContributions::Buffer& buffer;
               double TD_sum;
               vector<double> fixel_TDs;
+              vector<track_t> fixel_counts;
           };
 
           class FixelRemapper
@@ -143,20 +149,6 @@ namespace MR
 
 
 
-      template <class Fixel>
-      Model<Fixel>::~Model ()
-      {
-        for (vector<TrackContribution*>::iterator i = contributions.begin(); i != contributions.end(); ++i) {
-          if (*i) {
-            delete *i;
-            *i = nullptr;
-          }
-        }
-      }
-
-
-
-
       template <class Fixel>
       void Model<Fixel>::map_streamlines (const std::string& path)
       {
@@ -167,32 +159,49 @@ namespace MR
         if (!count)
           throw Exception ("Cannot map streamlines: track file " + Path::basename(path) + " is empty");
 
-        contributions.assign (count, nullptr);
+        auto opt = App::get_options ("mmap_contributions");
+        contributions.init (count, opt.size() ? std::string (opt[0][0]) : std::string());
 
         {
-          Mapping::TrackLoader loader (file, count);
           Mapping::TrackMapperBase mapper (Fixel_map<Fixel>::header(), dirs);
           mapper.set_upsample_ratio (Mapping::determine_upsample_ratio (Fixel_map<Fixel>::header(), properties, 0.1));
           mapper.set_use_precise_mapping (true);
           MappedTrackReceiver receiver (*this);
-          Thread::run_queue (
-              loader,
-              Thread::batch (Tractography::Streamline<>()),
-              Thread::multi (mapper),
-              Thread::batch (Mapping::SetDixel()),
-              Thread::multi (receiver));
+          if (Path::exists (index_path (path))) {
+            // where an index of streamline locations is available, the track
+            // file can be read by multiple threads concurrently:
+            Tractography::Properties indexed_properties;
+            Tractography::IndexedReader<> indexed_file (path, indexed_properties);
+            Mapping::ParallelTrackLoader loader (indexed_file, count);
+            Thread::run_queue (
+                Thread::multi (loader),
+                Thread::batch (Tractography::Streamline<>()),
+                Thread::multi (mapper),
+                Thread::batch (Mapping::SetDixel()),
+                Thread::multi (receiver));
+          } else {
+            Mapping::TrackLoader loader (file, count);
+            Thread::run_queue (
+                loader,
+                Thread::batch (Tractography::Streamline<>()),
+                Thread::multi (mapper),
+                Thread::batch (Mapping::SetDixel()),
+                Thread::multi (receiver));
+          }
         }
 
-        if (!contributions.back()) {
+        contributions.finalise();
+
+        if (!contributions.is_present (contributions.size()-1)) {
           track_t num_tracks = 0, max_index = 0;
           for (track_t i = 0; i != contributions.size(); ++i) {
-            if (contributions[i]) {
+            if (contributions.is_present (i)) {
               ++num_tracks;
               max_index = std::max (max_index, i);
             }
-            WARN ("Only " + str (num_tracks) + " tracks read from input track file; expected " + str (contributions.size()));
-            contributions.resize (max_index + 1);
           }
+          WARN ("Only " + str (num_tracks) + " tracks read from input track file; expected " + str (contributions.size()));
+          contributions.resize (max_index + 1);
         }
 
         tck_file_path = path;
@@ -249,9 +258,10 @@ namespace MR
 
         fixels.swap (new_fixels);
 
-        TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks(), "Removing excluded fixels");
+        TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions, "Removing excluded fixels");
         FixelRemapper remapper (*this, fixel_index_mapping);
         Thread::run_queue (writer, TrackIndexRange(), Thread::multi (remapper));
+        contributions.compact();
 
         TD_sum = 0.0;
         for (typename vector<Fixel>::const_iterator i = fixels.begin(); i != fixels.end(); ++i)
@@ -279,9 +289,9 @@ namespace MR
         VAR (sum_from_fixels);
         VAR (sum_from_fixels_weighted);
         double sum_from_tracks = 0.0;
-        for (vector<TrackContribution*>::const_iterator i = contributions.begin(); i != contributions.end(); ++i) {
-          if (*i)
-            sum_from_tracks += (*i)->get_total_contribution();
+        for (track_t i = 0; i != contributions.size(); ++i) {
+          if (contributions.is_present (i))
+            sum_from_tracks += contributions.get_total_contribution (i);
         }
         VAR (sum_from_tracks);
       }
@@ -300,7 +310,7 @@ namespace MR
         ProgressBar progress ("Writing non-contributing streamlines output file", contributions.size());
         track_t tck_counter = 0;
         while (reader (tck) && tck_counter < contributions.size()) {
-          if (contributions[tck_counter] && !contributions[tck_counter++]->get_total_contribution())
+          if (contributions.is_present (tck_counter) && !contributions.get_total_contribution (tck_counter++))
             writer (tck);
           else
             writer (null_tck);
@@ -322,7 +332,7 @@ namespace MR
         std::lock_guard<std::mutex> lock (*mutex);
         master.TD_sum += TD_sum;
         for (size_t i = 0; i != fixel_TDs.size(); ++i)
-          master.fixels[i] += fixel_TDs[i];
+          master.fixels[i].add_TD (fixel_TDs[i], fixel_counts[i]);
       }
 
 
@@ -331,11 +341,6 @@ namespace MR
       bool Model<Fixel>::MappedTrackReceiver::operator() (const Mapping::SetDixel& in)
       {
 
-        if (in.index >= master.contributions.size())
-          throw Exception ("Received mapped streamline beyond the expected number of streamlines (run tckfixcount on your .tck file!)");
-        if (master.contributions[in.index])
-          throw Exception ("FIXME: Same streamline has been mapped multiple times! (?)");
-
         try {
 
           vector<Track_fixel_contribution> masked_contributions;
@@ -356,15 +361,17 @@ namespace MR
             }
           }
 
-          master.contributions[in.index] = new TrackContribution (masked_contributions, total_contribution, total_length);
+          buffer.add (in.index, masked_contributions, total_contribution, total_length);
 
           TD_sum += total_contribution;
-          for (vector<Track_fixel_contribution>::const_iterator i = masked_contributions.begin(); i != masked_contributions.end(); ++i)
-            fixel_TDs [i->get_fixel_index()] += i->get_length();
+          for (vector<Track_fixel_contribution>::const_iterator i = masked_contributions.begin(); i != masked_contributions.end(); ++i) {
+            fixel_TDs   [i->get_fixel_index()] += i->get_length();
+            fixel_counts[i->get_fixel_index()]++;
+          }
 
           return true;
 
-        } catch (...) {
+        } catch (std::bad_alloc&) {
           throw Exception ("Error allocating memory for streamline visitations");
           return false;
         }
@@ -379,7 +386,7 @@ namespace MR
       {
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
           if (master.contributions[track_index]) {
-            TrackContribution& this_cont (*master.contributions[track_index]);
+            const TrackContribution this_cont (master.contributions[track_index]);
             vector<Track_fixel_contribution> new_cont;
             double total_contribution = 0.0;
             for (size_t i = 0; i != this_cont.dim(); ++i) {
@@ -389,9 +396,7 @@ namespace MR
                 total_contribution += this_cont[i].get_length() * master[new_index].get_weight();
               }
             }
-            TrackContribution* new_contribution = new TrackContribution (new_cont, total_contribution, this_cont.get_total_length());
-            delete master.contributions[track_index];
-            master.contributions[track_index] = new_contribution;
+            master.contributions.replace (track_index, new_cont, total_contribution);
           }
         }
         return true;
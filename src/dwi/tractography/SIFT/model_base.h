@@ -95,6 +95,9 @@ namespace MR
             void       set_weight (const default_type w)      { weight = w; }
             FixelBase& operator+= (const default_type length) { TD += length; return *this; }
 
+            // For merging the results of multi-threaded streamline mapping
+            void add_TD (const default_type sum_lengths, const track_t) { TD += sum_lengths; }
+
             void clear_TD() { TD = 0.0; }
 
             default_type get_diff (const default_type mu) const { return ((TD * mu) - FOD); }
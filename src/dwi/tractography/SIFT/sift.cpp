@@ -41,7 +41,14 @@ const OptionGroup SIFTModelOption = OptionGroup ("Options affecting the SIFT mod
 
   + Option ("fd_thresh", "fibre density threshold; exclude an FOD lobe from filtering processing if its integral is less than this amount "
                          "(streamlines will still be mapped to it, but it will not contribute to the cost function or the filtering)")
-    + Argument ("value").type_float (0.0, 2.0 * Math::pi);
+    + Argument ("value").type_float (0.0, 2.0 * Math::pi)
+
+  + Option ("mmap_contributions", "store the streamline-fixel contributions in temporary files within the specified directory "
+                                  "rather than in RAM, both while mapping streamlines and during optimisation, with the "
+                                  "contributions being read back from disk in the background as required; this allows "
+                                  "processing of tractograms for which these would not fit in RAM, at the expense of some "
+                                  "performance (the directory should reside on a fast local file system)")
+    + Argument ("path").type_text();
 
 
 
@@ -57,11 +57,11 @@ namespace MR
         double sum_contributing_length = 0.0, sum_noncontributing_length = 0.0;
         vector<track_t> noncontributing_indices;
         for (track_t i = 0; i != contributions.size(); ++i) {
-          if (contributions[i]) {
-            if (contributions[i]->get_total_contribution()) {
-              sum_contributing_length    += contributions[i]->get_total_length();
+          if (contributions.is_present (i)) {
+            if (contributions.get_total_contribution (i)) {
+              sum_contributing_length    += contributions.get_total_length (i);
             } else {
-              sum_noncontributing_length += contributions[i]->get_total_length();
+              sum_noncontributing_length += contributions.get_total_length (i);
               noncontributing_indices.push_back (i);
             }
           }
@@ -109,7 +109,7 @@ namespace MR
           const double current_roc_cf = calc_roc_cost_function();
 
 
-          TrackIndexRangeWriter range_writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+          TrackIndexRangeWriter range_writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
           TrackGradientCalculator gradient_calculator (*this, gradient_vector, current_mu, current_roc_cf);
           Thread::run_queue (range_writer, TrackIndexRange(), Thread::multi (gradient_calculator));
 
@@ -167,9 +167,8 @@ namespace MR
               noncontributing_indices.pop_back();
 
               // Remove this streamline, and adjust all of the relevant quantities
-              noncontributing_length_removed += contributions[to_remove]->get_total_length();
-              delete contributions[to_remove];
-              contributions[to_remove] = nullptr;
+              noncontributing_length_removed += contributions.get_total_length (to_remove);
+              contributions.remove (to_remove);
               ++removed_this_iteration;
               --tracks_remaining;
 
@@ -192,7 +191,7 @@ namespace MR
               const double streamline_density_ratio = candidate->get_cost_gradient() / (sum_contributing_length - contributing_length_removed);
               const double required_cf_change_ratio = - term_ratio * streamline_density_ratio * current_cf;
 
-              const TrackContribution& candidate_contribution (*contributions[candidate_index]);
+              const TrackContribution candidate_contribution (contributions[candidate_index]);
 
               const double old_mu = mu();
               const double new_mu = FOD_sum / (TD_sum - candidate_contribution.get_total_contribution());
@@ -224,8 +223,7 @@ namespace MR
                 }
                 TD_sum -= candidate_contribution.get_total_contribution();
                 contributing_length_removed += candidate_contribution.get_total_length();
-                delete contributions[candidate_index];
-                contributions[candidate_index] = nullptr;
+                contributions.remove (candidate_index);
                 ++removed_this_iteration;
                 --tracks_remaining;
 
@@ -320,7 +318,7 @@ namespace MR
         ProgressBar progress ("Writing filtered tracks output file", contributions.size());
         Tractography::Streamline<> empty_tck;
         while (reader (tck) && tck_counter < contributions.size()) {
-          if (contributions[tck_counter++])
+          if (contributions.is_present (tck_counter++))
             writer (tck);
           else
             writer (empty_tck);
@@ -337,7 +335,7 @@ namespace MR
       {
         File::OFStream out (path, std::ios_base::out | std::ios_base::trunc);
         for (track_t i = 0; i != contributions.size(); ++i) {
-          if (contributions[i])
+          if (contributions.is_present (i))
             out << "1\n";
           else
             out << "0\n";
@@ -427,7 +425,7 @@ namespace MR
       {
         if (!contributions[index])
           return std::numeric_limits<double>::max();
-        const TrackContribution& tck_cont = *contributions[index];
+        const TrackContribution tck_cont (contributions[index]);
         const double TD_sum_if_removed = TD_sum - tck_cont.get_total_contribution();
         const double mu_if_removed = FOD_sum / TD_sum_if_removed;
         const double mu_change_if_removed = mu_if_removed - current_mu;
@@ -449,9 +447,9 @@ namespace MR
       bool SIFTer::TrackGradientCalculator::operator() (const TrackIndexRange& in) const
       {
         for (track_t track_index = in.first; track_index != in.second; ++track_index) {
-          if (master.contributions[track_index]) {
+          if (master.contributions.is_present (track_index)) {
             const double gradient = master.calc_gradient (track_index, current_mu, current_roc_cost);
-            const double grad_per_unit_length = master.contributions[track_index]->get_total_contribution() ? (gradient / master.contributions[track_index]->get_total_contribution()) : 0.0;
+            const double grad_per_unit_length = master.contributions.get_total_contribution (track_index) ? (gradient / master.contributions.get_total_contribution (track_index)) : 0.0;
             gradient_vector[track_index].set (track_index, gradient, grad_per_unit_length);
           } else {
             gradient_vector[track_index].set (master.num_tracks(), 0.0, 0.0);
@@ -14,6 +14,15 @@
 
 #include "dwi/tractography/SIFT/track_contribution.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <thread>
+
+#include "thread_queue.h"
+#include "file/utils.h"
+
 namespace MR
 {
   namespace DWI
@@ -29,9 +38,521 @@ namespace MR
         float Track_fixel_contribution::min_length_for_storage = 0.0;
 
 
+
+#define SIFT_CONTRIBUTION_BLOCK_SIZE 1048576
+#define SIFT_CONTRIBUTION_DISK_BLOCK_SIZE 4194304
+#define SIFT_CONTRIBUTION_CACHE_SIZE 268435456
+
+
+
+        void TrackContributions::Buffer::add (const track_t index, const vector<Track_fixel_contribution>& in, const float total_contribution, const float total_length)
+        {
+          if (index >= master.size())
+            throw Exception ("Received mapped streamline beyond the expected number of streamlines (run tckfixcount on your .tck file!)");
+          if (master.total_lengths[index] >= 0.0f)
+            throw Exception ("FIXME: Same streamline has been mapped multiple times! (?)");
+          if (blocks.empty() || blocks.back().data.size() + in.size() > blocks.back().data.capacity()) {
+            vector<Track_fixel_contribution> storage;
+            if (blocks.size() && master.spill) {
+              // Only the most recent block of each thread is retained in RAM
+              master.write_block (blocks.back());
+              std::swap (storage, blocks.back().data);
+              storage.clear();
+            }
+            blocks.push_back (Block());
+            std::swap (blocks.back().data, storage);
+            blocks.back().data.reserve (std::max (size_t(SIFT_CONTRIBUTION_BLOCK_SIZE), in.size()));
+          }
+          Block& block (blocks.back());
+          block.data.insert (block.data.end(), in.begin(), in.end());
+          block.tracks.push_back (index);
+          // Streamline counts are stored in offsets until finalise() is called
+          master.offsets[index+1] = in.size();
+          master.total_contributions[index] = total_contribution;
+          master.total_lengths[index] = total_length;
+        }
+
+
+
+
+        // The packed array held in a temporary file, which is accessed in blocks of consecutive
+        //   streamlines using explicit reads and writes (rather than memory-mapping, which falls
+        //   back to a RAM copy of the whole file on networked file systems). Blocks are read on
+        //   request, and ahead of time in a background thread during a pass through all
+        //   streamlines; only a limited amount of data is retained once read, although blocks
+        //   remain valid for as long as a TrackContribution refers to them.
+        class TrackContributions::DiskStore
+        { MEMALIGN(DiskStore)
+          public:
+            using block_type = vector<Track_fixel_contribution>;
+
+            DiskStore (const TrackContributions& master, const std::string& path) :
+                master (master),
+                path (path),
+                file (path, std::ios::in | std::ios::out | std::ios::binary),
+                loaded_size (0),
+                max_loaded_size (SIFT_CONTRIBUTION_CACHE_SIZE / sizeof (Track_fixel_contribution)),
+                fetch_from (0),
+                fetch_to (0),
+                generation (0),
+                busy (false),
+                stop (false)
+            {
+              if (!file)
+                throw Exception ("error opening temporary file \"" + path + "\": " + strerror (errno));
+              set_blocks();
+              thread = std::thread (&DiskStore::execute, this);
+            }
+
+            ~DiskStore()
+            {
+              {
+                std::lock_guard<std::mutex> lock (mutex);
+                stop = true;
+              }
+              condition.notify_all();
+              thread.join();
+              file.close();
+              File::unlink (path);
+            }
+
+            // Partition the streamlines into blocks of similar size on disk, discarding any
+            //   blocks already read; must be called whenever the offsets are modified, after
+            //   a call to cancel()
+            void set_blocks()
+            {
+              std::lock_guard<std::mutex> lock (mutex);
+              block_starts.clear();
+              const uint64_t max_block_size = SIFT_CONTRIBUTION_DISK_BLOCK_SIZE / sizeof (Track_fixel_contribution);
+              for (track_t index = 0; index != master.size(); ) {
+                block_starts.push_back (index);
+                const uint64_t start = master.offsets[index];
+                while (++index != master.size() && master.offsets[index+1] - start <= max_block_size);
+              }
+              block_starts.push_back (master.size());
+              blocks.assign (block_starts.size() - 1, std::shared_ptr<block_type>());
+              loaded.clear();
+              loaded_size = 0;
+              fetch_from = fetch_to = 0;
+              ++generation;
+            }
+
+            // Stop reading ahead, and wait for any read in progress to complete
+            void cancel()
+            {
+              std::unique_lock<std::mutex> lock (mutex);
+              fetch_to = fetch_from;
+              condition.wait (lock, [&] { return !busy; });
+            }
+
+            size_t block_of (const track_t index) const
+            {
+              return std::upper_bound (block_starts.begin(), block_starts.end(), index) - block_starts.begin() - 1;
+            }
+            track_t block_start (const size_t b) const { return block_starts[b]; }
+
+            std::shared_ptr<block_type> get (const size_t b)
+            {
+              std::unique_lock<std::mutex> lock (mutex);
+              if (blocks[b])
+                return blocks[b];
+              const track_t first = block_starts[b], last = block_starts[b+1];
+              lock.unlock();
+              std::shared_ptr<block_type> block (load (first, last));
+              lock.lock();
+              // The block may have been read in the meantime by the background thread
+              if (!blocks[b])
+                insert (b, block);
+              return blocks[b];
+            }
+
+            // Read the blocks containing streamlines [from, to) in the background
+            void prefetch (const track_t from, const track_t to)
+            {
+              {
+                std::lock_guard<std::mutex> lock (mutex);
+                if (from >= to)
+                  return;
+                const size_t first = block_of (from), last = block_of (to-1) + 1;
+                // Jump ahead if the reading has fallen behind, or restart for a new pass
+                if (first > fetch_from || last < fetch_from)
+                  fetch_from = first;
+                fetch_to = last;
+                // Retain the blocks being processed as well as those read ahead
+                max_loaded_size = std::max (uint64_t (SIFT_CONTRIBUTION_CACHE_SIZE / sizeof (Track_fixel_contribution)),
+                                            2 * (master.offsets[to] - master.offsets[from]));
+              }
+              condition.notify_all();
+            }
+
+            void read (const uint64_t position, Track_fixel_contribution* const out, const size_t count)
+            {
+              if (!count)
+                return;
+              std::lock_guard<std::mutex> lock (file_mutex);
+              file.seekg (position * sizeof (Track_fixel_contribution));
+              file.read (reinterpret_cast<char*> (out), count * sizeof (Track_fixel_contribution));
+              if (!file.good())
+                throw Exception ("error reading temporary file \"" + path + "\": " + strerror (errno));
+            }
+
+            void write (const uint64_t position, const Track_fixel_contribution* const in, const size_t count)
+            {
+              if (!count)
+                return;
+              std::lock_guard<std::mutex> lock (file_mutex);
+              file.seekp (position * sizeof (Track_fixel_contribution));
+              file.write (reinterpret_cast<const char*> (in), count * sizeof (Track_fixel_contribution));
+              if (!file.good())
+                throw Exception ("error writing temporary file \"" + path + "\": " + strerror (errno));
+            }
+
+          private:
+            const TrackContributions& master;
+            const std::string path;
+            std::fstream file;
+            std::mutex file_mutex;
+
+            vector<track_t> block_starts;
+            vector<std::shared_ptr<block_type>> blocks;
+            // Blocks currently retained, in the order in which they were read
+            std::deque<size_t> loaded;
+            uint64_t loaded_size, max_loaded_size;
+
+            size_t fetch_from, fetch_to, generation;
+            bool busy, stop;
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::thread thread;
+
+            std::shared_ptr<block_type> load (const track_t first, const track_t last)
+            {
+              std::shared_ptr<block_type> block (new block_type (master.offsets[last] - master.offsets[first]));
+              read (master.offsets[first], block->data(), block->size());
+              return block;
+            }
+
+            // Must be called with the mutex locked
+            void insert (const size_t b, const std::shared_ptr<block_type>& block)
+            {
+              blocks[b] = block;
+              loaded.push_back (b);
+              loaded_size += block->size();
+              while (loaded_size > max_loaded_size && loaded.size() > 1) {
+                loaded_size -= blocks[loaded.front()]->size();
+                blocks[loaded.front()].reset();
+                loaded.pop_front();
+              }
+            }
+
+            void execute()
+            {
+              std::unique_lock<std::mutex> lock (mutex);
+              while (true) {
+                condition.wait (lock, [&] { return stop || fetch_from < fetch_to; });
+                if (stop)
+                  return;
+                const size_t b = fetch_from++;
+                if (blocks[b])
+                  continue;
+                const track_t first = block_starts[b], last = block_starts[b+1];
+                const size_t current_generation = generation;
+                busy = true;
+                lock.unlock();
+                std::shared_ptr<block_type> block;
+                try {
+                  block = load (first, last);
+                } catch (Exception& e) {
+                  // Reported if the block is subsequently requested by a processing thread
+                  DEBUG ("error reading ahead streamline-fixel contributions: " + e[0]);
+                }
+                lock.lock();
+                busy = false;
+                if (block && generation == current_generation && !blocks[b])
+                  insert (b, block);
+                condition.notify_all();
+              }
+            }
+        };
+
+
+
+
+        // Copy the contents of each block into its position in the packed array
+        class TrackContributions::BlockCopier
+        { MEMALIGN(BlockCopier)
+          public:
+            BlockCopier (TrackContributions& master) :
+                master (master) { }
+            BlockCopier (const BlockCopier& that) :
+                master (that.master) { }
+            bool operator() (Buffer::Block* const& block)
+            {
+              if (block->offset >= 0) {
+                size_t count = 0;
+                for (const auto index : block->tracks)
+                  count += master.offsets[index+1] - master.offsets[index];
+                if (!file) {
+                  file.reset (new std::ifstream (master.spill_path, std::ios::in | std::ios::binary));
+                  if (!*file)
+                    throw Exception ("error opening temporary file \"" + master.spill_path + "\": " + strerror (errno));
+                }
+                block->data.resize (count);
+                file->seekg (block->offset);
+                file->read (reinterpret_cast<char*> (block->data.data()), count * sizeof (Track_fixel_contribution));
+                if (!file->good())
+                  throw Exception ("error reading temporary file \"" + master.spill_path + "\": " + strerror (errno));
+              }
+              // Runs of consecutive streamlines are contiguous in the packed array also
+              const Track_fixel_contribution* in = block->data.data();
+              for (size_t i = 0; i != block->tracks.size(); ) {
+                const track_t first = block->tracks[i];
+                while (++i != block->tracks.size() && block->tracks[i] == block->tracks[i-1] + 1);
+                const size_t count = master.offsets[block->tracks[i-1]+1] - master.offsets[first];
+                if (master.disk)
+                  master.disk->write (master.offsets[first], in, count);
+                else
+                  std::copy (in, in + count, master.data + master.offsets[first]);
+                in += count;
+              }
+              vector<Track_fixel_contribution>().swap (block->data);
+              vector<track_t>().swap (block->tracks);
+              return true;
+            }
+          private:
+            TrackContributions& master;
+            std::unique_ptr<std::ifstream> file;
+        };
+
+
+
+
+        TrackContributions::TrackContributions () :
+            data (nullptr),
+            spill_size (0) { }
+
+
+
+        TrackContributions::~TrackContributions()
+        {
+          disk.reset();
+          if (spill_path.size()) {
+            spill.reset();
+            File::unlink (spill_path);
+          }
+        }
+
+
+
+        void TrackContributions::init (const track_t num_tracks, const std::string& dir)
+        {
+          offsets.assign (num_tracks + 1, 0);
+          total_contributions.assign (num_tracks, 0.0f);
+          total_lengths.assign (num_tracks, -1.0f);
+          directory = dir;
+          if (directory.size()) {
+            spill_path = File::create_tempfile (0, "dat", directory);
+            spill.reset (new std::ofstream (spill_path, std::ios::out | std::ios::binary));
+            if (!*spill)
+              throw Exception ("error opening temporary file \"" + spill_path + "\": " + strerror (errno));
+          }
+        }
+
+
+
+        TrackContributions::Buffer& TrackContributions::create_buffer()
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          buffers.push_back (std::unique_ptr<Buffer> (new Buffer (*this)));
+          return *buffers.back();
+        }
+
+
+
+        void TrackContributions::write_block (Buffer::Block& block)
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          block.offset = spill_size;
+          const int64_t bytes = block.data.size() * sizeof (Track_fixel_contribution);
+          spill->write (reinterpret_cast<const char*> (block.data.data()), bytes);
+          if (!spill->good())
+            throw Exception ("error writing temporary file \"" + spill_path + "\": " + strerror (errno));
+          spill_size += bytes;
+        }
+
+
+
+        void TrackContributions::finalise()
+        {
+          for (size_t i = 0; i != size(); ++i)
+            offsets[i+1] += offsets[i];
+
+          if (spill) {
+            spill->close();
+            if (spill->fail())
+              throw Exception ("error writing temporary file \"" + spill_path + "\": " + strerror (errno));
+            spill.reset();
+          }
+
+          const int64_t bytes = num_contributions() * sizeof (Track_fixel_contribution);
+          if (directory.size() && bytes) {
+            const std::string path = File::create_tempfile (bytes, "dat", directory);
+            INFO ("storing " + str(num_contributions()) + " streamline-fixel contributions in file \"" + path + "\"");
+            disk.reset (new DiskStore (*this, path));
+          } else {
+            try {
+              ram.reset (new Track_fixel_contribution [num_contributions()]);
+            } catch (...) {
+              throw Exception ("Error allocating memory for " + str(num_contributions()) + " streamline-fixel contributions"
+                               " (consider using the -mmap_contributions option)");
+            }
+            data = ram.get();
+          }
+
+          vector<Buffer::Block*> blocks;
+          for (auto& b : buffers) {
+            for (auto& block : b->blocks)
+              blocks.push_back (&block);
+          }
+          // Blocks written out during mapping are read back in the order in which they were written
+          std::sort (blocks.begin(), blocks.end(), [] (const Buffer::Block* a, const Buffer::Block* b) {
+              return (a->offset < 0 ? std::numeric_limits<int64_t>::max() : a->offset) < (b->offset < 0 ? std::numeric_limits<int64_t>::max() : b->offset);
+          });
+          size_t next = 0;
+          auto source = [&] (Buffer::Block*& out) {
+            if (next == blocks.size())
+              return false;
+            out = blocks[next++];
+            return true;
+          };
+          BlockCopier copier (*this);
+          Thread::run_queue (source, static_cast<Buffer::Block*> (nullptr), Thread::multi (copier));
+          buffers.clear();
+
+          if (spill_path.size()) {
+            File::unlink (spill_path);
+            spill_path.clear();
+          }
+        }
+
+
+
+        TrackContribution TrackContributions::read (const track_t index) const
+        {
+          const size_t b = disk->block_of (index);
+          auto block = disk->get (b);
+          const Track_fixel_contribution* const address = block->data() + (offsets[index] - offsets[disk->block_start (b)]);
+          return TrackContribution (address, offsets[index+1] - offsets[index], total_contributions[index], total_lengths[index], std::move (block));
+        }
+
+
+
+        void TrackContributions::prefetch (const track_t from, const track_t to)
+        {
+          if (!disk)
+            return;
+          // Read ahead enough data for each thread to process at least one range
+          const track_t window = (to - from) * (Thread::number_of_threads() + 1);
+          disk->prefetch (from, std::min (size(), to + window));
+        }
+
+
+
+        void TrackContributions::resize (const track_t num_tracks)
+        {
+          assert (num_tracks <= size());
+          if (disk)
+            disk->cancel();
+          offsets.resize (num_tracks + 1);
+          total_contributions.resize (num_tracks);
+          total_lengths.resize (num_tracks);
+          if (disk)
+            disk->set_blocks();
+        }
+
+
+
+        void TrackContributions::replace (const track_t index, const vector<Track_fixel_contribution>& in, const float total_contribution)
+        {
+          const size_t num = offsets[index+1] - offsets[index];
+          assert (in.size() <= num);
+          // Where held on disk, the block is modified also, in case it is retained
+          std::shared_ptr<DiskStore::block_type> block;
+          Track_fixel_contribution* out = data + offsets[index];
+          if (disk) {
+            const size_t b = disk->block_of (index);
+            block = disk->get (b);
+            out = block->data() + (offsets[index] - offsets[disk->block_start (b)]);
+          }
+          std::copy (in.begin(), in.end(), out);
+          // Entries with fixel index zero are removed by compact()
+          std::fill (out + in.size(), out + num, Track_fixel_contribution());
+          if (disk)
+            disk->write (offsets[index], out, num);
+          total_contributions[index] = total_contribution;
+        }
+
+
+
+        void TrackContributions::compact()
+        {
+          if (disk) {
+            compact_disk();
+            return;
+          }
+          uint64_t out = 0;
+          for (track_t index = 0; index != size(); ++index) {
+            const uint64_t begin = offsets[index], end = offsets[index+1];
+            offsets[index] = out;
+            // Data for streamlines no longer in the model are discarded also
+            if (total_lengths[index] < 0.0f)
+              continue;
+            for (uint64_t in = begin; in != end; ++in) {
+              if (data[in].get_fixel_index())
+                data[out++] = data[in];
+            }
+          }
+          offsets[size()] = out;
+        }
+
+
+
+        // As compact(), but with the packed array read from and written back to file in chunks;
+        //   since data are only ever moved towards the start of the file, this can be done in place
+        void TrackContributions::compact_disk()
+        {
+          disk->cancel();
+          const uint64_t max_chunk_size = SIFT_CONTRIBUTION_DISK_BLOCK_SIZE / sizeof (Track_fixel_contribution);
+          vector<Track_fixel_contribution> chunk;
+          uint64_t out = 0;
+          for (track_t first = 0; first != size(); ) {
+            track_t last = first;
+            while (++last != size() && offsets[last+1] - offsets[first] <= max_chunk_size);
+            const uint64_t start = offsets[first];
+            chunk.resize (offsets[last] - start);
+            disk->read (start, chunk.data(), chunk.size());
+            size_t count = 0;
+            for (track_t index = first; index != last; ++index) {
+              const uint64_t begin = offsets[index] - start, end = offsets[index+1] - start;
+              offsets[index] = out + count;
+              if (total_lengths[index] < 0.0f)
+                continue;
+              for (uint64_t in = begin; in != end; ++in) {
+                if (chunk[in].get_fixel_index())
+                  chunk[count++] = chunk[in];
+              }
+            }
+            disk->write (out, chunk.data(), count);
+            out += count;
+            first = last;
+          }
+          offsets[size()] = out;
+          disk->set_blocks();
+        }
+
+
+
       }
     }
   }
 }
-
-
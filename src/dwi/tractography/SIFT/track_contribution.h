@@ -17,12 +17,17 @@
 
 
 #include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
 
 #include "header.h"
-#include "min_mem_array.h"
+#include "types.h"
 
 #include "math/math.h"
 
+#include "dwi/tractography/SIFT/types.h"
+
 
 namespace MR
 {
@@ -126,28 +131,147 @@ class Track_fixel_contribution
 
 
 
-      class TrackContribution : public Min_mem_array<Track_fixel_contribution>
+      // A view of the fixel contributions of a single streamline, as stored within TrackContributions
+      // Where the contributions are held on disk, the view keeps the block of data read from file alive
+      class TrackContribution
       { MEMALIGN(TrackContribution)
 
         public:
-        TrackContribution (const vector<Track_fixel_contribution>& in, const float c, const float l) :
-            Min_mem_array<Track_fixel_contribution> (in),
+        TrackContribution (const Track_fixel_contribution* const data, const size_t size, const float c, const float l,
+                           std::shared_ptr<const vector<Track_fixel_contribution>> block = std::shared_ptr<const vector<Track_fixel_contribution>>()) :
+            data (data),
+            num (size),
             total_contribution (c),
-            total_length       (l) { }
+            total_length       (l),
+            block (std::move (block)) { }
 
-        TrackContribution () :
-            Min_mem_array<Track_fixel_contribution> (),
-            total_contribution (0.0),
-            total_length       (0.0) { }
+        // False if the streamline was not mapped, or has since been removed from the model
+        explicit operator bool () const { return total_length >= 0.0f; }
 
-        ~TrackContribution() { }
+        size_t dim() const { return num; }
+        const Track_fixel_contribution& operator[] (const size_t i) const { assert (i < num); return data[i]; }
 
         float get_total_contribution() const { return total_contribution; }
         float get_total_length      () const { return total_length; }
 
         private:
+          const Track_fixel_contribution* const data;
+          const size_t num;
           const float total_contribution, total_length;
+          const std::shared_ptr<const vector<Track_fixel_contribution>> block;
+
+      };
+
+
+
+
+      // Storage of the fixel contributions of all streamlines in compressed sparse row (CSR)
+      //   format: the contributions of streamline i are at [offsets[i], offsets[i+1]) within a
+      //   single packed array, which is held either in RAM or in a temporary file. In the latter
+      //   case, the file is read in blocks of consecutive streamlines using explicit reads
+      //   rather than memory-mapping, so that it can reside on any file system.
+      // Streamlines are mapped in parallel into a Buffer within each thread; these are then
+      //   copied into the packed array (in order of streamline index) by finalise().
+      class TrackContributions
+      { MEMALIGN(TrackContributions)
 
+        public:
+          class Buffer
+          { MEMALIGN(Buffer)
+            public:
+              Buffer (TrackContributions& master) : master (master) { }
+              Buffer (const Buffer&) = delete;
+
+              void add (const track_t index, const vector<Track_fixel_contribution>& in, const float total_contribution, const float total_length);
+
+              // Data are accumulated in fixed-size blocks, rather than a single growing vector,
+              //   to avoid the transient memory cost of reallocation
+              class Block
+              { MEMALIGN(Block)
+                public:
+                  Block () : offset (-1) { }
+                  vector<Track_fixel_contribution> data;
+                  vector<track_t> tracks;
+                  // Position of the data within the spill file, if written out during mapping
+                  int64_t offset;
+              };
+
+            private:
+              TrackContributions& master;
+              vector<Block> blocks;
+
+              friend class TrackContributions;
+          };
+
+
+          TrackContributions ();
+          TrackContributions (const TrackContributions&) = delete;
+          ~TrackContributions();
+
+          // Prepare for mapping the specified number of streamlines; if directory is not empty,
+          //   the contributions are held in temporary files within that directory rather than
+          //   in RAM, both during mapping and thereafter
+          void init (const track_t num_tracks, const std::string& directory = std::string());
+          // Create a buffer for accumulating the streamlines mapped within one thread
+          Buffer& create_buffer();
+          // Construct the packed array from the contents of all buffers
+          void finalise();
+
+          track_t size() const { return total_lengths.size(); }
+          size_t num_contributions() const { return offsets.size() ? offsets.back() : 0; }
+
+          TrackContribution operator[] (const track_t index) const
+          {
+            assert (index < size());
+            if (disk)
+              return read (index);
+            return TrackContribution (data + offsets[index], offsets[index+1] - offsets[index], total_contributions[index], total_lengths[index]);
+          }
+
+          // These do not require the contributions themselves to be read from disk
+          bool   is_present             (const track_t index) const { return total_lengths[index] >= 0.0f; }
+          size_t num_contributions      (const track_t index) const { return offsets[index+1] - offsets[index]; }
+          float  get_total_contribution (const track_t index) const { return total_contributions[index]; }
+          float  get_total_length       (const track_t index) const { return total_lengths[index]; }
+
+          // Indicate that streamlines [from, to) are about to be processed, as part of a pass
+          //   through all streamlines in order; if the contributions are held on disk, those
+          //   of subsequent streamlines are read in the background, and the blocks holding
+          //   those of preceding streamlines are released once no longer in use
+          void prefetch (const track_t from, const track_t to);
+
+          // Remove a streamline from the model
+          void remove (const track_t index) { total_lengths[index] = -1.0f; }
+          // Discard all streamlines from the specified index onwards
+          void resize (const track_t num_tracks);
+
+          // Replace the contributions of a streamline (e.g. following fixel removal); the number of
+          //   contributions must not increase. Calls to this function can be made concurrently for
+          //   different streamlines, and must be followed by a call to compact().
+          void replace (const track_t index, const vector<Track_fixel_contribution>& in, const float total_contribution);
+          void compact();
+
+        private:
+          vector<uint64_t> offsets;
+          vector<float> total_contributions, total_lengths;
+          Track_fixel_contribution* data;
+          std::unique_ptr<Track_fixel_contribution[]> ram;
+
+          class DiskStore;
+          std::unique_ptr<DiskStore> disk;
+          TrackContribution read (const track_t index) const;
+          void compact_disk();
+
+          std::mutex mutex;
+          vector<std::unique_ptr<Buffer>> buffers;
+
+          // Full blocks are written to a spill file during mapping if a directory is provided
+          std::string directory, spill_path;
+          std::unique_ptr<std::ofstream> spill;
+          int64_t spill_size;
+          void write_block (Buffer::Block&);
+
+          class BlockCopier;
       };
 
 
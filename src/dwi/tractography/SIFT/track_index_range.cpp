@@ -13,6 +13,7 @@
 
 
 #include "dwi/tractography/SIFT/track_index_range.h"
+#include "dwi/tractography/SIFT/track_contribution.h"
 
 
 namespace MR
@@ -30,7 +31,16 @@ namespace MR
         size  (buffer_size),
         end   (num_tracks),
         start (0),
-        progress (message.empty() ? NULL : new ProgressBar (message, ceil (float(end) / float(size)))) { }
+        progress (message.empty() ? NULL : new ProgressBar (message, ceil (float(end) / float(size)))),
+        contributions (nullptr) { }
+
+
+      TrackIndexRangeWriter::TrackIndexRangeWriter (const track_t buffer_size, TrackContributions& contributions, const std::string& message) :
+        size  (buffer_size),
+        end   (contributions.size()),
+        start (0),
+        progress (message.empty() ? NULL : new ProgressBar (message, ceil (float(end) / float(size)))),
+        contributions (&contributions) { }
 
 
       bool TrackIndexRangeWriter::operator() (TrackIndexRange& out)
@@ -41,6 +51,8 @@ namespace MR
         const track_t last = std::min (start + size, end);
         out.second = last;
         start = last;
+        if (contributions)
+          contributions->prefetch (out.first, out.second);
         if (progress)
           ++*progress;
         return true;
@@ -33,6 +33,10 @@ namespace MR
 
 
 
+      class TrackContributions;
+
+
+
       using TrackIndexRange = std::pair<track_t, track_t>;
       using TrackIndexRangeQueue = Thread::Queue< TrackIndexRange >;
 
@@ -47,6 +51,8 @@ namespace MR
 
         public:
           TrackIndexRangeWriter (const track_t, const track_t, const std::string& message = std::string ());
+          // Provide ranges over all streamlines, prefetching their contributions where these are stored on disk
+          TrackIndexRangeWriter (const track_t, TrackContributions&, const std::string& message = std::string ());
 
           bool operator() (TrackIndexRange&);
 
@@ -54,6 +60,7 @@ namespace MR
           const track_t size, end;
           track_t start;
           std::unique_ptr<ProgressBar> progress;
+          TrackContributions* contributions;
 
       };
 
@@ -48,7 +48,7 @@ namespace MR {
             local_stats_steps (),
             local_stats_coefficients (),
             local_nonzero_count (0),
-            local_to_exclude (fixels_to_exclude.size()),
+            local_to_exclude (),
             local_sum_costs (0.0) { }
 
 
@@ -71,7 +71,7 @@ namespace MR {
             local_stats_steps (),
             local_stats_coefficients (),
             local_nonzero_count (0),
-            local_to_exclude (fixels_to_exclude.size()),
+            local_to_exclude (),
             local_sum_costs (0.0) { }
 
 
@@ -85,7 +85,8 @@ namespace MR {
         step_stats += local_stats_steps;
         coefficient_stats += local_stats_coefficients;
         nonzero_streamlines += local_nonzero_count;
-        fixels_to_exclude |= local_to_exclude;
+        for (const auto i : local_to_exclude)
+          fixels_to_exclude[i] = true;
         sum_costs += local_sum_costs;
       }
 
@@ -135,7 +136,7 @@ namespace MR {
           // Update the stats
           local_stats_steps += dFs;
           local_stats_coefficients += new_coefficient;
-          if (master.contributions[track_index] && master.contributions[track_index]->dim() && new_coefficient > master.min_coeff)
+          if (master.contributions[track_index] && master.contributions[track_index].dim() && new_coefficient > master.min_coeff)
             ++local_nonzero_count;
 
 #ifdef STREAMLINE_OF_INTEREST
@@ -170,7 +171,7 @@ namespace MR {
 
       double CoefficientOptimiserBase::do_fixel_exclusion (const SIFT::track_t track_index)
       {
-        const SIFT::TrackContribution& this_contribution (*(master.contributions[track_index]));
+        const SIFT::TrackContribution this_contribution (master.contributions[track_index]);
 
         // Task 1: Identify the fixel that should be excluded
         size_t index_to_exclude = 0.0;
@@ -192,7 +193,7 @@ namespace MR {
         }
 
         if (index_to_exclude)
-          local_to_exclude[index_to_exclude] = true;
+          local_to_exclude.push_back (index_to_exclude);
         else
           return 0.0;
 
@@ -72,7 +72,8 @@ namespace MR {
 
           StreamlineStats local_stats_steps, local_stats_coefficients;
           size_t local_nonzero_count;
-          BitSet local_to_exclude;
+          // Exclusions are rare, so store a list of fixel indices rather than a mask of all fixels
+          vector<size_t> local_to_exclude;
 
         protected:
           mutable double local_sum_costs;
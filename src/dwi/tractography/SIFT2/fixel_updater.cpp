@@ -12,7 +12,7 @@
  */
 
 
-#include <mutex>
+#include "thread_queue.h"
 
 #include "dwi/tractography/SIFT2/fixel_updater.h"
 #include "dwi/tractography/SIFT2/tckfactor.h"
@@ -31,28 +31,32 @@ namespace MR {
 
       FixelUpdater::FixelUpdater (TckFactor& tckfactor) :
           master (tckfactor),
-          fixel_coeff_sums (tckfactor.fixels.size(), 0.0),
-          fixel_TDs        (tckfactor.fixels.size(), 0.0),
-          fixel_counts     (tckfactor.fixels.size(), 0) { }
+          shared (new Shared()),
+          buffer (nullptr) { }
 
 
 
-      FixelUpdater::~FixelUpdater()
-      {
-        std::lock_guard<std::mutex> lock (master.mutex);
-        for (size_t i = 0; i != master.fixels.size(); ++i) {
-          master.fixels[i].add_to_mean_coeff (fixel_coeff_sums[i]);
-          master.fixels[i].add_TD (fixel_TDs[i], fixel_counts[i]);
-        }
-      }
+      FixelUpdater::FixelUpdater (const FixelUpdater& that) :
+          master (that.master),
+          shared (that.shared),
+          buffer (nullptr) { }
 
 
 
       bool FixelUpdater::operator() (const SIFT::TrackIndexRange& range)
       {
+        if (!buffer) {
+          std::unique_ptr<Buffer> new_buffer (new Buffer (master.fixels.size()));
+          buffer = new_buffer.get();
+          std::lock_guard<std::mutex> lock (shared->mutex);
+          shared->buffers.push_back (std::move (new_buffer));
+        }
+        vector<double>& fixel_coeff_sums (buffer->coeff_sums);
+        vector<double>& fixel_TDs (buffer->TDs);
+        vector<SIFT::track_t>& fixel_counts (buffer->counts);
         for (SIFT::track_t track_index = range.first; track_index != range.second; ++track_index) {
           const double coefficient = master.coefficients[track_index];
-          const SIFT::TrackContribution& this_contribution (*(master.contributions[track_index]));
+          const SIFT::TrackContribution this_contribution (master.contributions[track_index]);
           const double weighting_factor = (coefficient > master.min_coeff) ? std::exp (coefficient) : 0.0;
           for (size_t j = 0; j != this_contribution.dim(); ++j) {
             const size_t fixel_index = this_contribution[j].get_fixel_index();
@@ -67,6 +71,33 @@ namespace MR {
 
 
 
+      void FixelUpdater::reduce()
+      {
+        reduce (master.fixels, shared->buffers);
+        shared->buffers.clear();
+      }
+
+
+
+      void FixelUpdater::reduce (vector<Fixel>& fixels, const BufferList& buffers, const size_t num_threads)
+      {
+        // Each item is a range of fixel indices, rather than of streamline indices
+        SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, fixels.size());
+        auto reducer = [&] (const SIFT::TrackIndexRange& range)
+        {
+          for (const auto& b : buffers) {
+            for (size_t i = range.first; i != range.second; ++i) {
+              fixels[i].add_to_mean_coeff (b->coeff_sums[i]);
+              fixels[i].add_TD (b->TDs[i], b->counts[i]);
+            }
+          }
+          return true;
+        };
+        Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (reducer, num_threads));
+      }
+
+
+
 
       }
     }
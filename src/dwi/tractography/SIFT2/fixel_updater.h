@@ -16,10 +16,15 @@
 #define __dwi_tractography_sift2_fixel_updater_h__
 
 
+#include <memory>
+#include <mutex>
+
+#include "thread.h"
 #include "types.h"
 
 #include "dwi/tractography/SIFT/track_index_range.h"
 #include "dwi/tractography/SIFT/types.h"
+#include "dwi/tractography/SIFT2/fixel.h"
 
 
 namespace MR {
@@ -35,18 +40,46 @@ namespace MR {
       { MEMALIGN(FixelUpdater)
 
         public:
+          // Sums for all fixels of the streamlines processed within a single thread
+          class Buffer
+          { MEMALIGN(Buffer)
+            public:
+              Buffer (const size_t num_fixels) :
+                  coeff_sums (num_fixels, 0.0),
+                  TDs        (num_fixels, 0.0),
+                  counts     (num_fixels, 0) { }
+              vector<double> coeff_sums;
+              vector<double> TDs;
+              vector<SIFT::track_t> counts;
+          };
+          using BufferList = vector<std::unique_ptr<Buffer>>;
+
+
           FixelUpdater (TckFactor&);
-          ~FixelUpdater();
+          FixelUpdater (const FixelUpdater&);
 
           bool operator() (const SIFT::TrackIndexRange& range);
 
+          // Add the contents of the buffers of all threads to the fixels; must be called once
+          //   the threads have completed
+          void reduce();
+
+          // This is multi-threaded over ranges of fixel indices, so that no locking is required
+          static void reduce (vector<Fixel>& fixels, const BufferList& buffers, const size_t num_threads = Thread::number_of_threads());
+
         private:
+          class Shared
+          { MEMALIGN(Shared)
+            public:
+              std::mutex mutex;
+              BufferList buffers;
+          };
+
           TckFactor& master;
+          std::shared_ptr<Shared> shared;
 
-          // Each thread needs a local copy of these
-          vector<double> fixel_coeff_sums;
-          vector<double> fixel_TDs;
-          vector<SIFT::track_t> fixel_counts;
+          // Each thread allocates its own buffer on first use
+          Buffer* buffer;
 
       };
 
@@ -113,7 +113,7 @@ namespace MR {
         TD_sum = 0.0;
 
         for (SIFT::track_t track_index = 0; track_index != num_tracks(); ++track_index) {
-          const SIFT::TrackContribution& tck_cont (*contributions[track_index]);
+          const SIFT::TrackContribution tck_cont (contributions[track_index]);
           const double weight = 1.0 / tck_cont.get_total_length();
           coefficients[track_index] = std::log (weight);
           for (size_t i = 0; i != tck_cont.dim(); ++i)
@@ -150,7 +150,7 @@ namespace MR {
 
         // Just do single-threaded for now
         for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
-          const SIFT::TrackContribution& tckcont = *contributions[i];
+          const SIFT::TrackContribution tckcont (contributions[i]);
           double sum_afd = 0.0;
           for (size_t f = 0; f != tckcont.dim(); ++f) {
             const size_t fixel_index = tckcont[f].get_fixel_index();
@@ -167,9 +167,10 @@ namespace MR {
           i->clear_mean_coeff();
         }
         {
-          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
           FixelUpdater worker (*this);
           Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
+          worker.reduce();
         }
 
         VAR (calc_cost_function());
@@ -197,7 +198,7 @@ namespace MR {
 
         unsigned int nonzero_streamlines = 0;
         for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
-          if (contributions[i] && contributions[i]->dim())
+          if (contributions.is_present (i) && contributions.num_contributions (i))
             ++nonzero_streamlines;
         }
 
@@ -243,7 +244,7 @@ namespace MR {
           fixels_to_exclude.clear();
           double sum_costs = 0.0;
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
             //CoefficientOptimiserGSS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
             //CoefficientOptimiserQLS worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
             CoefficientOptimiserIterative worker (*this, /*projected_steps,*/ step_stats, coefficient_stats, nonzero_streamlines, fixels_to_exclude, sum_costs);
@@ -270,9 +271,10 @@ namespace MR {
             i->clear_mean_coeff();
           }
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
             FixelUpdater worker (*this);
             Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
+            worker.reduce();
           }
           // Scale the fixel mean coefficient terms (each streamline in the fixel is weighted by its length)
           for (vector<Fixel>::iterator i = fixels.begin(); i != fixels.end(); ++i)
@@ -286,7 +288,7 @@ namespace MR {
           // Log different regularisation costs separately
           double cf_reg_tik = 0.0, cf_reg_tv = 0.0;
           {
-            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_tracks());
+            SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, contributions);
             RegularisationCalculator worker (*this, cf_reg_tik, cf_reg_tv);
             Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (worker));
           }
@@ -357,7 +359,7 @@ namespace MR {
           ProgressBar progress ("Generating streamline coefficient statistic images", num_tracks());
           for (SIFT::track_t i = 0; i != num_tracks(); ++i) {
             const double coeff = coefficients[i];
-            const SIFT::TrackContribution& this_contribution (*contributions[i]);
+            const SIFT::TrackContribution this_contribution (contributions[i]);
             if (coeff > min_coeff) {
               for (size_t j = 0; j != this_contribution.dim(); ++j) {
                 const size_t fixel_index = this_contribution[j].get_fixel_index();
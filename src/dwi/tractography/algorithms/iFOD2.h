@@ -380,6 +380,12 @@ end_init:
                   return 0.0;
               }
 
+              // points are deliberately evaluated one at a time, rather than
+              // using Math::SH::BatchEvaluator as in Calibrate: batching would
+              // require the FOD to be interpolated at every point of the arc
+              // up front, which forfeits the early exit below as soon as one
+              // point falls under threshold (most candidate arcs are rejected
+              // this way), and measured slower overall:
               float log_prob = half_log_prob0;
               for (size_t i = 0; i < S.num_samples; ++i) {
 
@@ -450,7 +456,8 @@ end_init:
                   fod (P.values),
                   vox (P.S.vox()),
                   positions (P.S.num_samples),
-                  tangents (P.S.num_samples) {
+                  tangents (P.S.num_samples),
+                  batch (P.S.lmax) {
                     Math::SH::delta (fod, Eigen::Vector3f (0.0, 0.0, 1.0), P.S.lmax);
                     init_log_prob = 0.5 * std::log (Math::SH::value (P.values, Eigen::Vector3f (0.0, 0.0, 1.0), P.S.lmax));
                   }
@@ -460,9 +467,12 @@ end_init:
                   P.pos = { 0.0f, 0.0f, 0.0f };
                   P.get_path (positions, tangents, Eigen::Vector3f (std::sin (el), 0.0, std::cos(el)));
 
+                  batch.set_directions (tangents);
+                  batch.values (amplitudes, fod);
+
                   float log_prob = init_log_prob;
                   for (size_t i = 0; i < P.S.num_samples; ++i) {
-                    float prob = Math::SH::value (P.values, tangents[i], P.S.lmax) * (1.0 - (positions[i][0] / vox));
+                    float prob = amplitudes[i] * (1.0 - (positions[i][0] / vox));
                     if (prob <= 0.0)
                       return 0.0;
                     prob = std::log (prob);
@@ -481,6 +491,8 @@ end_init:
                 const float vox;
                 float init_log_prob;
                 vector<Eigen::Vector3f> positions, tangents;
+                Math::SH::BatchEvaluator<float> batch;
+                Eigen::VectorXf amplitudes;
             };
 
             friend void calibrate<iFOD2> (iFOD2& method);
@@ -143,6 +143,8 @@ class SDStream : public MethodBase { MEMALIGN(SDStream)
       const Shared& S;
       Interpolator<Image<float>>::type source;
 
+      friend class Tracking::PacketStep<SDStream>;
+
       float find_peak ()
       {
         float FOD = Math::SH::get_peak (values, S.lmax, dir, S.precomputer);
@@ -163,6 +165,65 @@ class SDStream : public MethodBase { MEMALIGN(SDStream)
 };
 
 }
+
+
+
+namespace Tracking {
+
+// find the peaks for all streamlines in the packet together:
+template <>
+class PacketStep<Algorithms::SDStream>
+{ MEMALIGN(PacketStep<Algorithms::SDStream>)
+  public:
+    static constexpr bool vectorised = true;
+
+    PacketStep (const Algorithms::SDStream::Shared& shared) :
+      S (shared),
+      finder (S.lmax, S.precomputer) { }
+
+    void operator() (Algorithms::SDStream* const* lanes, size_t num_lanes, term_t* terms)
+    {
+      assert (num_lanes <= TRACKING_PACKET_SIZE);
+      size_t lane_index[TRACKING_PACKET_SIZE];
+      int num = 0;
+      for (size_t n = 0; n != num_lanes; ++n) {
+        Algorithms::SDStream& method (*lanes[n]);
+        if (!method.get_data (method.source)) {
+          terms[n] = EXIT_IMAGE;
+          continue;
+        }
+        finder.coefficients().row (num) = method.values.head (finder.coefficients().cols()).transpose();
+        dirs.row (num) = method.dir.transpose();
+        lane_index[num++] = n;
+      }
+
+      finder (dirs, amplitudes, num);
+
+      for (int i = 0; i != num; ++i) {
+        Algorithms::SDStream& method (*lanes[lane_index[i]]);
+        term_t& term (terms[lane_index[i]]);
+        const Eigen::Vector3f prev_dir (method.dir);
+        method.dir = dirs.row (i).transpose();
+        if (!std::isfinite (amplitudes[i]) || amplitudes[i] < S.threshold)
+          term = BAD_SIGNAL;
+        else if (prev_dir.dot (method.dir) < S.dot_threshold)
+          term = HIGH_CURVATURE;
+        else {
+          method.pos += method.dir * S.step_size;
+          term = CONTINUE;
+        }
+      }
+    }
+
+  protected:
+    const Algorithms::SDStream::Shared& S;
+    Math::SH::PeakFinder<float,TRACKING_PACKET_SIZE> finder;
+    Math::SH::PeakFinder<float,TRACKING_PACKET_SIZE>::dirs_type dirs;
+    Math::SH::PeakFinder<float,TRACKING_PACKET_SIZE>::lane_type amplitudes;
+};
+
+}
+
 }
 }
 }
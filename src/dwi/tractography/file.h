@@ -15,15 +15,19 @@
 #ifndef __dwi_tractography_file_h__
 #define __dwi_tractography_file_h__
 
+#include <limits>
 #include <map>
 
 #include "app.h"
 #include "types.h"
 #include "memory.h"
+#include "raw.h"
 #include "file/config.h"
 #include "file/key_value.h"
 #include "file/ofstream.h"
+#include "file/utils.h"
 #include "dwi/tractography/file_base.h"
+#include "dwi/tractography/file_index.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/streamline.h"
 
@@ -62,7 +66,125 @@ namespace MR
 
 
 
+      //! \cond skip
+      // the quantised track file format, used for files with the .tcq suffix:
+      //
+      // The header is as for the .tck format, with the first line "mrtrix
+      // quantised tracks", the datatype set to Int16LE, and the additional
+      // entry "quantisation" providing the spacing (in mm) of the grid to
+      // which all vertices are rounded. The data consist of a sequence of
+      // blocks, each starting with the size in bytes of the remainder of
+      // the block and the number of streamlines within it (both uint32 LE),
+      // with one block written per commit of the write-back buffer; this
+      // allows blocks to be located without decoding their contents. Each
+      // streamline then consists of its number of vertices (uint32 LE), the
+      // position of the first vertex in grid units (3 x int32 LE), and the
+      // offset of each subsequent vertex from the previous one in grid
+      // units (3 x int16 LE per vertex). An offset too large to be stored
+      // as an int16 is replaced by the value -32768, followed by the
+      // position along that axis in grid units (int32 LE). As all
+      // arithmetic is performed on the integer grid positions, errors do
+      // not accumulate along the streamline: each vertex lies within half
+      // the grid spacing of its original position along each axis.
+      constexpr int16_t quantised_tracks_escape = std::numeric_limits<int16_t>::min();
+
+
+      template <class ValueType = float>
+      class QuantisedReader : public __ReaderBase__, public ReaderInterface<ValueType>
+      { NOMEMALIGN
+        public:
+          QuantisedReader (const std::string& file, Properties& properties) :
+              current_index (0),
+              tracks_in_block (0),
+              pos (0) {
+            open (file, "quantised tracks", properties);
+            auto it = properties.find ("quantisation");
+            if (it == properties.end())
+              throw Exception ("missing quantisation for quantised tracks file \"" + file + "\"");
+            quantisation = to<default_type> (it->second);
+            properties.erase (it);
+          }
+
+          bool operator() (Streamline<ValueType>& tck) {
+            tck.clear();
+            if (!tracks_in_block && !next_block())
+              return false;
+
+            const uint8_t* p = block.data() + pos;
+            const uint8_t* const end = block.data() + block.size();
+            if (end - p < 16)
+              throw Exception ("corrupted data in quantised tracks file \"" + data_path + "\"");
+            const uint32_t num_points = Raw::fetch_LE<uint32_t> (p);
+            int32_t q[3] = { Raw::fetch_LE<int32_t> (p+4), Raw::fetch_LE<int32_t> (p+8), Raw::fetch_LE<int32_t> (p+12) };
+            p += 16;
+
+            tck.resize (num_points);
+            for (uint32_t n = 0; n < num_points; ++n) {
+              if (n) {
+                if (end - p < 6)
+                  throw Exception ("corrupted data in quantised tracks file \"" + data_path + "\"");
+                for (size_t axis = 0; axis < 3; ++axis) {
+                  const int16_t delta = Raw::fetch_LE<int16_t> (p);
+                  p += 2;
+                  if (delta == quantised_tracks_escape) {
+                    if (end - p < 4)
+                      throw Exception ("corrupted data in quantised tracks file \"" + data_path + "\"");
+                    q[axis] = Raw::fetch_LE<int32_t> (p);
+                    p += 4;
+                  }
+                  else
+                    q[axis] += delta;
+                }
+              }
+              tck[n] = { ValueType (q[0] * quantisation), ValueType (q[1] * quantisation), ValueType (q[2] * quantisation) };
+            }
+
+            pos = p - block.data();
+            --tracks_in_block;
+            tck.index = current_index++;
+            tck.weight = 1.0f;
+            return true;
+          }
+
+        protected:
+          default_type quantisation;
+          uint64_t current_index;
+          uint32_t tracks_in_block;
+          size_t pos;
+          vector<uint8_t> block;
+
+          bool next_block () {
+            do {
+              if (!in.is_open())
+                return false;
+              uint32_t header[2];
+              in.read (reinterpret_cast<char*> (header), sizeof (header));
+              if (in.gcount() < std::streamsize (sizeof (header))) {
+                in.close();
+                return false;
+              }
+              block.resize (Raw::fetch_LE<uint32_t> (header));
+              tracks_in_block = Raw::fetch_LE<uint32_t> (header+1);
+              in.read (reinterpret_cast<char*> (block.data()), block.size());
+              if (in.gcount() < std::streamsize (block.size())) {
+                WARN ("quantised tracks file \"" + data_path + "\" is truncated");
+                in.close();
+                return false;
+              }
+              pos = 0;
+            } while (!tracks_in_block);
+            return true;
+          }
+      };
+
+
+
+      //! \endcond
+
+
+
       //! A class to read streamlines data
+      /*! This reads both .tck files and quantised track files (.tcq). */
       template <class ValueType = float>
       class Reader : public __ReaderBase__, public ReaderInterface<ValueType>
       { NOMEMALIGN
@@ -71,7 +193,10 @@ namespace MR
           //! open the \c file for reading and load header into \c properties
           Reader (const std::string& file, Properties& properties) :
             current_index (0) {
-              open (file, "tracks", properties);
+              if (Path::has_suffix (file, ".tcq"))
+                quantised.reset (new QuantisedReader<ValueType> (file, properties));
+              else
+                open (file, "tracks", properties);
               auto opt = App::get_options ("tck_weights_in");
               if (opt.size()) {
                 weights_file.reset (new std::ifstream (str(opt[0][0]).c_str(), std::ios_base::in));
@@ -83,6 +208,16 @@ namespace MR
 
             //! fetch next track from file
             bool operator() (Streamline<ValueType>& tck) {
+              if (quantised) {
+                if (!(*quantised) (tck)) {
+                  quantised.reset();
+                  check_excess_weights();
+                  return false;
+                }
+                tck.index = current_index++;
+                return read_weight (tck);
+              }
+
               tck.clear();
 
               if (!in.is_open())
@@ -103,22 +238,7 @@ namespace MR
 
                 if (std::isnan (p[0])) {
                   tck.index = current_index++;
-
-                  if (weights_file) {
-
-                    (*weights_file) >> tck.weight;
-                    if (weights_file->fail()) {
-                      WARN ("Streamline weights file contains less entries than .tck file; only read " + str(current_index-1) + " streamlines");
-                      in.close();
-                      tck.clear();
-                      return false;
-                    }
-
-                  } else {
-                    tck.weight = 1.0;
-                  }
-
-                  return true;
+                  return read_weight (tck);
                 }
 
                 tck.push_back (p);
@@ -136,6 +256,25 @@ namespace MR
 
           uint64_t current_index;
           std::unique_ptr<std::ifstream> weights_file;
+          std::unique_ptr<QuantisedReader<ValueType>> quantised;
+
+          //! set the weight of the streamline just read
+          bool read_weight (Streamline<ValueType>& tck)
+          {
+            if (weights_file) {
+              (*weights_file) >> tck.weight;
+              if (weights_file->fail()) {
+                WARN ("Streamline weights file contains less entries than .tck file; only read " + str(current_index-1) + " streamlines");
+                in.close();
+                quantised.reset();
+                tck.clear();
+                return false;
+              }
+            } else {
+              tck.weight = 1.0;
+            }
+            return true;
+          }
 
           //! takes care of byte ordering issues
 
@@ -219,6 +358,7 @@ namespace MR
           using __WriterBase__<ValueType>::verify_stream;
           using __WriterBase__<ValueType>::update_counts;
           using __WriterBase__<ValueType>::open_success;
+          using __WriterBase__<ValueType>::reopen;
 
           using vector_type = Eigen::Matrix<ValueType,3,1>;
 
@@ -226,8 +366,9 @@ namespace MR
           WriterUnbuffered (const std::string& file, const Properties& properties) :
               __WriterBase__<ValueType> (file) {
 
-            if (!Path::has_suffix (name, ".tck"))
-              throw Exception ("output track files must use the .tck suffix");
+            const bool quantised_format = Path::has_suffix (name, ".tcq");
+            if (!quantised_format && !Path::has_suffix (name, ".tck"))
+              throw Exception ("output track files must use the .tck or .tcq suffix");
 
             File::OFStream out;
             try {
@@ -239,21 +380,109 @@ namespace MR
             const_cast<Properties&> (properties).set_timestamp();
             const_cast<Properties&> (properties).set_version_info();
 
-            create (out, properties, "tracks");
-            barrier_addr = out.tellp();
-
-            vector_type x;
-            format_point (barrier(), x);
-            out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            if (quantised_format) {
+              //CONF option: TrackQuantisation
+              //CONF default: 0.001
+              //CONF The spacing (in mm) of the grid to which streamline
+              //CONF vertices are rounded when writing quantised track files
+              //CONF (.tcq).
+              // store the value as specified, so that readers reconstruct
+              // exactly the same positions:
+              const std::string spacing = File::Config::get ("TrackQuantisation", "0.001");
+              quantisation = to<default_type> (spacing);
+              if (!(quantisation > 0.0))
+                throw Exception ("TrackQuantisation config file option must be positive");
+              dtype = DataType::Int16LE;
+              const_cast<Properties&> (properties)["quantisation"] = spacing;
+              create (out, properties, "quantised tracks");
+              const_cast<Properties&> (properties).erase ("quantisation");
+
+              // an empty block, so that subsequent blocks are appended at the
+              // data offset:
+              const uint32_t empty_block[2] = { 0, 0 };
+              out.write (reinterpret_cast<const char*> (empty_block), sizeof (empty_block));
+              quantised_end = out.tellp();
+            }
+            else {
+              quantisation = 0.0;
+              create (out, properties, "tracks");
+              barrier_addr = out.tellp();
+
+              vector_type x;
+              format_point (barrier(), x);
+              out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            }
             if (!out.good())
               throw Exception ("error writing tracks file \"" + name + "\": " + strerror (errno));
             open_success = true;
 
+            // an index left over from a previous file of the same name would
+            // no longer match the data:
+            if (write_index() && !quantisation)
+              index.reset (new TrackIndexWriter (name, barrier_addr));
+            else if (Path::exists (index_path (name)))
+              File::unlink (index_path (name));
+
             auto opt = App::get_options ("tck_weights_out");
             if (opt.size())
               set_weights_path (opt[0][0]);
           }
 
+          //! re-open an existing track file to append further tracks
+          /*! Any data beyond the first \a size bytes of the file (as
+           * previously obtained from data_end()) are discarded, and the track
+           * counts in the header are reset to \a num_tracks and \a
+           * total_num_tracks. This allows writing to resume after an
+           * interruption; note that the streamline index is not maintained
+           * for appended files. */
+          WriterUnbuffered (const std::string& file, const int64_t size, const uint64_t num_tracks, const uint64_t total_num_tracks) :
+              __WriterBase__<ValueType> (file, true) {
+
+            const bool quantised_format = Path::has_suffix (name, ".tcq");
+            if (!quantised_format && !Path::has_suffix (name, ".tck"))
+              throw Exception ("output track files must use the .tck or .tcq suffix");
+
+            const auto header = reopen (quantised_format ? "quantised tracks" : "tracks");
+            if (quantised_format) {
+              const auto q = header.find ("quantisation");
+              quantisation = q == header.end() ? 0.0 : to<default_type> (q->second);
+              if (!(quantisation > 0.0))
+                throw Exception ("invalid quantisation in header of track file \"" + name + "\"");
+              dtype = DataType::Int16LE;
+              quantised_end = size;
+            }
+            else {
+              const auto d = header.find ("datatype");
+              if (d == header.end() || DataType::parse (d->second) != dtype)
+                throw Exception ("cannot append to track file \"" + name + "\": datatype does not match");
+              quantisation = 0.0;
+              barrier_addr = size - sizeof (vector_type);
+            }
+
+            File::resize (name, size);
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+            if (!quantisation) {
+              vector_type x;
+              format_point (barrier(), x);
+              out.seekp (barrier_addr);
+              out.write (reinterpret_cast<char*> (&x[0]), sizeof (x));
+            }
+            count = num_tracks;
+            total_count = total_num_tracks;
+            update_counts (out);
+            open_success = true;
+
+            if (Path::exists (index_path (name))) {
+              WARN ("streamline index for track file \"" + name + "\" removed as data are being appended");
+              File::unlink (index_path (name));
+            }
+          }
+
+          //! the size of the file once all data written so far have been committed
+          int64_t data_end () const {
+            return quantisation ? quantised_end : barrier_addr + int64_t (sizeof (vector_type));
+          }
+
           //! append track to file
           bool operator() (const Streamline<ValueType>& tck) {
             if (tck.size()) {
@@ -263,6 +492,8 @@ namespace MR
                 format_point (tck[n], buffer[n]);
               format_point (delimiter(), buffer[tck.size()]);
 
+              if (index)
+                index->add (barrier_addr);
               commit (buffer, tck.size()+1);
 
               if (weights_name.size())
@@ -286,7 +517,10 @@ namespace MR
 
         protected:
           std::string weights_name;
-          int64_t barrier_addr;
+          int64_t barrier_addr, quantised_end;
+          std::unique_ptr<TrackIndexWriter> index;
+          default_type quantisation;
+          vector<uint8_t> quantised_block;
 
           //! indicates end of track and start of new track
           vector_type delimiter () const { return { ValueType(NaN), ValueType(NaN), ValueType(NaN) }; }
@@ -318,6 +552,11 @@ namespace MR
             if (num_points == 0 || !open_success)
               return;
 
+            if (quantisation) {
+              commit_quantised (data, num_points);
+              return;
+            }
+
             int64_t prev_barrier_addr = barrier_addr;
 
             format_point (barrier(), data[num_points]);
@@ -329,6 +568,67 @@ namespace MR
             out.write (reinterpret_cast<const char* const> (data), sizeof(vector_type));
             verify_stream (out);
             update_counts (out);
+            if (index)
+              index->commit (barrier_addr);
+          }
+
+
+          //! encode track point data and write to file as a single block
+          /*! See the description of the quantised track file format above. */
+          void commit_quantised (const vector_type* data, size_t num_points) {
+            // reserve space for the worst case, with every offset escaped:
+            quantised_block.resize (8 + 18*num_points);
+            uint8_t* p = quantised_block.data() + 8;
+            uint32_t num_tracks = 0;
+
+            for (size_t start = 0; start < num_points; ++num_tracks) {
+              size_t end = start;
+              while (end < num_points && !std::isnan (ByteOrder::LE (data[end][0])))
+                ++end;
+
+              int32_t q[3];
+              Raw::store_LE<uint32_t> (end - start, p);
+              for (size_t axis = 0; axis < 3; ++axis) {
+                q[axis] = quantise (ByteOrder::LE (data[start][axis]));
+                Raw::store_LE<int32_t> (q[axis], p + 4 + 4*axis);
+              }
+              p += 16;
+
+              for (size_t n = start+1; n < end; ++n) {
+                for (size_t axis = 0; axis < 3; ++axis) {
+                  const int32_t value = quantise (ByteOrder::LE (data[n][axis]));
+                  const int64_t delta = int64_t (value) - q[axis];
+                  if (delta > quantised_tracks_escape && delta <= std::numeric_limits<int16_t>::max()) {
+                    Raw::store_LE<int16_t> (delta, p);
+                    p += 2;
+                  }
+                  else {
+                    Raw::store_LE<int16_t> (quantised_tracks_escape, p);
+                    Raw::store_LE<int32_t> (value, p+2);
+                    p += 6;
+                  }
+                  q[axis] = value;
+                }
+              }
+              start = end + 1;
+            }
+
+            const size_t block_size = p - quantised_block.data();
+            Raw::store_LE<uint32_t> (block_size - 8, quantised_block.data());
+            Raw::store_LE<uint32_t> (num_tracks, quantised_block.data() + 4);
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
+            out.write (reinterpret_cast<const char*> (quantised_block.data()), block_size);
+            verify_stream (out);
+            quantised_end = out.tellp();
+            update_counts (out);
+          }
+
+          //! convert a coordinate to the quantisation grid
+          int32_t quantise (ValueType value) const {
+            const default_type q = std::round (value / quantisation);
+            if (!(std::abs (q) <= std::numeric_limits<int32_t>::max()))
+              throw Exception ("streamline vertex out of range for quantised tracks file \"" + name + "\"");
+            return q;
           }
 
 
@@ -360,10 +660,14 @@ namespace MR
         public:
           using __WriterBase__<ValueType>::count;
           using __WriterBase__<ValueType>::total_count;
+          using __WriterBase__<ValueType>::name;
+          using __WriterBase__<ValueType>::update_counts;
           using WriterUnbuffered<ValueType>::delimiter;
           using WriterUnbuffered<ValueType>::format_point;
           using WriterUnbuffered<ValueType>::weights_name;
           using WriterUnbuffered<ValueType>::write_weights;
+          using WriterUnbuffered<ValueType>::barrier_addr;
+          using WriterUnbuffered<ValueType>::index;
           using vector_type = typename WriterUnbuffered<ValueType>::vector_type;
 
           //! create new RAM-buffered track file with specified properties
@@ -383,6 +687,14 @@ namespace MR
             buffer (new vector_type [buffer_capacity]),
             buffer_size (0) { }
 
+          //! re-open an existing track file to append further tracks
+          /*! See the corresponding WriterUnbuffered constructor. */
+          Writer (const std::string& file, const int64_t size, const uint64_t num_tracks, const uint64_t total_num_tracks, size_t default_buffer_capacity = 16777216) :
+            WriterUnbuffered<ValueType> (file, size, num_tracks, total_num_tracks),
+            buffer_capacity (File::Config::get_int ("TrackWriterBufferSize", default_buffer_capacity) / sizeof (vector_type)),
+            buffer (new vector_type [buffer_capacity]),
+            buffer_size (0) { }
+
           Writer (const Writer& W) = delete;
 
           //! commits any remaining data to file
@@ -390,18 +702,38 @@ namespace MR
             commit();
           }
 
+          //! commit all data written so far to file, and update the track counts
+          /*! Once this returns, the file is complete and consistent up to
+           * this point, as required for checkpointing. */
+          void flush () {
+            commit();
+            File::OFStream out (name, std::ios::in | std::ios::out | std::ios::binary);
+            update_counts (out);
+          }
+
           //! append track to file
           bool operator() (const Streamline<ValueType>& tck) {
-            if (tck.size()) {
-              if (buffer_size + tck.size() + 2 > buffer_capacity)
+            return (*this) (tck.data(), tck.size(), tck.weight);
+          }
+
+          //! append track held as a contiguous array of \a num_points points to file
+          /*! This allows tracks stored in other containers (e.g. the
+           * Tracking::GeneratedTrack objects recycled between batches in
+           * tckgen) to be written directly into the RAM buffer, without
+           * first having to be copied into a Streamline. */
+          bool operator() (const vector_type* points, size_t num_points, float weight = 1.0f) {
+            if (num_points) {
+              if (buffer_size + num_points + 2 > buffer_capacity)
                 commit ();
 
-              for (const auto& i : tck)
-                add_point (i);
+              if (index)
+                index->add (barrier_addr + buffer_size * sizeof (vector_type));
+              for (size_t n = 0; n < num_points; ++n)
+                add_point (points[n]);
               add_point (delimiter());
 
               if (weights_name.size())
-                weights_buffer += str (tck.weight) + ' ';
+                weights_buffer += str (weight) + ' ';
 
               ++count;
             }
@@ -48,7 +48,11 @@ namespace MR {
 
         if (dtype == DataType::Undefined)
           throw Exception ("no datatype specified for tracks file \"" + file + "\"");
-        if (dtype != DataType::Float32LE && dtype != DataType::Float32BE &&
+        if (type == "quantised tracks") {
+          if (dtype != DataType::Int16LE)
+            throw Exception ("only supported datatype for quantised tracks file is Int16LE (in file \"" + file + "\")");
+        }
+        else if (dtype != DataType::Float32LE && dtype != DataType::Float32BE &&
             dtype != DataType::Float64LE && dtype != DataType::Float64BE)
           throw Exception ("only supported datatype for tracks file are "
               "Float32LE, Float32BE, Float64LE & Float64BE (in " + type  + " file \"" + file + "\")");
@@ -77,6 +81,8 @@ namespace MR {
         if (!in)
           throw Exception ("error opening " + type  + " data file \"" + fname + "\": " + strerror(errno));
         in.seekg (offset);
+        data_path = fname;
+        data_offset = offset;
       }
 
     }
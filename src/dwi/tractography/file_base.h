@@ -51,6 +51,8 @@ namespace MR
 
           std::ifstream  in;
           DataType  dtype;
+          std::string data_path;
+          int64_t data_offset;
       };
 
 
@@ -60,7 +62,7 @@ namespace MR
           public:
             using value_type = ValueType;
 
-            __WriterBase__(const std::string& name) :
+            __WriterBase__(const std::string& name, const bool append = false) :
               count (0),
               total_count (0),
               name (name), 
@@ -73,7 +75,8 @@ namespace MR
                 dtype != DataType::Float64LE && dtype != DataType::Float64BE)
               throw Exception ("only supported datatype for tracks file are "
                   "Float32LE, Float32BE, Float64LE & Float64BE");
-            App::check_overwrite (name);
+            if (!append)
+              App::check_overwrite (name);
           }
 
             ~__WriterBase__()
@@ -135,6 +138,32 @@ namespace MR
                 throw Exception ("error writing file \"" + name + "\": " + strerror (errno));
             }
 
+            //! read the header of an existing file, in order to append data to it
+            /*! This locates the track count in the header, and returns the
+             * remaining key-value pairs. */
+            std::map<std::string,std::string> reopen (const std::string& type) {
+              std::ifstream in (name.c_str(), std::ios::in | std::ios::binary);
+              if (!in)
+                throw Exception ("unable to open file \"" + name + "\" to append data: " + strerror (errno));
+              std::string line;
+              std::getline (in, line);
+              if (strip (line) != "mrtrix " + type)
+                throw Exception ("file \"" + name + "\" is not a valid " + type + " file");
+              std::map<std::string,std::string> header;
+              while (std::getline (in, line) && line != "END") {
+                const size_t colon = line.find (':');
+                if (colon == std::string::npos)
+                  continue;
+                const std::string key = strip (line.substr (0, colon));
+                if (key == "count")
+                  count_offset = int64_t (in.tellg()) - line.size() - 1 + colon + 2;
+                header[key] = strip (line.substr (colon+1));
+              }
+              if (!count_offset)
+                throw Exception ("invalid header in file \"" + name + "\": track count not found");
+              return header;
+            }
+
             void update_counts (File::OFStream& out) {
               out.seekp (count_offset);
               out << count << "\ntotal_count: " << total_count << "\nEND\n";
@@ -0,0 +1,212 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <cstring>
+#include <fstream>
+#include <sys/stat.h>
+
+#include "raw.h"
+#include "file/config.h"
+#include "file/ofstream.h"
+#include "file/path.h"
+#include "file/utils.h"
+#include "dwi/tractography/file_index.h"
+
+#define TRACK_INDEX_MAGIC "mrtrix tck index"
+#define TRACK_INDEX_HEADER_SIZE 32
+#define TRACK_INDEX_SCAN_CHUNK 1048576
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+
+      std::string index_path (const std::string& tck_path)
+      {
+        return tck_path + ".idx";
+      }
+
+
+
+      //CONF option: TrackWriterIndex
+      //CONF default: 0 (false)
+      //CONF If true, an index of the location of each streamline is written
+      //CONF alongside each .tck file (with the additional suffix .idx).
+      //CONF This allows subsequent commands to access streamlines at
+      //CONF random, and to read them using multiple threads, without first
+      //CONF having to scan through the whole file (this is currently used
+      //CONF by tcksift and tcksift2 when mapping streamlines to fixels).
+      bool write_index ()
+      {
+        static const bool value = File::Config::get_bool ("TrackWriterIndex", false);
+        return value;
+      }
+
+
+
+
+      TrackIndex::TrackIndex (const std::string& tck_path, const std::string& data_path, int64_t data_offset, DataType dtype) :
+          data_end (data_offset),
+          point_size (3 * dtype.bytes())
+      {
+        const std::string path = index_path (tck_path);
+        if (Path::exists (path)) {
+          if (load (path, data_path, data_offset))
+            return;
+          WARN ("index file \"" + path + "\" is inconsistent with track file \"" + tck_path + "\" - ignored");
+        }
+        scan (data_path, data_offset, dtype);
+      }
+
+
+
+      namespace {
+        int64_t file_size (const std::string& path)
+        {
+          struct stat sbuf;
+          if (stat (path.c_str(), &sbuf))
+            return -1;
+          return sbuf.st_size;
+        }
+      }
+
+      bool TrackIndex::load (const std::string& path, const std::string& data_path, int64_t data_offset)
+      {
+        std::ifstream in (path, std::ios::in | std::ios::binary);
+        char header[TRACK_INDEX_HEADER_SIZE];
+        in.read (header, TRACK_INDEX_HEADER_SIZE);
+        if (!in.good() || memcmp (header, TRACK_INDEX_MAGIC, 16))
+          return false;
+        const uint64_t count = Raw::fetch_LE<uint64_t> (header + 16);
+        data_end = Raw::fetch_LE<uint64_t> (header + 24);
+
+        // the index must match the size of both files, and the data must
+        // terminate with the barrier where expected:
+        if (file_size (path) != int64_t (TRACK_INDEX_HEADER_SIZE + 8*count)
+            || file_size (data_path) != data_end + int64_t (point_size))
+          return false;
+
+        vector<uint64_t> buffer (count);
+        in.read (reinterpret_cast<char*> (buffer.data()), 8*count);
+        if (!in.good())
+          return false;
+        offsets.resize (count);
+        for (size_t n = 0; n < count; ++n) {
+          offsets[n] = Raw::fetch_LE<uint64_t> (&buffer[n]);
+          if (offsets[n] < (n ? offsets[n-1] + int64_t (point_size) : data_offset) || offsets[n] >= data_end)
+            return false;
+        }
+        if (count && offsets[0] != data_offset)
+          return false;
+
+        DEBUG ("loaded index of " + str(count) + " streamlines from file \"" + path + "\"");
+        return true;
+      }
+
+
+
+      namespace {
+        // the first coordinate is sufficient to identify delimiters and barriers:
+        template <typename ValueType>
+          inline bool is_delimiter (const uint8_t* p, bool little_endian, bool& barrier)
+          {
+            const ValueType x = little_endian ? Raw::fetch_LE<ValueType> (p) : Raw::fetch_BE<ValueType> (p);
+            barrier = std::isinf (x);
+            return barrier || std::isnan (x);
+          }
+      }
+
+      void TrackIndex::scan (const std::string& data_path, int64_t data_offset, DataType dtype)
+      {
+        DEBUG ("scanning track data in file \"" + data_path + "\" to generate index...");
+        offsets.clear();
+        std::ifstream in (data_path, std::ios::in | std::ios::binary);
+        in.seekg (data_offset);
+
+        const bool little_endian = dtype.is_little_endian();
+        const bool is_double = dtype.bytes() == 8;
+        const size_t points_per_chunk = TRACK_INDEX_SCAN_CHUNK / point_size;
+        vector<uint8_t> buffer (points_per_chunk * point_size);
+
+        int64_t offset = data_offset, track_start = data_offset;
+        while (in.good()) {
+          in.read (reinterpret_cast<char*> (buffer.data()), buffer.size());
+          const size_t num_points = in.gcount() / point_size;
+          for (size_t n = 0; n < num_points; ++n, offset += point_size) {
+            bool barrier;
+            const uint8_t* p = buffer.data() + n*point_size;
+            if (is_double ? is_delimiter<double> (p, little_endian, barrier) : is_delimiter<float> (p, little_endian, barrier)) {
+              if (barrier) {
+                data_end = offset;
+                return;
+              }
+              offsets.push_back (track_start);
+              track_start = offset + point_size;
+            }
+          }
+        }
+        // no barrier found - file truncated, e.g. during writing:
+        data_end = track_start - point_size;
+      }
+
+
+
+
+
+
+
+      TrackIndexWriter::TrackIndexWriter (const std::string& tck_path, int64_t data_end) :
+          path (index_path (tck_path)),
+          count (0)
+      {
+        File::OFStream out (path, std::ios::out | std::ios::binary | std::ios::trunc);
+        char header[TRACK_INDEX_HEADER_SIZE];
+        memcpy (header, TRACK_INDEX_MAGIC, 16);
+        Raw::store_LE<uint64_t> (0, header + 16);
+        Raw::store_LE<uint64_t> (data_end, header + 24);
+        out.write (header, TRACK_INDEX_HEADER_SIZE);
+        if (!out.good())
+          throw Exception ("error writing track index file \"" + path + "\": " + strerror (errno));
+      }
+
+
+
+      void TrackIndexWriter::commit (int64_t data_end)
+      {
+        File::OFStream out (path, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
+        for (auto& offset : pending)
+          Raw::store_LE<uint64_t> (offset, &offset);
+        out.write (reinterpret_cast<const char*> (pending.data()), 8*pending.size());
+        count += pending.size();
+        pending.clear();
+
+        char counts[16];
+        Raw::store_LE<uint64_t> (count, counts);
+        Raw::store_LE<uint64_t> (data_end, counts + 8);
+        out.seekp (16);
+        out.write (counts, 16);
+        if (!out.good())
+          throw Exception ("error writing track index file \"" + path + "\": " + strerror (errno));
+      }
+
+
+
+    }
+  }
+}
+
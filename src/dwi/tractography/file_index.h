@@ -0,0 +1,107 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#ifndef __dwi_tractography_file_index_h__
+#define __dwi_tractography_file_index_h__
+
+#include "types.h"
+#include "datatype.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      /*! \file file_index.h
+       * An optional index of the location of each streamline within a .tck
+       * file, allowing random access and concurrent reading of streamlines.
+       *
+       * The index is stored alongside the track file, with the additional
+       * suffix ".idx" (e.g. "tracks.tck.idx"). It consists of a 32-byte
+       * header: the 16 characters "mrtrix tck index", the number of
+       * streamlines, and the file offset of the barrier terminating the
+       * track data (both as 64-bit little-endian unsigned integers); this is
+       * followed by the file offset of the first point of each streamline
+       * (64-bit little-endian unsigned integers). Each streamline ends with
+       * its delimiter, immediately before the start of the next streamline
+       * (or before the barrier for the last streamline). */
+
+
+      //! the path of the index file associated with track file \a tck_path
+      std::string index_path (const std::string& tck_path);
+
+      //! whether track files should be written with an index
+      /*! This is set using the TrackWriterIndex config file option. */
+      bool write_index ();
+
+
+
+      //! the offsets of all streamlines within a track file
+      class TrackIndex
+      { NOMEMALIGN
+        public:
+          //! load the index for the track data in \a data_path
+          /*! The index is loaded from the index file associated with \a
+           * tck_path if it exists and is consistent with the track data;
+           * otherwise, it is generated by scanning through the track data,
+           * starting at byte offset \a data_offset, with the points stored
+           * using datatype \a dtype. */
+          TrackIndex (const std::string& tck_path, const std::string& data_path, int64_t data_offset, DataType dtype);
+
+          size_t size () const { return offsets.size(); }
+          //! the file offset of the first point of streamline \a n
+          int64_t start (size_t n) const { return offsets[n]; }
+          //! the file offset one past the delimiter of streamline \a n
+          int64_t end (size_t n) const { return n+1 < size() ? offsets[n+1] : data_end; }
+
+        protected:
+          vector<int64_t> offsets;
+          int64_t data_end;
+          const size_t point_size;
+
+          bool load (const std::string& path, const std::string& data_path, int64_t data_offset);
+          void scan (const std::string& data_path, int64_t data_offset, DataType dtype);
+      };
+
+
+
+      //! \cond skip
+      // used by the track file writers to write the index as the data are committed:
+      class TrackIndexWriter
+      { NOMEMALIGN
+        public:
+          TrackIndexWriter (const std::string& tck_path, int64_t data_end);
+
+          void add (int64_t offset) { pending.push_back (offset); }
+          void commit (int64_t data_end);
+
+        protected:
+          const std::string path;
+          uint64_t count;
+          vector<uint64_t> pending;
+      };
+      //! \endcond
+
+
+    }
+  }
+}
+
+
+#endif
+
@@ -0,0 +1,200 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#ifndef __dwi_tractography_indexed_reader_h__
+#define __dwi_tractography_indexed_reader_h__
+
+#include <atomic>
+
+#include "app.h"
+#include "raw.h"
+#include "types.h"
+#include "math/math.h"
+#include "dwi/tractography/file.h"
+#include "dwi/tractography/file_base.h"
+#include "dwi/tractography/file_index.h"
+#include "dwi/tractography/properties.h"
+#include "dwi/tractography/streamline.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+
+
+      //! A class to read streamlines data in any order
+      /*! This uses the index of streamline locations within the file (see
+       * file_index.h) to read any individual streamline, or any range of
+       * streamlines, each with a single read() call. If no valid index file
+       * is present, the index is generated by scanning through the file
+       * once on construction.
+       *
+       * Used as a ReaderInterface, this will by default return all
+       * streamlines in order, as for the Reader class; use set_range() or
+       * seek() to restrict this to a subset of the data.
+       *
+       * Copies of this class share the same index (and streamline weights,
+       * if provided using the -tck_weights_in option), but maintain their
+       * own file handle, and so can be used concurrently from different
+       * threads - see the ParallelReader class. */
+      template <class ValueType = float>
+      class IndexedReader : public __ReaderBase__, public ReaderInterface<ValueType>
+      { NOMEMALIGN
+        public:
+
+          //! open the \c file for reading and load header into \c properties
+          IndexedReader (const std::string& file, Properties& properties) {
+            open (file, "tracks", properties);
+            shared.reset (new Shared (file, data_path, data_offset, dtype));
+            auto opt = App::get_options ("tck_weights_in");
+            if (opt.size()) {
+              shared->weights = load_vector<float> (opt[0][0]);
+              if (size_t(shared->weights.size()) < size())
+                throw Exception ("Streamline weights file contains less entries than .tck file");
+              if (size_t(shared->weights.size()) > size())
+                WARN ("Streamline weights file contains more entries than .tck file");
+            }
+            set_range (0, size());
+          }
+
+          IndexedReader (const IndexedReader& that) :
+              shared (that.shared),
+              current (that.current),
+              last (that.last) {
+            dtype = that.dtype;
+            data_path = that.data_path;
+            data_offset = that.data_offset;
+            in.open (data_path.c_str(), std::ios::in | std::ios::binary);
+            if (!in)
+              throw Exception ("error opening tracks data file \"" + data_path + "\": " + strerror(errno));
+          }
+
+
+          //! the total number of streamlines in the file
+          size_t size () const { return shared->index.size(); }
+
+          //! the next call to operator() will return streamline \a track_index
+          void seek (size_t track_index) { current = track_index; }
+
+          //! restrict operator() to streamlines \a first up to (but excluding) \a last
+          void set_range (size_t first, size_t last_plus_one) {
+            current = first;
+            last = std::min (last_plus_one, size());
+          }
+
+          //! fetch next track from file
+          bool operator() (Streamline<ValueType>& tck) {
+            if (current >= last) {
+              tck.clear();
+              return false;
+            }
+            read (current++, tck);
+            return true;
+          }
+
+          //! fetch streamline \a track_index from file
+          void read (size_t track_index, Streamline<ValueType>& tck) {
+            const int64_t start = shared->index.start (track_index);
+            const size_t num_bytes = shared->index.end (track_index) - start;
+            buffer.resize (num_bytes);
+            in.seekg (start);
+            in.read (reinterpret_cast<char*> (buffer.data()), num_bytes);
+            if (!in.good())
+              throw Exception ("error reading tracks data file \"" + data_path + "\": " + strerror(errno));
+
+            // exclude the delimiter:
+            const size_t num_values = 3 * (num_bytes / (3*dtype.bytes()) - 1);
+            tck.resize (num_values / 3);
+            ValueType* dest = tck.size() ? tck[0].data() : nullptr;
+            switch (dtype()) {
+              case DataType::Float32LE: for (size_t n = 0; n < num_values; ++n) dest[n] = Raw::fetch_LE<float> (buffer.data(), n); break;
+              case DataType::Float32BE: for (size_t n = 0; n < num_values; ++n) dest[n] = Raw::fetch_BE<float> (buffer.data(), n); break;
+              case DataType::Float64LE: for (size_t n = 0; n < num_values; ++n) dest[n] = Raw::fetch_LE<double> (buffer.data(), n); break;
+              case DataType::Float64BE: for (size_t n = 0; n < num_values; ++n) dest[n] = Raw::fetch_BE<double> (buffer.data(), n); break;
+              default: assert (0); break;
+            }
+
+            tck.index = track_index;
+            tck.weight = shared->weights.size() ? shared->weights[track_index] : 1.0f;
+          }
+
+
+        protected:
+          class Shared { NOMEMALIGN
+            public:
+              Shared (const std::string& file, const std::string& data_path, int64_t data_offset, DataType dtype) :
+                index (file, data_path, data_offset, dtype) { }
+              const TrackIndex index;
+              Eigen::VectorXf weights;
+          };
+
+          std::shared_ptr<Shared> shared;
+          size_t current, last;
+          vector<uint8_t> buffer;
+      };
+
+
+
+
+      //! read streamlines concurrently from multiple threads
+      /*! This is intended to be used as the source functor for
+       * Thread::run_queue(), wrapped in Thread::multi(), e.g.:
+       * \code
+       * Properties properties;
+       * IndexedReader<> reader (path, properties);
+       * ParallelReader<> source (reader);
+       * Thread::run_queue (Thread::multi (source), Thread::batch (Streamline<>()), Thread::multi (processor), sink);
+       * \endcode
+       * Each copy claims consecutive blocks of \a block_size streamlines from
+       * those remaining in turn, reading each block with its own file
+       * handle. Streamlines will therefore not be delivered in order; their
+       * original position in the file is available as Streamline::index. */
+      template <class ValueType = float>
+      class ParallelReader
+      { NOMEMALIGN
+        public:
+          ParallelReader (const IndexedReader<ValueType>& reader, size_t block_size = 256) :
+              reader (reader),
+              next (new std::atomic<size_t> (0)),
+              block_size (block_size) {
+            this->reader.set_range (0, 0);
+          }
+
+          bool operator() (Streamline<ValueType>& tck) {
+            if (reader (tck))
+              return true;
+            const size_t first = block_size * (*next)++;
+            if (first >= reader.size())
+              return false;
+            reader.set_range (first, first + block_size);
+            return reader (tck);
+          }
+
+        protected:
+          IndexedReader<ValueType> reader;
+          std::shared_ptr<std::atomic<size_t>> next;
+          const size_t block_size;
+      };
+
+
+    }
+  }
+}
+
+
+#endif
+
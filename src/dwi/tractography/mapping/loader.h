@@ -20,6 +20,7 @@
 #include "progressbar.h"
 #include "thread_queue.h"
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/indexed_reader.h"
 #include "dwi/tractography/streamline.h"
 
 
@@ -64,6 +65,51 @@ namespace MR {
         };
 
 
+
+        //! multi-threaded equivalent of TrackLoader
+        /*! For use as a source in Thread::run_queue(), wrapped in
+         * Thread::multi(), where an index of streamline locations is
+         * available (see IndexedReader). Each copy reads its own blocks of
+         * streamlines, so these are not delivered in order. */
+        class ParallelTrackLoader
+        { MEMALIGN(ParallelTrackLoader)
+
+          public:
+            ParallelTrackLoader (const IndexedReader<>& file, const size_t to_load = 0, const std::string& msg = "mapping tracks to image") :
+              reader (file),
+              tracks_to_load (to_load),
+              progress (msg.size() ? new Progress (msg, tracks_to_load) : nullptr) { }
+
+            bool operator() (Streamline<>& out)
+            {
+              if (!reader (out))
+                return false;
+              if (tracks_to_load && out.index >= tracks_to_load) {
+                out.clear();
+                return false;
+              }
+              if (progress) {
+                std::lock_guard<std::mutex> lock (progress->mutex);
+                ++progress->bar;
+              }
+              return true;
+            }
+
+          protected:
+            class Progress { NOMEMALIGN
+              public:
+                Progress (const std::string& msg, const size_t count) : bar (msg, count) { }
+                ProgressBar bar;
+                std::mutex mutex;
+            };
+
+            ParallelReader<> reader;
+            const size_t tracks_to_load;
+            std::shared_ptr<Progress> progress;
+
+        };
+
+
       }
     }
   }
@@ -16,10 +16,12 @@
 #define __dwi_tractography_mapping_writer_h__
 
 #include "memory.h"
+#include "file/config.h"
 #include "file/path.h"
 #include "file/utils.h"
 #include "image.h"
 #include "algo/loop.h"
+#include "algo/threaded_loop.h"
 #include "thread_queue.h"
 
 #include "dwi/tractography/mapping/twi_stats.h"
@@ -28,7 +30,9 @@
 
 
 
+#include <mutex>
 #include <typeinfo>
+#include <unordered_map>
 
 
 namespace MR {
@@ -64,6 +68,10 @@ namespace MR {
             // std::terminate() with no further ado).
             virtual void finalise() { }
 
+            // Provide a buffer into which the streamlines mapped by a single thread can
+            //   be accumulated; all such buffers are then combined during finalise()
+            virtual MapWriterBase& create_partial () { throw Exception ("Partial map accumulation not supported for this writer"); }
+
 
 
             virtual bool operator() (const SetVoxel&)    { return false; }
@@ -89,6 +97,19 @@ namespace MR {
             // It's also hijacked to store per-voxel min/max factors in the case of TOD
             std::unique_ptr<Image<float>> counts;
 
+            // These acquire the TWI factor at any point along the streamline;
+            //   For the standard SetVoxel classes, this is a single value 'factor' for the set as
+            //     stored in SetVoxelExtras
+            //   For the Gaussian SetVoxel classes, there is a factor per mapped element
+            default_type get_factor (const Voxel&    element, const SetVoxel&    set) const { return set.factor; }
+            default_type get_factor (const VoxelDEC& element, const SetVoxelDEC& set) const { return set.factor; }
+            default_type get_factor (const Dixel&    element, const SetDixel&    set) const { return set.factor; }
+            default_type get_factor (const VoxelTOD& element, const SetVoxelTOD& set) const { return set.factor; }
+            default_type get_factor (const Gaussian::Voxel&    element, const Gaussian::SetVoxel&    set) const { return element.get_factor(); }
+            default_type get_factor (const Gaussian::VoxelDEC& element, const Gaussian::SetVoxelDEC& set) const { return element.get_factor(); }
+            default_type get_factor (const Gaussian::Dixel&    element, const Gaussian::SetDixel&    set) const { return element.get_factor(); }
+            default_type get_factor (const Gaussian::VoxelTOD& element, const Gaussian::SetVoxelTOD& set) const { return element.get_factor(); }
+
         };
 
 
@@ -96,6 +117,90 @@ namespace MR {
 
 
 
+        // Accumulates the contributions of all streamlines mapped within a single thread,
+        //   so that the output image is no longer updated by a single writer thread.
+        // The data for each element of the output image (voxel, or dixel) are stored either
+        //   densely, or in a hash table containing only those elements that have been visited;
+        //   the accumulated values are combined with those in the MapWriter buffer using merge().
+        template <typename value_type>
+          class PartialMapWriter : public MapWriterBase
+        { MEMALIGN(PartialMapWriter<value_type>)
+
+          public:
+          PartialMapWriter (const Header& header, const std::string& name, const vox_stat_t voxel_statistic, const writer_dim type, const bool use_counts, const bool dense);
+
+          PartialMapWriter (const PartialMapWriter&) = delete;
+
+          bool operator() (const SetVoxel& in)    { receive_greyscale (in); return true; }
+          bool operator() (const SetVoxelDEC& in) { receive_dec       (in); return true; }
+          bool operator() (const SetDixel& in)    { receive_greyscale (in); return true; }
+          bool operator() (const SetVoxelTOD& in) { receive_tod       (in); return true; }
+
+          bool operator() (const Gaussian::SetVoxel& in)    { receive_greyscale (in); return true; }
+          bool operator() (const Gaussian::SetVoxelDEC& in) { receive_dec       (in); return true; }
+          bool operator() (const Gaussian::SetDixel& in)    { receive_greyscale (in); return true; }
+          bool operator() (const Gaussian::SetVoxelTOD& in) { receive_tod       (in); return true; }
+
+          // Combine the data accumulated for the element at the current position of
+          //   the image into the image (and the counts image, if used)
+          void merge (Image<value_type>& buffer, Image<float>* const counts) const;
+
+          size_t size () const { return dense ? values.size() / num_values : slots.size(); }
+
+          private:
+          // Can't use vector<bool>: data must be addressable
+          using storage_type = typename std::conditional<std::is_same<value_type, bool>::value, uint8_t, value_type>::type;
+
+          const size_t dim[3];
+          const size_t num_dirs, num_values;
+          const bool use_counts, dense;
+          storage_type init_value;
+          vector<storage_type> values;
+          vector<float> aux;
+          std::unordered_map<size_t, size_t> slots;
+
+          size_t element (const Voxel& v) const { return v[0] + dim[0] * (v[1] + dim[1] * v[2]); }
+          size_t element (const Dixel& d) const { return element (static_cast<const Voxel&> (d)) * num_dirs + d.get_dir(); }
+
+          // Get the storage location for an element, allocating it if necessary
+          size_t slot (const size_t index)
+          {
+            if (dense)
+              return index;
+            const auto result = slots.insert (std::make_pair (index, slots.size()));
+            if (result.second) {
+              values.resize (values.size() + num_values, init_value);
+              if (use_counts)
+                aux.push_back (0.0f);
+            }
+            return result.first->second;
+          }
+
+          bool find (const size_t index, size_t& s) const
+          {
+            if (dense) {
+              s = index;
+              return true;
+            }
+            const auto i = slots.find (index);
+            if (i == slots.end())
+              return false;
+            s = i->second;
+            return true;
+          }
+
+          template <class Cont> void receive_greyscale (const Cont&);
+          template <class Cont> void receive_dec       (const Cont&);
+          template <class Cont> void receive_tod       (const Cont&);
+
+          inline void add (storage_type&, const default_type, const default_type);
+
+        };
+
+
+
+
+
         template <typename value_type>
           class MapWriter : public MapWriterBase
         { MEMALIGN(MapWriter<value_type>)
@@ -150,6 +255,9 @@ namespace MR {
 
           void finalise () {
 
+            if (partials.size())
+              reduce();
+
             auto loop = Loop (buffer, 0, 3);
             switch (voxel_statistic) {
 
@@ -244,9 +352,18 @@ namespace MR {
           bool operator() (const Gaussian::SetVoxelTOD& in) { receive_tod       (in); return true; }
 
 
+          MapWriterBase& create_partial ();
+
+
           private:
           Image<value_type> buffer;
 
+          std::mutex partials_mutex;
+          vector<std::unique_ptr<PartialMapWriter<value_type>>> partials;
+
+          // Combine the contents of all partial buffers into the output buffer
+          void reduce ();
+
           // Template functions used so that the functors don't have to be written twice
           //   (once for standard TWI and one for Gaussian track-wise statistic)
           template <class Cont> void receive_greyscale (const Cont&);
@@ -258,19 +375,6 @@ namespace MR {
           //   regarding using multiplication in a boolean context
           inline void add (const default_type, const default_type);
 
-          // These acquire the TWI factor at any point along the streamline;
-          //   For the standard SetVoxel classes, this is a single value 'factor' for the set as
-          //     stored in SetVoxelExtras
-          //   For the Gaussian SetVoxel classes, there is a factor per mapped element
-          default_type get_factor (const Voxel&    element, const SetVoxel&    set) const { return set.factor; }
-          default_type get_factor (const VoxelDEC& element, const SetVoxelDEC& set) const { return set.factor; }
-          default_type get_factor (const Dixel&    element, const SetDixel&    set) const { return set.factor; }
-          default_type get_factor (const VoxelTOD& element, const SetVoxelTOD& set) const { return set.factor; }
-          default_type get_factor (const Gaussian::Voxel&    element, const Gaussian::SetVoxel&    set) const { return element.get_factor(); }
-          default_type get_factor (const Gaussian::VoxelDEC& element, const Gaussian::SetVoxelDEC& set) const { return element.get_factor(); }
-          default_type get_factor (const Gaussian::Dixel&    element, const Gaussian::SetDixel&    set) const { return element.get_factor(); }
-          default_type get_factor (const Gaussian::VoxelTOD& element, const Gaussian::SetVoxelTOD& set) const { return element.get_factor(); }
-
 
           // Convenience functions for Directionally-Encoded Colour processing
           Eigen::Vector3 get_dec ();
@@ -502,6 +606,302 @@ namespace MR {
 
 
 
+        template <typename value_type>
+          MapWriterBase& MapWriter<value_type>::create_partial ()
+          {
+            //CONF option: TckmapPartialDenseLimit
+            //CONF default: 256
+            //CONF The maximal size (in MB) of the buffer allocated by tckmap within
+            //CONF each thread when the -partial_maps option is used; if a dense buffer
+            //CONF for the output image would be larger than this, only those
+            //CONF voxels traversed by streamlines are stored, in a hash table.
+            const size_t num_elements = voxel_count (buffer, 0, (type == DIXEL) ? 4 : 3);
+            const size_t num_values = (type == DEC || type == TOD) ? buffer.size(3) : 1;
+            const bool dense = num_elements * num_values * sizeof (value_type)
+                               <= 1024.0 * 1024.0 * File::Config::get_float ("TckmapPartialDenseLimit", 256.0);
+            std::lock_guard<std::mutex> lock (partials_mutex);
+            if (partials.empty())
+              INFO ("accumulating streamlines within each thread using " + std::string (dense ? "dense" : "hashed") + " buffers");
+            partials.push_back (std::unique_ptr<PartialMapWriter<value_type>> (new PartialMapWriter<value_type> (H, output_image_name, voxel_statistic, type, bool(counts), dense)));
+            return *partials.back();
+          }
+
+
+
+        template <typename value_type>
+          void MapWriter<value_type>::reduce ()
+          {
+            // Each element of the output image is combined with the partial buffers
+            //   independently, so the reduction can be distributed across threads
+            //   (other than for bitwise data, where neighbouring voxels share bytes)
+            const size_t last_axis = (type == DIXEL) ? 4 : 3;
+            if (std::is_same<value_type, bool>::value) {
+              for (auto l = Loop ("combining per-thread maps", buffer, 0, last_axis) (buffer); l; ++l) {
+                if (counts)
+                  assign_pos_of (buffer, 0, last_axis).to (*counts);
+                for (const auto& p : partials)
+                  p->merge (buffer, counts.get());
+              }
+            } else if (counts) {
+              ThreadedLoop ("combining per-thread maps", buffer, 0, last_axis).run ([&] (Image<value_type>& out, Image<float>& count) {
+                  for (const auto& p : partials)
+                    p->merge (out, &count);
+              }, buffer, *counts);
+            } else {
+              ThreadedLoop ("combining per-thread maps", buffer, 0, last_axis).run ([&] (Image<value_type>& out) {
+                  for (const auto& p : partials)
+                    p->merge (out, nullptr);
+              }, buffer);
+            }
+            partials.clear();
+          }
+
+
+
+
+
+
+
+        template <typename value_type>
+          PartialMapWriter<value_type>::PartialMapWriter (const Header& header, const std::string& name, const vox_stat_t voxel_statistic, const writer_dim type, const bool use_counts, const bool dense) :
+              MapWriterBase (header, name, voxel_statistic, type),
+              dim { size_t(header.size(0)), size_t(header.size(1)), size_t(header.size(2)) },
+              num_dirs (type == DIXEL ? header.size(3) : 1),
+              num_values ((type == DEC || type == TOD) ? header.size(3) : 1),
+              use_counts (use_counts),
+              dense (dense),
+              init_value (0)
+          {
+            // Initial values must match those of the MapWriter buffer
+            if (voxel_statistic == V_MIN)
+              init_value = std::numeric_limits<value_type>::max();
+            else if (voxel_statistic == V_MAX && (type == GREYSCALE || type == DIXEL))
+              init_value = std::numeric_limits<value_type>::lowest();
+            if (dense) {
+              const size_t num_elements = dim[0] * dim[1] * dim[2] * num_dirs;
+              values.assign (num_elements * num_values, init_value);
+              if (use_counts)
+                aux.assign (num_elements, 0.0f);
+            }
+          }
+
+
+
+        template <typename value_type>
+          template <class Cont>
+          void PartialMapWriter<value_type>::receive_greyscale (const Cont& in)
+          {
+            assert (type == GREYSCALE || type == DIXEL);
+            for (const auto& i : in) {
+              const size_t s = slot (element (i));
+              const default_type factor = get_factor (i, in);
+              const default_type weight = in.weight * i.get_length();
+              storage_type& value (values[s]);
+              switch (voxel_statistic) {
+                case V_SUM:  add (value, weight, factor); break;
+                case V_MIN:  value = value_type (std::min (default_type (value), factor)); break;
+                case V_MAX:  value = value_type (std::max (default_type (value), factor)); break;
+                case V_MEAN:
+                             add (value, weight, factor);
+                             assert (use_counts);
+                             aux[s] += weight;
+                             break;
+                default:
+                             throw Exception ("Unknown / unhandled voxel statistic in PartialMapWriter::receive_greyscale()");
+              }
+            }
+          }
+
+
+
+        template <typename value_type>
+          template <class Cont>
+          void PartialMapWriter<value_type>::receive_dec (const Cont& in)
+          {
+            assert (type == DEC);
+            for (const auto& i : in) {
+              const size_t s = slot (element (i));
+              const default_type factor = get_factor (i, in);
+              const default_type weight = in.weight * i.get_length();
+              storage_type* const value = &values[3*s];
+              const Eigen::Vector3 current_value (value[0], value[1], value[2]);
+              Eigen::Vector3 scaled_colour (i.get_colour());
+              scaled_colour *= factor;
+              switch (voxel_statistic) {
+                case V_SUM:
+                case V_MEAN:
+                  for (size_t axis = 0; axis != 3; ++axis)
+                    value[axis] = current_value[axis] + scaled_colour[axis] * weight;
+                  if (use_counts)
+                    aux[s] += weight;
+                  break;
+                case V_MIN:
+                  if (scaled_colour.squaredNorm() < current_value.squaredNorm()) {
+                    for (size_t axis = 0; axis != 3; ++axis)
+                      value[axis] = scaled_colour[axis];
+                  }
+                  break;
+                case V_MAX:
+                  if (scaled_colour.squaredNorm() > current_value.squaredNorm()) {
+                    for (size_t axis = 0; axis != 3; ++axis)
+                      value[axis] = scaled_colour[axis];
+                  }
+                  break;
+                default:
+                  throw Exception ("Unknown / unhandled voxel statistic in PartialMapWriter::receive_dec()");
+              }
+            }
+          }
+
+
+
+        template <typename value_type>
+          template <class Cont>
+          void PartialMapWriter<value_type>::receive_tod (const Cont& in)
+          {
+            assert (type == TOD);
+            for (const auto& i : in) {
+              const size_t s = slot (element (i));
+              const default_type factor = get_factor (i, in);
+              const default_type weight = in.weight * i.get_length();
+              storage_type* const value = &values[num_values*s];
+              switch (voxel_statistic) {
+                case V_SUM:
+                case V_MEAN:
+                  for (size_t index = 0; index != num_values; ++index)
+                    value[index] += i.get_tod()[index] * weight * factor;
+                  if (voxel_statistic == V_MEAN)
+                    aux[s] += weight;
+                  break;
+                  // As for MapWriter, the counts are used to store the min/max factors
+                case V_MIN:
+                  if (factor < aux[s]) {
+                    aux[s] = factor;
+                    for (size_t index = 0; index != num_values; ++index)
+                      value[index] = i.get_tod()[index] * factor;
+                  }
+                  break;
+                case V_MAX:
+                  if (factor > aux[s]) {
+                    aux[s] = factor;
+                    for (size_t index = 0; index != num_values; ++index)
+                      value[index] = i.get_tod()[index] * factor;
+                  }
+                  break;
+                default:
+                  throw Exception ("Unknown / unhandled voxel statistic in PartialMapWriter::receive_tod()");
+              }
+            }
+          }
+
+
+
+        template <>
+        inline void PartialMapWriter<bool>::add (storage_type& value, const default_type weight, const default_type factor)
+        {
+          if (weight && factor)
+            value = true;
+        }
+
+        template <typename value_type>
+        inline void PartialMapWriter<value_type>::add (storage_type& value, const default_type weight, const default_type factor)
+        {
+          // Convert before adding, as is done when writing to the MapWriter buffer
+          value += value_type (weight * factor);
+        }
+
+
+
+        template <typename value_type>
+          void PartialMapWriter<value_type>::merge (Image<value_type>& buffer, Image<float>* const counts) const
+          {
+            size_t index = buffer.index(0) + dim[0] * (buffer.index(1) + dim[1] * buffer.index(2));
+            if (type == DIXEL)
+              index = index * num_dirs + buffer.index(3);
+            size_t s;
+            if (!find (index, s))
+              return;
+            const storage_type* const value = &values[num_values*s];
+
+            switch (type) {
+
+              case GREYSCALE:
+              case DIXEL:
+                switch (voxel_statistic) {
+                  case V_SUM:  buffer.value() += value_type (value[0]); break;
+                  case V_MIN:  buffer.value() = std::min (value_type (buffer.value()), value_type (value[0])); break;
+                  case V_MAX:  buffer.value() = std::max (value_type (buffer.value()), value_type (value[0])); break;
+                  case V_MEAN:
+                               buffer.value() += value_type (value[0]);
+                               assert (counts);
+                               counts->value() += aux[s];
+                               break;
+                  default:
+                               throw Exception ("Unknown / unhandled voxel statistic in PartialMapWriter::merge()");
+                }
+                break;
+
+              case DEC:
+                {
+                  Eigen::Vector3 current_value, partial_value (value[0], value[1], value[2]);
+                  for (auto l = Loop (3) (buffer); l; ++l)
+                    current_value[buffer.index(3)] = buffer.value();
+                  switch (voxel_statistic) {
+                    case V_SUM:
+                    case V_MEAN:
+                      partial_value += current_value;
+                      if (counts)
+                        counts->value() += aux[s];
+                      break;
+                    case V_MIN:
+                      if (partial_value.squaredNorm() >= current_value.squaredNorm())
+                        return;
+                      break;
+                    case V_MAX:
+                      if (partial_value.squaredNorm() <= current_value.squaredNorm())
+                        return;
+                      break;
+                    default:
+                      throw Exception ("Unknown / unhandled voxel statistic in PartialMapWriter::merge()");
+                  }
+                  for (auto l = Loop (3) (buffer); l; ++l)
+                    buffer.value() = partial_value[buffer.index(3)];
+                }
+                break;
+
+              case TOD:
+                switch (voxel_statistic) {
+                  case V_SUM:
+                  case V_MEAN:
+                    for (auto l = Loop (3) (buffer); l; ++l)
+                      buffer.value() += value_type (value[buffer.index(3)]);
+                    if (voxel_statistic == V_MEAN)
+                      counts->value() += aux[s];
+                    break;
+                  case V_MIN:
+                  case V_MAX:
+                    assert (counts);
+                    if (voxel_statistic == V_MIN ? (aux[s] < counts->value()) : (aux[s] > counts->value())) {
+                      counts->value() = aux[s];
+                      for (auto l = Loop (3) (buffer); l; ++l)
+                        buffer.value() = value_type (value[buffer.index(3)]);
+                    }
+                    break;
+                  default:
+                    throw Exception ("Unknown / unhandled voxel statistic in PartialMapWriter::merge()");
+                }
+                break;
+
+              default:
+                throw Exception ("Invalid TWI writer image dimensionality");
+
+            }
+          }
+
+
+
+
+
       }
     }
   }
@@ -31,6 +31,22 @@ namespace MR
       extern thread_local Math::RNG* rng;
 #endif 
 
+
+      //! point the thread-local RNG at \a generator for the lifetime of this object
+      /*! Worker threads are drawn from a persistent pool and reused across
+       * jobs, so a value left in \c rng would otherwise outlive the generator
+       * it refers to. The previous value is restored on destruction. */
+      class RNGScope
+      { NOMEMALIGN
+        public:
+          RNGScope (Math::RNG& generator) : previous (rng) { rng = &generator; }
+          ~RNGScope () { rng = previous; }
+          RNGScope (const RNGScope&) = delete;
+          RNGScope& operator= (const RNGScope&) = delete;
+        private:
+          Math::RNG* const previous;
+      };
+
     }
   }
 }
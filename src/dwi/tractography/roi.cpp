@@ -12,6 +12,8 @@
  */
 
 
+#include <map>
+
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/roi.h"
 #include "adapter/subset.h"
@@ -70,6 +72,215 @@ namespace MR {
 
 
 
+      void ROI::bounds (Eigen::Vector3f& lower, Eigen::Vector3f& upper) const
+      {
+        if (!mask) {
+          lower = pos.array() - radius;
+          upper = pos.array() + radius;
+          return;
+        }
+        // voxels extend half a voxel beyond their centres:
+        lower.setConstant (std::numeric_limits<float>::infinity());
+        upper.setConstant (-std::numeric_limits<float>::infinity());
+        for (size_t c = 0; c != 8; ++c) {
+          const Eigen::Vector3f corner (*(mask->voxel2scanner) * Eigen::Vector3f (
+                (c & 1) ? mask->size(0) - 0.5f : -0.5f,
+                (c & 2) ? mask->size(1) - 0.5f : -0.5f,
+                (c & 4) ? mask->size(2) - 0.5f : -0.5f));
+          lower = lower.cwiseMin (corner);
+          upper = upper.cwiseMax (corner);
+        }
+      }
+
+
+
+      ROI::overlap_t ROI::overlap (const Eigen::Vector3f& lower, const Eigen::Vector3f& upper) const
+      {
+        if (!mask) {
+          // allow for rounding errors in contains():
+          const float tolerance = 1.0e-4f * radius2;
+          const Eigen::Vector3f nearest = pos.cwiseMax (lower).cwiseMin (upper);
+          if ((nearest - pos).squaredNorm() > radius2 + tolerance)
+            return OUTSIDE;
+          const Eigen::Vector3f furthest = (pos - lower).cwiseAbs().cwiseMax ((pos - upper).cwiseAbs());
+          return furthest.squaredNorm() < radius2 - tolerance ? INSIDE : BOUNDARY;
+        }
+
+        Eigen::Vector3f vlower (Eigen::Vector3f::Constant (std::numeric_limits<float>::infinity()));
+        Eigen::Vector3f vupper (Eigen::Vector3f::Constant (-std::numeric_limits<float>::infinity()));
+        for (size_t c = 0; c != 8; ++c) {
+          const Eigen::Vector3f v (*(mask->scanner2voxel) * Eigen::Vector3f (
+                (c & 1) ? upper[0] : lower[0],
+                (c & 2) ? upper[1] : lower[1],
+                (c & 4) ? upper[2] : lower[2]));
+          vlower = vlower.cwiseMin (v);
+          vupper = vupper.cwiseMax (v);
+        }
+
+        // range of voxels that any point within the box may be rounded to,
+        // again allowing for rounding errors:
+        ssize_t from[3], to[3];
+        bool out_of_bounds = false;
+        for (size_t axis = 0; axis != 3; ++axis) {
+          from[axis] = std::round (vlower[axis] - 1.0e-3f);
+          to[axis] = std::round (vupper[axis] + 1.0e-3f);
+          if (from[axis] < 0) {
+            from[axis] = 0;
+            out_of_bounds = true;
+          }
+          if (to[axis] >= mask->size (axis)) {
+            to[axis] = mask->size (axis) - 1;
+            out_of_bounds = true;
+          }
+          if (from[axis] > to[axis])
+            return OUTSIDE;
+        }
+
+        Mask temp (*mask);
+        size_t count = 0, total = 0;
+        for (temp.index(2) = from[2]; temp.index(2) <= to[2]; ++temp.index(2))
+          for (temp.index(1) = from[1]; temp.index(1) <= to[1]; ++temp.index(1))
+            for (temp.index(0) = from[0]; temp.index(0) <= to[0]; ++temp.index(0)) {
+              ++total;
+              if (temp.value())
+                ++count;
+            }
+
+        if (!count)
+          return OUTSIDE;
+        return (count == total && !out_of_bounds) ? INSIDE : BOUNDARY;
+      }
+
+
+
+      float ROI::voxel_size () const
+      {
+        if (!mask)
+          return std::numeric_limits<float>::infinity();
+        return std::min ({ mask->spacing(0), mask->spacing(1), mask->spacing(2) });
+      }
+
+
+
+
+
+
+      ROIGrid::ROIGrid (const ROISet& include, const ROISet& exclude, const ROISet& mask, float voxel_size) :
+          include (include),
+          exclude (exclude),
+          mask (mask),
+          origin (0.0f, 0.0f, 0.0f),
+          spacing (1.0f),
+          inv_spacing (1.0f),
+          dim { 0, 0, 0 }
+      {
+        // the entry for points outside of all ROIs:
+        cells.push_back (Cell (include.size()));
+
+        Eigen::Vector3f lower (Eigen::Vector3f::Constant (std::numeric_limits<float>::infinity()));
+        Eigen::Vector3f upper (Eigen::Vector3f::Constant (-std::numeric_limits<float>::infinity()));
+        spacing = voxel_size;
+        for (const ROISet* set : { &include, &exclude, &mask }) {
+          for (size_t n = 0; n != set->size(); ++n) {
+            Eigen::Vector3f roi_lower, roi_upper;
+            (*set)[n].bounds (roi_lower, roi_upper);
+            lower = lower.cwiseMin (roi_lower);
+            upper = upper.cwiseMax (roi_upper);
+            spacing = std::min (spacing, (*set)[n].voxel_size());
+          }
+        }
+        if (!lower.allFinite() || !upper.allFinite())
+          return;
+
+        const Eigen::Vector3f extent (upper - lower);
+        while (std::ceil (extent[0]/spacing) * std::ceil (extent[1]/spacing) * std::ceil (extent[2]/spacing) > ROI_GRID_MAX_CELLS)
+          spacing *= 1.25f;
+        inv_spacing = 1.0f / spacing;
+        origin = lower;
+        for (size_t axis = 0; axis != 3; ++axis)
+          dim[axis] = std::max (size_t (1), size_t (std::ceil (extent[axis] * inv_spacing)));
+        labels.assign (dim[0] * dim[1] * dim[2], 0);
+
+        for (size_t n = 0; n != include.size(); ++n)
+          add (include[n], INCLUDE_ROI, n);
+        for (size_t n = 0; n != exclude.size(); ++n)
+          add (exclude[n], EXCLUDE_ROI, n);
+        for (size_t n = 0; n != mask.size(); ++n)
+          add (mask[n], MASK_ROI, n);
+
+        DEBUG ("ROI lookup grid: " + str(dim[0]) + "x" + str(dim[1]) + "x" + str(dim[2])
+            + " cells of size " + str(spacing) + " mm, with " + str(cells.size()) + " distinct labels");
+      }
+
+
+
+      void ROIGrid::add (const ROI& roi, roi_type type, uint32_t index)
+      {
+        Eigen::Vector3f lower, upper;
+        roi.bounds (lower, upper);
+        size_t from[3], to[3];
+        for (size_t axis = 0; axis != 3; ++axis) {
+          from[axis] = std::max (0.0f, std::floor ((lower[axis] - origin[axis]) * inv_spacing));
+          to[axis] = std::min (dim[axis], size_t (std::max (0.0f, std::ceil ((upper[axis] - origin[axis]) * inv_spacing))));
+        }
+
+        // the same combination of labels yields the same new combination:
+        std::map<std::pair<uint32_t, ROI::overlap_t>, uint32_t> relabel;
+
+        for (size_t z = from[2]; z < to[2]; ++z) {
+          for (size_t y = from[1]; y < to[1]; ++y) {
+            for (size_t x = from[0]; x < to[0]; ++x) {
+              const Eigen::Vector3f cell_lower (origin + spacing * Eigen::Vector3f (float(x), float(y), float(z)));
+              const ROI::overlap_t overlap = roi.overlap (cell_lower, cell_lower.array() + spacing);
+              if (overlap == ROI::OUTSIDE)
+                continue;
+              uint32_t& label (labels[x + dim[0] * (y + dim[1] * z)]);
+              const auto key = std::make_pair (label, overlap);
+              auto existing = relabel.find (key);
+              if (existing != relabel.end()) {
+                label = existing->second;
+                continue;
+              }
+
+              Cell cell (cells[label]);
+              switch (type) {
+                case INCLUDE_ROI:
+                  if (overlap == ROI::INSIDE)
+                    cell.include[index] = true;
+                  else
+                    cell.include_boundary.push_back (index);
+                  break;
+                case EXCLUDE_ROI:
+                  if (overlap == ROI::INSIDE) {
+                    cell.in_exclude = true;
+                    cell.exclude_boundary.clear();
+                  } else if (!cell.in_exclude) {
+                    cell.exclude_boundary.push_back (index);
+                  }
+                  break;
+                case MASK_ROI:
+                  if (overlap == ROI::INSIDE) {
+                    cell.in_mask = true;
+                    cell.mask_boundary.clear();
+                  } else if (!cell.in_mask) {
+                    cell.mask_boundary.push_back (index);
+                  }
+                  break;
+              }
+              if (cells.size() > std::numeric_limits<uint32_t>::max())
+                throw Exception ("too many distinct combinations of ROIs for lookup grid");
+              cells.push_back (cell);
+              relabel[key] = label = cells.size() - 1;
+            }
+          }
+        }
+      }
+
+
+
+
+
+
       Image<bool> Mask::__get_mask (const std::string& name)
       {
         auto data = Image<bool>::open (name);
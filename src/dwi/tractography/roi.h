@@ -16,12 +16,18 @@
 #define __dwi_tractography_roi_h__
 
 #include "app.h"
+#include "bitset.h"
 #include "image.h"
 #include "image.h"
 #include "interp/linear.h"
 #include "math/rng.h"
 
 
+// the maximum number of cells in an ROIGrid; its resolution is reduced as
+// required to satisfy this:
+#define ROI_GRID_MAX_CELLS 8388608
+
+
 namespace MR
 {
   namespace DWI
@@ -101,6 +107,16 @@ namespace MR
 
           }
 
+          //! the bounding box of the ROI in scanner space
+          void bounds (Eigen::Vector3f& lower, Eigen::Vector3f& upper) const;
+
+          enum overlap_t { OUTSIDE, INSIDE, BOUNDARY };
+          //! whether the box from \a lower to \a upper lies entirely inside or outside the ROI
+          overlap_t overlap (const Eigen::Vector3f& lower, const Eigen::Vector3f& upper) const;
+
+          //! the voxel size of the ROI image, or infinity for a sphere
+          float voxel_size () const;
+
           friend inline std::ostream& operator<< (std::ostream& stream, const ROI& roi)
           {
             stream << roi.shape() << " (" << roi.parameters() << ")";
@@ -140,6 +156,11 @@ namespace MR
               if (R[n].contains (p)) retval[n] = true;
           }
 
+          void contains (const Eigen::Vector3f& p, BitSet& retval) const {
+            for (size_t n = 0; n < R.size(); ++n)
+              if (R[n].contains (p)) retval[n] = true;
+          }
+
           friend inline std::ostream& operator<< (std::ostream& stream, const ROISet& R) {
             if (R.R.empty()) return (stream);
             vector<ROI>::const_iterator i = R.R.begin();
@@ -155,6 +176,88 @@ namespace MR
 
 
 
+
+
+      //! a precomputed lookup grid for the include, exclude & mask ROIs
+      /*! This divides the bounding box of all ROIs into a regular grid of
+       * cells, and labels each cell according to which ROIs contain it
+       * entirely, and which ROIs it straddles the boundary of. Membership of
+       * any point can then be determined with a single lookup, with an
+       * explicit test of only those ROIs whose boundary passes through the
+       * relevant cell; results are identical to those of the corresponding
+       * ROISet::contains() calls.
+       *
+       * Since most cells share the same set of labels, each distinct set is
+       * stored only once, and the grid itself holds only an index into these. */
+      class ROIGrid { MEMALIGN(ROIGrid)
+        public:
+          ROIGrid (const ROISet& include, const ROISet& exclude, const ROISet& mask, float voxel_size);
+
+          class Cell { NOMEMALIGN
+            public:
+              Cell (size_t num_include) : include (num_include), in_exclude (false), in_mask (false) { }
+              BitSet include;
+              vector<uint32_t> include_boundary, exclude_boundary, mask_boundary;
+              bool in_exclude, in_mask;
+          };
+
+          //! the cell containing point \a p
+          const Cell& operator() (const Eigen::Vector3f& p) const {
+            const Eigen::Vector3f v ((p - origin) * inv_spacing);
+            if (!(v[0] >= 0.0f && v[1] >= 0.0f && v[2] >= 0.0f))
+              return cells[0];
+            const size_t x (v[0]), y (v[1]), z (v[2]);
+            if (x >= dim[0] || y >= dim[1] || z >= dim[2])
+              return cells[0];
+            return cells[labels[x + dim[0] * (y + dim[1] * z)]];
+          }
+
+          //! whether \a p (within \a cell) lies in any of the mask ROIs
+          bool in_mask (const Cell& cell, const Eigen::Vector3f& p) const {
+            if (cell.in_mask)
+              return true;
+            for (auto n : cell.mask_boundary)
+              if (mask[n].contains (p))
+                return true;
+            return false;
+          }
+
+          //! whether \a p (within \a cell) lies in any of the exclude ROIs
+          bool in_exclude (const Cell& cell, const Eigen::Vector3f& p) const {
+            if (cell.in_exclude)
+              return true;
+            for (auto n : cell.exclude_boundary)
+              if (exclude[n].contains (p))
+                return true;
+            return false;
+          }
+
+          //! flag the include ROIs containing \a p (within \a cell) in \a visited
+          void include_visited (const Cell& cell, const Eigen::Vector3f& p, BitSet& visited) const {
+            visited |= cell.include;
+            for (auto n : cell.include_boundary)
+              if (!visited[n] && include[n].contains (p))
+                visited[n] = true;
+          }
+
+          bool in_mask (const Eigen::Vector3f& p) const { return in_mask ((*this) (p), p); }
+          bool in_exclude (const Eigen::Vector3f& p) const { return in_exclude ((*this) (p), p); }
+          void include_visited (const Eigen::Vector3f& p, BitSet& visited) const { include_visited ((*this) (p), p, visited); }
+
+        private:
+          const ROISet include, exclude, mask;
+          Eigen::Vector3f origin;
+          float spacing, inv_spacing;
+          size_t dim[3];
+          vector<uint32_t> labels;
+          vector<Cell> cells;
+
+          enum roi_type { INCLUDE_ROI, EXCLUDE_ROI, MASK_ROI };
+          void add (const ROI& roi, roi_type type, uint32_t index);
+      };
+
+
+
     }
   }
 }
@@ -365,7 +365,7 @@ namespace MR
 
         bool WriteKernelDynamic::operator() (const Tracking::GeneratedTrack& in, Tractography::Streamline<>& out)
         {
-          out.index = writer.count;
+          out.index = writer->count;
           out.weight = 1.0;
           if (!WriteKernel::operator() (in)) {
             out.clear();
@@ -374,7 +374,11 @@ namespace MR
             // Actually need to pass this down the queue so that the seeder thread receives it and knows to terminate
             return true;
           }
-          out = in;
+          // assign rather than copy-construct, to re-use the capacity of out;
+          // index & weight must be reset as they would be by a plain copy:
+          out.assign (in.begin(), in.end());
+          out.index = -1;
+          out.weight = 1.0;
           return out.size(); // New pipe functor interpretation: Don't bother sending empty tracks
         }
 
@@ -102,7 +102,7 @@ namespace MR
         + Argument ("dir").type_sequence_float()
 
       + Option ("output_seeds", "output the seed location of all successful streamlines to a file")
-        + Argument ("path").type_file_out();
+        + Argument ("path").type_file_out().append_on_resume();
 
 
 
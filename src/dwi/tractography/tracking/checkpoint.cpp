@@ -0,0 +1,100 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+
+#include <cstdio>
+
+#include "file/key_value.h"
+#include "file/ofstream.h"
+#include "dwi/tractography/tracking/checkpoint.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        void Checkpoint::load (const std::string& path)
+        {
+          File::KeyValue kv (path, TCKGEN_CHECKPOINT_FIRST_LINE);
+          size_t num_entries = 0;
+          while (kv.next()) {
+            const std::string& key (kv.key());
+            if (key == "shard") {
+              shard = kv.value();
+              continue;
+            }
+            const size_t value = to<size_t> (kv.value());
+            ++num_entries;
+            if      (key == "next_seed")     next_seed = value;
+            else if (key == "max_num_seeds") max_num_seeds = value;
+            else if (key == "seeds")         seeds = value;
+            else if (key == "streamlines")   streamlines = value;
+            else if (key == "selected")      selected = value;
+            else if (key == "tracks_size")   tracks_size = value;
+            else if (key == "seeds_size")    seeds_size = value;
+            else {
+              --num_entries;
+              for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+                if (key == std::string ("termination_") + termination_name (term_t (i)))
+                  terminations[i] = value;
+              for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+                if (key == std::string ("rejection_") + rejection_name (reject_t (i)))
+                  rejections[i] = value;
+            }
+          }
+          if (num_entries != 7)
+            throw Exception ("incomplete tracking checkpoint file \"" + path + "\"");
+        }
+
+
+
+        void Checkpoint::save (const std::string& path) const
+        {
+          const std::string temp_path = path + ".tmp";
+          {
+            File::OFStream out (temp_path);
+            out << TCKGEN_CHECKPOINT_FIRST_LINE << "\n";
+            out << "shard: " << shard << "\n";
+            out << "next_seed: " << next_seed << "\n";
+            out << "max_num_seeds: " << max_num_seeds << "\n";
+            out << "seeds: " << seeds << "\n";
+            out << "streamlines: " << streamlines << "\n";
+            out << "selected: " << selected << "\n";
+            out << "tracks_size: " << tracks_size << "\n";
+            out << "seeds_size: " << seeds_size << "\n";
+            for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+              out << "termination_" << termination_name (term_t (i)) << ": " << terminations[i] << "\n";
+            for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+              out << "rejection_" << rejection_name (reject_t (i)) << ": " << rejections[i] << "\n";
+            out << "END\n";
+            if (!out.good())
+              throw Exception ("error writing tracking checkpoint file \"" + temp_path + "\": " + strerror (errno));
+          }
+          if (std::rename (temp_path.c_str(), path.c_str()))
+            throw Exception ("error replacing tracking checkpoint file \"" + path + "\": " + strerror (errno));
+        }
+
+
+
+      }
+    }
+  }
+}
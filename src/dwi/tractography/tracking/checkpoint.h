@@ -0,0 +1,87 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+
+#ifndef __dwi_tractography_tracking_checkpoint_h__
+#define __dwi_tractography_tracking_checkpoint_h__
+
+#include <string>
+
+#include "types.h"
+#include "dwi/tractography/tracking/types.h"
+
+
+#define TCKGEN_CHECKPOINT_FIRST_LINE "mrtrix tracking checkpoint"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        //! the state of tckgen at a point where the streamlines from all seeds
+        //! up to (but not including) next_seed have been written to file
+        /*! As each seed uses its own random number sequence (see
+         * SharedBase::seed_rng()), this is sufficient to continue generating
+         * exactly the same streamlines as would have been produced had
+         * tckgen not been interrupted. The termination and rejection counts
+         * are those at the time of the checkpoint, and may include streamlines
+         * that had been generated but not yet written. */
+        class Checkpoint
+        { MEMALIGN(Checkpoint)
+          public:
+            Checkpoint () :
+                next_seed (0),
+                max_num_seeds (0),
+                seeds (0),
+                streamlines (0),
+                selected (0),
+                tracks_size (0),
+                seeds_size (0)
+            {
+              for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+                terminations[i] = 0;
+              for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+                rejections[i] = 0;
+            }
+
+            void load (const std::string& path);
+
+            //! write to a temporary file, then replace \a path with it, so
+            //! that a valid checkpoint remains if interrupted while saving
+            void save (const std::string& path) const;
+
+            std::string shard;
+            size_t next_seed, max_num_seeds;
+            size_t seeds, streamlines, selected;
+            int64_t tracks_size, seeds_size;
+            size_t terminations[TERMINATION_REASON_COUNT];
+            size_t rejections[REJECTION_REASON_COUNT];
+        };
+
+
+
+      }
+    }
+  }
+}
+
+#endif
+
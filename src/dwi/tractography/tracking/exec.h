@@ -17,6 +17,7 @@
 
 
 #include "thread_queue.h"
+#include "file/config.h"
 #include "dwi/directions/set.h"
 #include "dwi/tractography/streamline.h"
 #include "dwi/tractography/rng.h"
@@ -48,6 +49,9 @@ namespace MR
       {
 
 
+        template <class Method> class ExecPacket;
+
+
         // TODO Try having ACT as a template boolean; allow compiler to optimise out branch statements
 
         template <class Method> class Exec { MEMALIGN(Exec<Method>)
@@ -61,8 +65,17 @@ namespace MR
 
                 typename Method::Shared shared (diff_path, properties);
                 WriteKernel writer (shared, destination, properties);
-                Exec<Method> tracker (shared);
-                Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
+                if (use_packets (shared)) {
+                  ExecPacket<Method> tracker (shared);
+                  Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE), writer);
+                } else {
+                  Exec<Method> tracker (shared);
+                  // in shard mode, threads may have to wait for earlier seeds to
+                  //   be written before claiming more (see next_shard_seed()), so
+                  //   must not hold back completed streamlines in a batch:
+                  Thread::run_queue (Thread::multi (tracker), Thread::batch (GeneratedTrack(), shared.sharded ? 1 : TRACKING_BATCH_SIZE), writer);
+                }
+                write_statistics (shared);
 
               } else {
 
@@ -72,7 +85,6 @@ namespace MR
                   throw Exception ("Dynamic seeding requires setting the desired number of tracks using the -select option");
                 const size_t num_tracks = to<size_t>(max_num_tracks);
 
-                using SetDixel = Mapping::SetDixel;
                 using TckMapper = Mapping::TrackMapperBase;
                 using Writer = Seeding::WriteKernelDynamic;
 
@@ -85,20 +97,19 @@ namespace MR
                 typename Method::Shared shared (diff_path, properties);
 
                 Writer       writer  (shared, destination, properties);
-                Exec<Method> tracker (shared);
 
                 TckMapper mapper (fod_data, dirs);
                 mapper.set_upsample_ratio (Mapping::determine_upsample_ratio (fod_data, properties, 0.25));
                 mapper.set_use_precise_mapping (true);
 
-                Thread::run_queue (
-                    Thread::multi (tracker), 
-                    Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE),
-                    writer, 
-                    Thread::batch (Streamline<>(), TRACKING_BATCH_SIZE),
-                    Thread::multi (mapper), 
-                    Thread::batch (SetDixel(), TRACKING_BATCH_SIZE),
-                    *seeder);
+                if (use_packets (shared)) {
+                  ExecPacket<Method> tracker (shared);
+                  run_dynamic (tracker, writer, mapper, *seeder);
+                } else {
+                  Exec<Method> tracker (shared);
+                  run_dynamic (tracker, writer, mapper, *seeder);
+                }
+                write_statistics (shared);
 
               }
 
@@ -110,11 +121,31 @@ namespace MR
               S (shared),
               method (shared),
               track_excluded (false),
-              track_included (S.properties.include.size(), false) { }
+              unidirectional (false),
+              track_included (S.properties.include.size()) { }
 
 
             bool operator() (GeneratedTrack& item) {
-              rng = &thread_local_RNG;
+              RNGScope rng_scope (thread_local_RNG);
+              if (!S.sharded)
+                return track (item);
+              // make sure no other thread is left waiting for a seed:
+              try {
+                if (track (item))
+                  return true;
+              }
+              catch (...) {
+                S.stop_seeding();
+                throw;
+              }
+              S.stop_seeding();
+              return false;
+            }
+
+
+          private:
+
+            bool track (GeneratedTrack& item) {
               if (!seed_track (item))
                 return false;
               if (track_excluded) {
@@ -123,30 +154,71 @@ namespace MR
                 return true;
               }
               gen_track (item);
-              if (track_rejected (item)) {
-                item.clear();
-                item.set_status (GeneratedTrack::status_t::TRACK_REJECTED);
-              } else {
-                S.downsampler (item);
-                item.set_status (GeneratedTrack::status_t::ACCEPTED);
-              }
+              finalise_track (item);
               return true;
             }
 
-
-          private:
-
             const typename Method::Shared& S;
             Math::RNG thread_local_RNG;
             Method method;
-            bool track_excluded;
-            vector<bool> track_included;
+            bool track_excluded, unidirectional;
+            BitSet track_included;
+            Eigen::Vector3f seed_dir;
+
+            friend class ExecPacket<Method>;
+
+
+            //CONF option: TckgenPacketTracking
+            //CONF default: 0 (false)
+            //CONF If true, tckgen advances a packet of streamlines together
+            //CONF within each thread, so that the calculations for each step
+            //CONF can be vectorised across streamlines. This is currently
+            //CONF only supported for the SD_STREAM algorithm, and not in
+            //CONF conjunction with the -rk4 or -shard options. Streamlines are
+            //CONF generated from the same seeds, but may differ from those
+            //CONF generated otherwise to within floating-point precision, and
+            //CONF are written to the output file in a different order.
+            static bool use_packets (const typename Method::Shared& shared)
+            {
+              if (!PacketStep<Method>::vectorised || shared.rk4 || shared.sharded || (shared.is_act() && shared.act().backtrack()))
+                return false;
+              return File::Config::get_bool ("TckgenPacketTracking", false);
+            }
+
+
+            static void write_statistics (const typename Method::Shared& shared)
+            {
+              const auto p = shared.properties.find ("stats_output");
+              if (p != shared.properties.end())
+                shared.write_statistics (p->second);
+            }
+
+
+            template <class Tracker, class Writer, class Mapper, class Seeder>
+            static void run_dynamic (Tracker& tracker, Writer& writer, Mapper& mapper, Seeder& seeder)
+            {
+              Thread::run_queue (
+                  Thread::multi (tracker), 
+                  Thread::batch (GeneratedTrack(), TRACKING_BATCH_SIZE),
+                  writer, 
+                  Thread::batch (Streamline<>(), TRACKING_BATCH_SIZE),
+                  Thread::multi (mapper), 
+                  Thread::batch (Mapping::SetDixel(), TRACKING_BATCH_SIZE),
+                  seeder);
+            }
 
 
             term_t iterate ()
             {
+              return check_step (S.rk4 ? next_rk4() : method.next());
+            }
 
-              const term_t method_term = (S.rk4 ? next_rk4() : method.next());
+
+
+            // apply the termination criteria that are common to all
+            // algorithms, given the outcome of the algorithm's own step:
+            term_t check_step (const term_t method_term)
+            {
 
               if (method_term)
                 return (S.is_act() && method.act().sgm_depth) ? TERM_IN_SGM : method_term;
@@ -157,16 +229,19 @@ namespace MR
                   return structural_term;
               }
 
-              if (S.properties.mask.size() && !S.properties.mask.contains (method.pos))
+              // a single lookup for all ROIs:
+              const ROIGrid::Cell& rois (S.rois (method.pos));
+
+              if (S.properties.mask.size() && !S.rois.in_mask (rois, method.pos))
                 return EXIT_MASK;
 
-              if (S.properties.exclude.contains (method.pos))
+              if (S.rois.in_exclude (rois, method.pos))
                 return ENTER_EXCLUDE;
 
               // If backtracking is not enabled, add streamline to include regions as it is generated
               // If it is enabled, this check can only be performed after the streamline is completed
               if (!(S.is_act() && S.act().backtrack()))
-                S.properties.include.contains (method.pos, track_included);
+                S.rois.include_visited (rois, method.pos, track_included);
 
               if (S.stop_on_all_include && traversed_all_include_regions())
                 return TRAVERSE_ALL_INCLUDE;
@@ -181,12 +256,12 @@ namespace MR
             {
               tck.clear();
               track_excluded = false;
-              track_included.assign (track_included.size(), false);
+              track_included.clear();
               method.dir = { NaN, NaN, NaN };
 
               if (S.properties.seeds.is_finite()) {
 
-                if (!S.properties.seeds.get_seed (method.pos, method.dir))
+                if (S.sharded ? !next_shard_seed (tck) : !S.properties.seeds.get_seed (method.pos, method.dir))
                   return false;
                 if (!method.check_seed() || !method.init()) {
                   track_excluded = true;
@@ -196,6 +271,8 @@ namespace MR
 
               } else {
 
+                if (S.sharded && !next_shard_seed (tck))
+                  return false;
                 for (size_t num_attempts = 0; num_attempts != MAX_NUM_SEED_ATTEMPTS; ++num_attempts) {
                   if (S.properties.seeds.get_seed (method.pos, method.dir)) {
                     if (!(method.check_seed() && method.init())) {
@@ -213,24 +290,27 @@ namespace MR
 
 
 
-            bool gen_track (GeneratedTrack& tck)
+            // in shard mode, the RNG is re-seeded from the seed number, so that
+            //   the streamline generated is independent of the thread or process:
+            bool next_shard_seed (GeneratedTrack& tck)
             {
-              bool unidirectional = S.unidirectional;
-              if (S.is_act() && !unidirectional)
-                unidirectional = method.act().seed_is_unidirectional (method.pos, method.dir);
+              size_t index;
+              bool seeded = true;
+              if (!S.next_shard_seed (thread_local_RNG, index, [&] () { seeded = S.properties.seeds.get_seed (method.pos, method.dir); }))
+                return false;
+              tck.set_seed_number (index);
+              return seeded;
+            }
 
-              S.properties.include.contains (method.pos, track_included);
 
-              const Eigen::Vector3f seed_dir (method.dir);
-              tck.push_back (method.pos);
 
+            bool gen_track (GeneratedTrack& tck)
+            {
+              start_track (tck);
               gen_track_unidir (tck);
 
               if (!track_excluded && !unidirectional) {
-                tck.reverse();
-                method.pos = tck.back();
-                method.dir = -seed_dir;
-                method.reverse_track ();
+                reverse_track (tck);
                 gen_track_unidir (tck);
               }
 
@@ -239,6 +319,43 @@ namespace MR
 
 
 
+            void start_track (GeneratedTrack& tck)
+            {
+              unidirectional = S.unidirectional;
+              if (S.is_act() && !unidirectional)
+                unidirectional = method.act().seed_is_unidirectional (method.pos, method.dir);
+
+              S.rois.include_visited (method.pos, track_included);
+
+              seed_dir = method.dir;
+              tck.push_back (method.pos);
+            }
+
+
+
+            void reverse_track (GeneratedTrack& tck)
+            {
+              tck.reverse();
+              method.pos = tck.back();
+              method.dir = -seed_dir;
+              method.reverse_track ();
+            }
+
+
+
+            void finalise_track (GeneratedTrack& tck)
+            {
+              if (track_rejected (tck)) {
+                tck.clear();
+                tck.set_status (GeneratedTrack::status_t::TRACK_REJECTED);
+              } else {
+                S.downsampler (tck);
+                tck.set_status (GeneratedTrack::status_t::ACCEPTED);
+              }
+            }
+
+
+
 
             void gen_track_unidir (GeneratedTrack& tck)
             {
@@ -282,15 +399,32 @@ namespace MR
               } else {
 
                 do {
-                  termination = iterate();
-                  if (term_add_to_tck[termination])
-                    tck.push_back (method.pos);
-                  if (!termination && tck.size() >= S.max_num_points)
-                    termination = LENGTH_EXCEED;
+                  termination = step (tck, S.rk4 ? next_rk4() : method.next());
                 } while (!termination);
 
               }
 
+              end_unidir (tck, termination);
+
+            }
+
+
+
+            term_t step (GeneratedTrack& tck, const term_t method_term)
+            {
+              term_t termination = check_step (method_term);
+              if (term_add_to_tck[termination])
+                tck.push_back (method.pos);
+              if (!termination && tck.size() >= S.max_num_points)
+                termination = LENGTH_EXCEED;
+              return termination;
+            }
+
+
+
+            void end_unidir (GeneratedTrack& tck, term_t termination)
+            {
+
               apply_priors (termination);
 
               if (termination == EXIT_SGM) {
@@ -404,7 +538,7 @@ namespace MR
 
                 if (S.act().backtrack()) {
                   for (const auto& i : tck) 
-                    S.properties.include.contains (i, track_included);
+                    S.rois.include_visited (i, track_included);
                 }
 
               }
@@ -422,10 +556,7 @@ namespace MR
 
             bool traversed_all_include_regions ()
             {
-              for (size_t n = 0; n < track_included.size(); ++n)
-                if (!track_included[n])
-                  return false;
-              return true;
+              return track_included.full();
             }
 
 
@@ -526,6 +657,138 @@ namespace MR
 
 
 
+        //! generate a packet of streamlines together within each thread
+        /*! This maintains TRACKING_PACKET_SIZE streamlines in flight, each
+         * handled by its own instance of Exec, and advances all of them by one
+         * step at a time using PacketStep<Method>, so that the calculations
+         * for each step can be vectorised across streamlines. As each
+         * streamline terminates, its lane is refilled with a new streamline
+         * from the seeder, so that the packet remains full until the seeds
+         * have been exhausted. Completed streamlines are then returned one at
+         * a time, in the order in which they terminate. */
+        template <class Method> class ExecPacket { MEMALIGN(ExecPacket<Method>)
+
+          public:
+
+            ExecPacket (const typename Method::Shared& shared) :
+              S (shared),
+              lanes (TRACKING_PACKET_SIZE, Exec<Method> (shared)),
+              tracks (TRACKING_PACKET_SIZE),
+              state (TRACKING_PACKET_SIZE, IDLE),
+              packet_step (shared),
+              seeds_exhausted (false) { }
+
+            ExecPacket (const ExecPacket& that) :
+              S (that.S),
+              lanes (that.lanes),
+              tracks (TRACKING_PACKET_SIZE),
+              state (TRACKING_PACKET_SIZE, IDLE),
+              packet_step (that.S),
+              seeds_exhausted (false) { }
+
+
+            bool operator() (GeneratedTrack& item) {
+              RNGScope rng_scope (thread_local_RNG);
+              while (completed.empty()) {
+                for (size_t n = 0; n != lanes.size() && !seeds_exhausted; ++n) {
+                  if (state[n] == IDLE)
+                    start (n);
+                }
+                if (!completed.empty())
+                  break;
+                if (!step())
+                  return false;
+              }
+              const size_t n = completed.back();
+              completed.pop_back();
+              std::swap (item, tracks[n]);
+              state[n] = IDLE;
+              return true;
+            }
+
+
+          private:
+
+            enum state_t { IDLE, FORWARD, REVERSE, COMPLETED };
+
+            const typename Method::Shared& S;
+            Math::RNG thread_local_RNG;
+            vector<Exec<Method>> lanes;
+            vector<GeneratedTrack> tracks;
+            vector<state_t> state;
+            vector<size_t> completed;
+            PacketStep<Method> packet_step;
+            bool seeds_exhausted;
+
+
+            void start (const size_t n)
+            {
+              Exec<Method>& lane (lanes[n]);
+              if (!lane.seed_track (tracks[n])) {
+                seeds_exhausted = true;
+                return;
+              }
+              if (lane.track_excluded) {
+                tracks[n].set_status (GeneratedTrack::status_t::SEED_REJECTED);
+                S.add_rejection (INVALID_SEED);
+                complete (n);
+                return;
+              }
+              lane.start_track (tracks[n]);
+              state[n] = FORWARD;
+            }
+
+
+            // advance all active lanes by one step; returns false if none are active:
+            bool step ()
+            {
+              Method* methods[TRACKING_PACKET_SIZE];
+              size_t lane_index[TRACKING_PACKET_SIZE];
+              term_t terms[TRACKING_PACKET_SIZE];
+              size_t num = 0;
+              for (size_t n = 0; n != lanes.size(); ++n) {
+                if (state[n] == FORWARD || state[n] == REVERSE) {
+                  methods[num] = &lanes[n].method;
+                  lane_index[num++] = n;
+                }
+              }
+              if (!num)
+                return false;
+
+              packet_step (methods, num, terms);
+
+              for (size_t i = 0; i != num; ++i) {
+                const size_t n = lane_index[i];
+                Exec<Method>& lane (lanes[n]);
+                const term_t termination = lane.step (tracks[n], terms[i]);
+                if (!termination)
+                  continue;
+                lane.end_unidir (tracks[n], termination);
+                if (state[n] == FORWARD && !lane.track_excluded && !lane.unidirectional) {
+                  lane.reverse_track (tracks[n]);
+                  state[n] = REVERSE;
+                } else {
+                  lane.finalise_track (tracks[n]);
+                  complete (n);
+                }
+              }
+              return true;
+            }
+
+
+            void complete (const size_t n)
+            {
+              state[n] = COMPLETED;
+              completed.push_back (n);
+            }
+
+        };
+
+
+
+
+
+
 
 
 
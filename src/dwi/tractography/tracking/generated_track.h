@@ -42,16 +42,21 @@ namespace MR
 
             enum class status_t { INVALID, SEED_REJECTED, TRACK_REJECTED, ACCEPTED };
 
-            GeneratedTrack() : seed_index (0), status (status_t::INVALID) { }
+            GeneratedTrack() : seed_index (0), seed_number (0), status (status_t::INVALID) { }
             void clear() { BaseType::clear(); seed_index = 0; status = status_t::INVALID; }
             size_t get_seed_index() const { return seed_index; }
+            size_t get_seed_number() const { return seed_number; }
             status_t get_status() const { return status; }
             void reverse() { std::reverse (begin(), end()); seed_index = size()-1; }
             void set_seed_index (const size_t i) { seed_index = i; }
+            void set_seed_number (const size_t i) { seed_number = i; }
             void set_status (const status_t i) { status = i; }
 
           private:
-            size_t seed_index;
+            // seed_index: the index of the seed point within the streamline
+            // seed_number: the position of the seed in the overall sequence of
+            //   seeds (only used in shard mode)
+            size_t seed_index, seed_number;
             status_t status;
 
         };
@@ -21,6 +21,8 @@
 #include "dwi/tractography/ACT/method.h"
 
 
+#define TRACKING_PACKET_SIZE 8
+
 
 namespace MR
 {
@@ -59,8 +61,9 @@ namespace MR
               if (!pos.allFinite())
                 return false;
 
-              if ((S.properties.mask.size() && !S.properties.mask.contains (pos))
-                  || (S.properties.exclude.contains (pos))
+              const ROIGrid::Cell& rois (S.rois (pos));
+              if ((S.properties.mask.size() && !S.rois.in_mask (rois, pos))
+                  || (S.rois.in_exclude (rois, pos))
                   || (S.is_act() && !act().check_seed (pos))) {
                 pos = { NaN, NaN, NaN };
                 return false;
@@ -80,6 +83,21 @@ namespace MR
                 return !std::isnan (values[0]);
               }
 
+            // FOD / signal images are opened with volume-contiguous strides
+            // and direct IO, so that all volumes of each neighbouring voxel
+            // can be interpolated together:
+            inline bool get_data (Interpolator<Image<float>>::type& source, const Eigen::Vector3f& position)
+            {
+              if (!source.scanner (position))
+                return false;
+              if (source.row_is_contiguous())
+                source.contiguous_row (values);
+              else
+                for (auto l = Loop (3) (source); l; ++l)
+                  values[source.index(3)] = source.value();
+              return !std::isnan (values[0]);
+            }
+
             template <class InterpolatorType>
               inline bool get_data (InterpolatorType& source) {
                 return get_data (source, pos);
@@ -192,6 +210,31 @@ namespace MR
         }
 
 
+
+
+        //! advance a packet of streamlines by one step each
+        /*! This is used by ExecPacket to call the next() function of each
+         * of the \a num_lanes tracking methods in the packet, storing the
+         * result for each in \a terms. Algorithms for which the work of each
+         * step can be vectorised across streamlines can specialise this
+         * class to do so, setting \c vectorised to true to make use of this
+         * execution mode (see the TckgenPacketTracking config file option). */
+        template <class Method>
+        class PacketStep
+        { MEMALIGN(PacketStep<Method>)
+          public:
+            static constexpr bool vectorised = false;
+
+            PacketStep (const typename Method::Shared&) { }
+
+            void operator() (Method* const* lanes, size_t num_lanes, term_t* terms)
+            {
+              for (size_t n = 0; n != num_lanes; ++n)
+                terms[n] = lanes[n]->next();
+            }
+        };
+
+
       }
     }
   }
@@ -16,15 +16,20 @@
 #define __dwi_tractography_tracking_shared_h__
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 
 #include "header.h"
 #include "image.h"
 #include "memory.h"
+#include "file/ofstream.h"
+#include "math/rng.h"
 #include "transform.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/roi.h"
 #include "dwi/tractography/ACT/shared.h"
 #include "dwi/tractography/resampling/downsampler.h"
+#include "dwi/tractography/tracking/checkpoint.h"
 #include "dwi/tractography/tracking/types.h"
 #include "dwi/tractography/tracking/tractography.h"
 
@@ -55,6 +60,8 @@ namespace MR
 
               source (Image<float>::open (diff_path).with_direct_io (3)),
               properties (property_set),
+              rois (properties.include, properties.exclude, properties.mask,
+                  std::min ({ source.spacing(0), source.spacing(1), source.spacing(2) })),
               init_dir ({ NaN, NaN, NaN }),
               min_num_points (0),
               max_num_points (0),
@@ -68,7 +75,15 @@ namespace MR
               rk4 (false),
               stop_on_all_include (false),
               implicit_max_num_seeds (properties.find ("max_num_seeds") == properties.end()),
-              downsampler ()
+              sharded (false),
+              shard ("0/1"),
+              first_seed (0),
+              last_seed (0),
+              rng_base (0),
+              downsampler (),
+              next_seed (0),
+              seeds_written (0),
+              seeding_stopped (false)
 #ifdef DEBUG_TERMINATIONS
             , debug_header (Header::open (properties.find ("act") == properties.end() ? diff_path : properties["act"])),
               transform (debug_header)
@@ -92,6 +107,22 @@ namespace MR
                 max_num_seeds = TCKGEN_DEFAULT_SEED_TO_SELECT_RATIO * max_num_tracks;
                 properties.set (max_num_seeds, "max_num_seeds");
 
+                for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+                  terminations[i] = 0;
+                for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+                  rejections[i] = 0;
+
+                // checkpointing relies on the seed numbering of shard mode:
+                if (properties.find ("shard") != properties.end())
+                  set_shard (properties["shard"]);
+                else if (properties.find ("checkpoint") != properties.end())
+                  set_shard ("0/1");
+
+                if (properties.find ("resume") != properties.end()) {
+                  properties.erase ("resume");
+                  resume (properties["checkpoint"]);
+                }
+
                 assert (properties.seeds.num_seeds());
                 max_seed_attempts = properties.seeds[0]->get_max_attempts();
                 properties.set (max_seed_attempts, "max_seed_attempts");
@@ -114,31 +145,11 @@ namespace MR
                 if (properties.find ("downsample_factor") != properties.end())
                   downsampler.set_ratio (to<int> (properties["downsample_factor"]));
 
-                for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
-                  terminations[i] = 0;
-                for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
-                  rejections[i] = 0;
-
 #ifdef DEBUG_TERMINATIONS
                 debug_header.ndim() = 3;
                 debug_header.datatype() = DataType::UInt32;
                 for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i) {
-                  std::string name;
-                  switch (i) {
-                    case CONTINUE:              name = "undefined";      break;
-                    case ENTER_CGM:             name = "enter_cgm";      break;
-                    case CALIBRATOR:            name = "calibrator";     break;
-                    case EXIT_IMAGE:            name = "exit_image";     break;
-                    case ENTER_CSF:             name = "enter_csf";      break;
-                    case BAD_SIGNAL:            name = "bad_signal";     break;
-                    case HIGH_CURVATURE:        name = "curvature";      break;
-                    case LENGTH_EXCEED:         name = "max_length";     break;
-                    case TERM_IN_SGM:           name = "term_in_sgm";    break;
-                    case EXIT_SGM:              name = "exit_sgm";       break;
-                    case EXIT_MASK:             name = "exit_mask";      break;
-                    case ENTER_EXCLUDE:         name = "enter_exclude";  break;
-                    case TRAVERSE_ALL_INCLUDE:  name = "all_include";    break;
-                  }
+                  const std::string name = termination_name (term_t (i));
                   debug_images[i] = new Image<uint32_t> (Image<uint32_t>::create ("terms_" + name + ".mif", debug_header));
                 }
 #endif
@@ -206,12 +217,18 @@ namespace MR
 
             Image<float> source;
             Properties& properties;
+            const ROIGrid rois;
             Eigen::Vector3f init_dir;
             size_t max_num_tracks, max_num_seeds, min_num_points, max_num_points;
             float max_angle, max_angle_rk4, cos_max_angle, cos_max_angle_rk4;
             float step_size, threshold, init_threshold;
             size_t max_seed_attempts;
             bool unidirectional, rk4, stop_on_all_include, implicit_max_num_seeds;
+            bool sharded;
+            std::string shard;
+            size_t first_seed, last_seed;
+            uint32_t rng_base;
+            std::unique_ptr<Checkpoint> resume_point;
             DWI::Tractography::Resampling::Downsampler downsampler;
 
             // Additional members for ACT
@@ -262,6 +279,89 @@ namespace MR
             virtual float internal_step_size() const { return step_size; }
 
 
+            // In shard mode, seeds are numbered consecutively across all
+            //   shards, and each thread claims the next seed number together
+            //   with the corresponding seed point. Returns false once all
+            //   seeds of this shard have been claimed.
+            // Since streamlines are written in order of seed number, those
+            //   generated ahead of the next one due to be written must be held
+            //   back; to bound the memory this requires, threads wait here
+            //   until the seed claimed is within TCKGEN_SHARD_MAX_PENDING of
+            //   the next seed to be written.
+            template <class SeedFunctor>
+            bool next_shard_seed (Math::RNG& rng, size_t& index, SeedFunctor&& get_seed) const
+            {
+              std::unique_lock<std::mutex> lock (seed_mutex);
+              seed_claimable.wait (lock, [&] () { return seeding_stopped || std::max (next_seed, first_seed) < seeds_written + TCKGEN_SHARD_MAX_PENDING; });
+              if (seeding_stopped)
+                return false;
+              // finite seeders can only be traversed in order:
+              for (; next_seed < first_seed; ++next_seed) {
+                seed_rng (rng, next_seed);
+                get_seed();
+              }
+              if (next_seed >= last_seed)
+                return false;
+              index = next_seed++;
+              seed_rng (rng, index);
+              if (properties.seeds.is_finite())
+                get_seed();
+              return true;
+            }
+
+            // called by the writer in shard mode once all streamlines up to
+            //   (but excluding) seed number \a seed have been written:
+            void set_seeds_written (size_t seed) const
+            {
+              {
+                std::lock_guard<std::mutex> lock (seed_mutex);
+                seeds_written = seed;
+              }
+              seed_claimable.notify_all();
+            }
+
+            // release any threads waiting for a seed, e.g. once the writer
+            //   has completed, or a thread has failed to obtain its seed:
+            void stop_seeding () const
+            {
+              {
+                std::lock_guard<std::mutex> lock (seed_mutex);
+                seeding_stopped = true;
+              }
+              seed_claimable.notify_all();
+            }
+
+            // The random number sequence used for each seed depends only on
+            //   the seed number (and MRTRIX_RNG_SEED if set), and not on the
+            //   thread or process that generates the streamline
+            void seed_rng (Math::RNG& rng, const size_t index) const
+            {
+              std::seed_seq seq { rng_base, uint32_t (index), uint32_t (uint64_t (index) >> 32) };
+              rng.seed (seq);
+            }
+
+
+            void get_statistics (Checkpoint& checkpoint) const
+            {
+              for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+                checkpoint.terminations[i] = terminations[i];
+              for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+                checkpoint.rejections[i] = rejections[i];
+            }
+
+
+            void write_statistics (const std::string& path) const
+            {
+              File::OFStream out (path);
+              out << "mrtrix tracking statistics\n";
+              for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+                out << "termination_" << termination_name (term_t (i)) << ": " << terminations[i] << "\n";
+              for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+                out << "rejection_" << rejection_name (reject_t (i)) << ": " << rejections[i] << "\n";
+              out << "END\n";
+            }
+
+
             void add_termination (const term_t i)   const { terminations[i].fetch_add (1, std::memory_order_relaxed); }
             void add_rejection   (const reject_t i) const { rejections[i]  .fetch_add (1, std::memory_order_relaxed); }
 
@@ -285,8 +385,78 @@ namespace MR
             mutable std::atomic<size_t> terminations[TERMINATION_REASON_COUNT];
             mutable std::atomic<size_t> rejections  [REJECTION_REASON_COUNT];
 
+            mutable std::mutex seed_mutex;
+            mutable std::condition_variable seed_claimable;
+            mutable size_t next_seed, seeds_written;
+            mutable bool seeding_stopped;
+
             std::unique_ptr<ACT::ACT_Shared_additions> act_shared_additions;
 
+            void set_shard (const std::string& spec)
+            {
+              vector<int> V;
+              try {
+                for (const auto& entry : split (spec, "/"))
+                  V.push_back (to<int> (entry));
+              } catch (Exception&) { }
+              if (V.size() != 2 || V[1] < 1 || V[0] < 0 || V[0] >= V[1])
+                throw Exception ("invalid shard specification \"" + spec + "\" (expected i/N, with 0 <= i < N)");
+              if (properties.find ("seed_dynamic") != properties.end())
+                throw Exception ("Dynamic seeding cannot be used in conjunction with the -shard or -checkpoint options");
+              const size_t shard_index = V[0], num_shards = V[1];
+              sharded = true;
+              shard = str(shard_index) + "/" + str(num_shards);
+              if (num_shards > 1) {
+                if (max_num_tracks && !properties.seeds.is_finite())
+                  throw Exception ("The -shard option requires a fixed number of seeds: use -select 0 and set the total number of seeds using the -seeds option");
+                if (!max_num_seeds)
+                  throw Exception ("The -shard option requires a finite number of seeds");
+                first_seed = shard_index * max_num_seeds / num_shards;
+                last_seed = (shard_index+1) * max_num_seeds / num_shards;
+                // the number of streamlines is determined by the number of seeds,
+                //   so the test for early exit is not applicable:
+                max_num_tracks = 0;
+                max_num_seeds = last_seed - first_seed;
+              } else {
+                // streamlines are written in order of seed number, so the
+                //   target number of streamlines is still reached deterministically:
+                first_seed = 0;
+                last_seed = max_num_seeds ? max_num_seeds : std::numeric_limits<size_t>::max();
+              }
+              next_seed = properties.seeds.is_finite() ? 0 : first_seed;
+              seeds_written = first_seed;
+              const char* env = getenv ("MRTRIX_RNG_SEED");
+              if (env)
+                rng_base = to<uint32_t> (env);
+
+              // a single shard should produce the same output as merging multiple shards:
+              if (num_shards == 1) {
+                properties.erase ("shard");
+              } else {
+                properties["shard"] = shard;
+                INFO ("generating shard " + shard + " (seeds " + str(first_seed) + " to " + str(last_seed-1) + ")");
+              }
+            }
+
+
+            void resume (const std::string& path)
+            {
+              resume_point.reset (new Checkpoint);
+              resume_point->load (path);
+              if (resume_point->shard != shard || resume_point->max_num_seeds != max_num_seeds)
+                throw Exception ("tracking checkpoint file \"" + path + "\" does not match the current tckgen invocation");
+              // the seeds up to the checkpoint need not be tracked again:
+              first_seed = resume_point->next_seed;
+              next_seed = properties.seeds.is_finite() ? 0 : first_seed;
+              seeds_written = first_seed;
+              for (size_t i = 0; i != TERMINATION_REASON_COUNT; ++i)
+                terminations[i] = resume_point->terminations[i];
+              for (size_t i = 0; i != REJECTION_REASON_COUNT; ++i)
+                rejections[i] = resume_point->rejections[i];
+              INFO ("resuming tracking from seed " + str(first_seed));
+            }
+
+
 #ifdef DEBUG_TERMINATIONS
             Header debug_header;
             Image<uint32_t>* debug_images[TERMINATION_REASON_COUNT];
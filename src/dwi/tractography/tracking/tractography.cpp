@@ -88,7 +88,32 @@ namespace MR
 
       + Option ("downsample", "downsample the generated streamlines to reduce output file size "
                               "(default is (samples-1) for iFOD2, no downsampling for all other algorithms)")
-          + Argument ("factor").type_integer (2);
+          + Argument ("factor").type_integer (2)
+
+      + Option ("shard", "generate only part i (counting from 0) of N of the seeds, such that "
+                         "the outputs of N separate invocations of tckgen (e.g. on different machines) "
+                         "can be combined into a single output using the tckmerge command. "
+                         "The random number generator is re-seeded from the index of each seed, so that "
+                         "the combined output is identical to that of a single invocation "
+                         "with the option -shard 0/1. Requires a fixed number of seeds, provided either "
+                         "by the -seeds option or by a finite seeding mechanism; "
+                         "cannot be combined with the -select or -seed_dynamic options.")
+          + Argument ("i/N").type_text()
+
+      + Option ("output_stats", "write the counts of the different streamline termination and rejection "
+                                "mechanisms to a text file")
+          + Argument ("path").type_file_out()
+
+      + Option ("checkpoint", "periodically record the progress of tracking in the specified file, "
+                              "so that tracking can be continued using the -resume option if tckgen is interrupted "
+                              "(the interval can be set using the TckgenCheckpointInterval config file option). "
+                              "As with the -shard option, the random number generator is re-seeded from the index of each seed, "
+                              "and -seed_dynamic is not supported.")
+          + Argument ("path").type_file_out().append_on_resume()
+
+      + Option ("resume", "continue tracking from the state recorded in the file provided with the -checkpoint option, "
+                          "appending to the existing output files. All other options must be identical to those of the "
+                          "interrupted invocation; the output is then identical to that of an uninterrupted run.");
 
 
 
@@ -156,6 +181,21 @@ namespace MR
         opt = get_options ("grad");
         if (opt.size()) properties["DW_scheme"] = std::string (opt[0][0]);
 
+        opt = get_options ("shard");
+        if (opt.size()) properties["shard"] = std::string (opt[0][0]);
+
+        opt = get_options ("output_stats");
+        if (opt.size()) properties["stats_output"] = std::string (opt[0][0]);
+
+        opt = get_options ("checkpoint");
+        if (opt.size()) properties["checkpoint"] = std::string (opt[0][0]);
+
+        if (get_options ("resume").size()) {
+          if (properties.find ("checkpoint") == properties.end())
+            throw Exception ("-resume option requires the checkpoint file to be provided using the -checkpoint option");
+          properties["resume"] = "1";
+        }
+
       }
 
 
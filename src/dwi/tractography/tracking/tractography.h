@@ -27,6 +27,10 @@
 #define TCKGEN_DEFAULT_MAX_TRIALS_PER_STEP 1000
 #define TCKGEN_DEFAULT_IFOD2_NSAMPLES 4
 
+// In shard mode, the maximum number of seeds that may be claimed ahead of
+//   the next streamline due to be written:
+#define TCKGEN_SHARD_MAX_PENDING 16384
+
 
 namespace MR
 {
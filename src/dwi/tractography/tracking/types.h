@@ -42,6 +42,42 @@ namespace MR
         enum reject_t { INVALID_SEED, NO_PROPAGATION_FROM_SEED, TRACK_TOO_SHORT, TRACK_TOO_LONG, ENTER_EXCLUDE_REGION, MISSED_INCLUDE_REGION, ACT_POOR_TERMINATION, ACT_FAILED_WM_REQUIREMENT };
 #define REJECTION_REASON_COUNT 8
 
+        // short names used to label termination & rejection counts in output files:
+        inline const char* termination_name (const term_t i)
+        {
+          switch (i) {
+            case CONTINUE:              return "undefined";
+            case ENTER_CGM:             return "enter_cgm";
+            case CALIBRATOR:            return "calibrator";
+            case EXIT_IMAGE:            return "exit_image";
+            case ENTER_CSF:             return "enter_csf";
+            case BAD_SIGNAL:            return "bad_signal";
+            case HIGH_CURVATURE:        return "curvature";
+            case LENGTH_EXCEED:         return "max_length";
+            case TERM_IN_SGM:           return "term_in_sgm";
+            case EXIT_SGM:              return "exit_sgm";
+            case EXIT_MASK:             return "exit_mask";
+            case ENTER_EXCLUDE:         return "enter_exclude";
+            case TRAVERSE_ALL_INCLUDE:  return "all_include";
+          }
+          return "";
+        }
+
+        inline const char* rejection_name (const reject_t i)
+        {
+          switch (i) {
+            case INVALID_SEED:              return "invalid_seed";
+            case NO_PROPAGATION_FROM_SEED:  return "no_propagation";
+            case TRACK_TOO_SHORT:           return "too_short";
+            case TRACK_TOO_LONG:            return "too_long";
+            case ENTER_EXCLUDE_REGION:      return "enter_exclude";
+            case MISSED_INCLUDE_REGION:     return "missed_include";
+            case ACT_POOR_TERMINATION:      return "poor_termination";
+            case ACT_FAILED_WM_REQUIREMENT: return "failed_wm_requirement";
+          }
+          return "";
+        }
+
 
 
         template <class ImageType>
@@ -26,14 +26,66 @@ namespace MR
 
 
           bool WriteKernel::operator() (const GeneratedTrack& tck)
+          {
+            if (!S.sharded)
+              return write (tck);
+
+            if (tck.get_seed_number() != next_seed_number) {
+              pending.insert (std::make_pair (tck.get_seed_number(), tck));
+              return true;
+            }
+            if (!write (tck)) {
+              S.stop_seeding();
+              return false;
+            }
+            ++next_seed_number;
+            for (auto i = pending.begin(); i != pending.end() && i->first == next_seed_number; i = pending.erase (i)) {
+              if (!write (i->second)) {
+                S.stop_seeding();
+                return false;
+              }
+              ++next_seed_number;
+            }
+            // allow the trackers to claim further seeds:
+            S.set_seeds_written (next_seed_number);
+            // all streamlines up to next_seed_number have now been written:
+            if (checkpoint_path.size() && checkpoint_timer.elapsed() > checkpoint_interval)
+              save_checkpoint();
+            return true;
+          }
+
+
+
+          void WriteKernel::save_checkpoint ()
+          {
+            Checkpoint checkpoint;
+            writer->flush();
+            if (output_seeds)
+              output_seeds->flush();
+            checkpoint.shard = S.shard;
+            checkpoint.next_seed = next_seed_number;
+            checkpoint.max_num_seeds = S.max_num_seeds;
+            checkpoint.seeds = seeds;
+            checkpoint.streamlines = streamlines;
+            checkpoint.selected = selected;
+            checkpoint.tracks_size = writer->data_end();
+            checkpoint.seeds_size = output_seeds ? int64_t (output_seeds->tellp()) : 0;
+            S.get_statistics (checkpoint);
+            checkpoint.save (checkpoint_path);
+            checkpoint_timer.start();
+          }
+
+
+
+          bool WriteKernel::write (const GeneratedTrack& tck)
           {
             if (complete())
               return false;
             if (tck.size() && output_seeds) {
               const auto& p = tck[tck.get_seed_index()];
-              (*output_seeds) << str(writer.count) << "," << str(tck.get_seed_index()) << "," << str(p[0]) << "," << str(p[1]) << "," << str(p[2]) << ",\n";
+              (*output_seeds) << str(writer->count) << "," << str(tck.get_seed_index()) << "," << str(p[0]) << "," << str(p[1]) << "," << str(p[2]) << ",\n";
             }
-            writer (tck);
+            (*writer) (tck.data(), tck.size());
             switch (tck.get_status()) {
               case GeneratedTrack::status_t::INVALID: assert (0); break;
               // Note intentiional lack of break usage
@@ -16,15 +16,19 @@
 #define __dwi_tractography_tracking_write_kernel_h__
 
 #include <cinttypes>
+#include <map>
 #include <string>
 
 #include "timer.h"
+#include "file/config.h"
 #include "file/ofstream.h"
+#include "file/utils.h"
 
 #include "dwi/tractography/file.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/streamline.h"
 
+#include "dwi/tractography/tracking/checkpoint.h"
 #include "dwi/tractography/tracking/early_exit.h"
 #include "dwi/tractography/tracking/generated_track.h"
 #include "dwi/tractography/tracking/shared.h"
@@ -50,19 +54,43 @@ namespace MR
               const std::string& output_file,
               const DWI::Tractography::Properties& properties) :
                 S (shared),
-                writer (output_file, properties),
                 always_increment (S.properties.seeds.is_finite() || !S.max_num_tracks),
                 warn_on_max_seeds (S.implicit_max_num_seeds),
-                seeds (0),
-                streamlines (0),
-                selected (0),
+                seeds (S.resume_point ? S.resume_point->seeds : 0),
+                streamlines (S.resume_point ? S.resume_point->streamlines : 0),
+                selected (S.resume_point ? S.resume_point->selected : 0),
                 progress (printf ("       0 seeds,        0 streamlines,        0 selected", 0, 0), always_increment ? S.max_num_seeds : S.max_num_tracks),
-                early_exit (shared)
+                early_exit (shared),
+                next_seed_number (S.first_seed)
           {
+            if (S.resume_point)
+              writer.reset (new Writer<> (output_file, S.resume_point->tracks_size, selected, seeds));
+            else
+              writer.reset (new Writer<> (output_file, properties));
+
             const auto p = properties.find ("seed_output");
             if (p != properties.end()) {
-              output_seeds.reset (new File::OFStream (p->second, std::ios_base::out | std::ios_base::trunc));
-              (*output_seeds) << "#Track_index,Seed_index,Pos_x,Pos_y,Pos_z,\n";
+              if (S.resume_point) {
+                File::resize (p->second, S.resume_point->seeds_size);
+                output_seeds.reset (new File::OFStream (p->second, std::ios_base::in | std::ios_base::out | std::ios_base::ate));
+              } else {
+                output_seeds.reset (new File::OFStream (p->second, std::ios_base::out | std::ios_base::trunc));
+                (*output_seeds) << "#Track_index,Seed_index,Pos_x,Pos_y,Pos_z,\n";
+              }
+            }
+
+            const auto c = properties.find ("checkpoint");
+            if (c != properties.end()) {
+              checkpoint_path = c->second;
+              //CONF option: TckgenCheckpointInterval
+              //CONF default: 600
+              //CONF The interval (in seconds) between successive checkpoints
+              //CONF written by tckgen when the -checkpoint option is used.
+              checkpoint_interval = File::Config::get_float ("TckgenCheckpointInterval", 600.0);
+            }
+            if (S.resume_point) {
+              for (size_t n = 0; n != (always_increment ? seeds : selected); ++n)
+                progress.update ([&](){ return printf ("%8" PRIu64 " seeds, %8" PRIu64 " streamlines, %8" PRIu64 " selected", seeds, streamlines, selected); });
             }
           }
 
@@ -72,9 +100,12 @@ namespace MR
           ~WriteKernel ()
           {
             // Use set_text() rather than update() here to force update of the text before progress goes out of scope
+            // write any streamlines still held back, e.g. if a seed could not be found:
+            for (const auto& i : pending)
+              write (i.second);
             progress.set_text (printf ("%8" PRIu64 " seeds, %8" PRIu64 " streamlines, %8" PRIu64 " selected", seeds, streamlines, selected));
-            if (warn_on_max_seeds && writer.total_count == S.max_num_seeds
-                && S.max_num_tracks && writer.count < S.max_num_tracks) {
+            if (warn_on_max_seeds && writer->total_count == S.max_num_seeds
+                && S.max_num_tracks && writer->count < S.max_num_tracks) {
               WARN ("less than desired streamline number due to implicit maximum number of seeds; set -seeds 0 to override");
             }
             if (output_seeds) {
@@ -92,12 +123,25 @@ namespace MR
 
         protected:
           const SharedBase& S;
-          Writer<> writer;
+          std::unique_ptr<Writer<>> writer;
           const bool always_increment, warn_on_max_seeds;
           size_t seeds, streamlines, selected;
           std::unique_ptr<File::OFStream> output_seeds;
           ProgressBar progress;
           EarlyExit early_exit;
+
+          // in shard mode, streamlines are written in order of seed number
+          //   rather than in the order in which they are generated; the
+          //   number held back is bounded by TCKGEN_SHARD_MAX_PENDING:
+          std::map<size_t, GeneratedTrack> pending;
+          size_t next_seed_number;
+
+          std::string checkpoint_path;
+          float checkpoint_interval;
+          Timer checkpoint_timer;
+
+          bool write (const GeneratedTrack&);
+          void save_checkpoint ();
       };
 
 
@@ -0,0 +1,141 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "image.h"
+#include "timer.h"
+#include "algo/loop.h"
+#include "algo/threaded_loop.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Compare the throughput of indirect image IO via std::function with that of with_typed_io()";
+
+  DESCRIPTION
+  + "A test image of the requested size and datatype is written to the path "
+    "supplied, using intensity scaling. It is then read back in, once through "
+    "the regular Image interface (which invokes the fetch function held by "
+    "the Image::Buffer on every voxel access), and once via with_typed_io(). "
+    "The throughput of both approaches is reported, for single-threaded and "
+    "multi-threaded loops.";
+
+  ARGUMENTS
+  + Argument ("image", "the path of the test image to create").type_image_out();
+
+  OPTIONS
+  + Option ("size", "the size of the test image (default: 128,128,64,32)")
+  +   Argument ("dims").type_sequence_int()
+
+  + Option ("repeats", "the number of passes over the data for each test (default: 5)")
+  +   Argument ("number").type_integer (1)
+
+  + DataType::options();
+}
+
+
+
+// read all values through the image supplied, using a single thread:
+struct SumSingle { NOMEMALIGN
+  double& sum;
+  template <class ImageType>
+    void operator() (ImageType& in) {
+      for (auto l = Loop (in) (in); l; ++l)
+        sum += in.value();
+    }
+};
+
+// read all values through the image supplied, using ThreadedLoop:
+struct SumThreaded { NOMEMALIGN
+  template <class ImageType>
+    void operator() (ImageType& in) {
+      ThreadedLoop (in).run ([] (ImageType& in) { volatile float x = in.value(); (void) x; }, in);
+    }
+};
+
+// write all values through the image supplied, using ThreadedLoop:
+struct Fill { NOMEMALIGN
+  template <class ImageType>
+    void operator() (ImageType& out) {
+      ThreadedLoop (out).run ([] (ImageType& out) { out.value() = out.index(0) + out.index(1) - out.index(2); }, out);
+    }
+};
+
+
+
+template <class Functor>
+double time_it (Image<float>& image, Functor&& functor, bool typed, size_t repeats)
+{
+  Timer timer;
+  for (size_t n = 0; n < repeats; ++n) {
+    if (typed)
+      with_typed_io (image, functor);
+    else
+      functor (image);
+  }
+  return timer.elapsed() / repeats;
+}
+
+
+
+void report (const std::string& label, size_t nvox, double generic, double typed)
+{
+  CONSOLE (label + ": std::function " + str(1.0e-6*nvox/generic, 4) + " Mvox/s, typed "
+      + str(1.0e-6*nvox/typed, 4) + " Mvox/s (speedup " + str(generic/typed, 3) + ")");
+}
+
+
+
+void run ()
+{
+  Header header;
+  header.ndim() = 4;
+  vector<int> dims = { 128, 128, 64, 32 };
+  auto opt = get_options ("size");
+  if (opt.size())
+    dims = opt[0][0].as_sequence_int();
+  header.ndim() = dims.size();
+  for (size_t n = 0; n < dims.size(); ++n) {
+    header.size(n) = dims[n];
+    header.spacing(n) = 1.0;
+  }
+  header.datatype() = DataType::from_command_line (DataType::Int16BE);
+  header.set_intensity_scaling (0.5, 10.0);
+  const size_t repeats = get_option_value ("repeats", 5);
+  const size_t nvox = voxel_count (header);
+
+  {
+    auto out = Image<float>::create (argument[0], header);
+    if (out.is_direct_io())
+      WARN ("image uses direct IO - benchmark results will not be informative");
+    Fill fill;
+    report ("multi-threaded write", nvox, time_it (out, fill, false, repeats), time_it (out, fill, true, repeats));
+  }
+
+  auto in = Image<float>::open (argument[0]);
+  double sum_generic = 0.0, sum_typed = 0.0;
+  const double generic = time_it (in, SumSingle { sum_generic }, false, repeats);
+  const double typed = time_it (in, SumSingle { sum_typed }, true, repeats);
+  report ("single-threaded read", nvox, generic, typed);
+  if (sum_generic != sum_typed)
+    throw Exception ("mismatch between values read using std::function and typed kernels");
+
+  SumThreaded sum;
+  report ("multi-threaded read", nvox, time_it (in, sum, false, repeats), time_it (in, sum, true, repeats));
+}
+
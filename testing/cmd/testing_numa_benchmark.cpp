@@ -0,0 +1,171 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <atomic>
+#include <cstring>
+
+#include "command.h"
+#include "timer.h"
+#include "thread.h"
+#include "math/math.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Measure the effect of first-touch buffer initialisation on multi-threaded image processing";
+
+  DESCRIPTION
+  + "Buffers are initialised either serially by the main thread, or in "
+    "parallel using Thread::first_touch(). On NUMA systems, the latter "
+    "distributes the memory pages of each buffer over the nodes of the threads "
+    "that initialised them, rather than placing them all on the node of the "
+    "main thread. Two workloads are then timed over these buffers, with the "
+    "voxels processed in blocks shared between threads in the same way as "
+    "ThreadedLoop: a memory-bound voxel-wise operation (equivalent to mrcalc a "
+    "b -mult c -add), and a more compute-bound per-voxel matrix multiplication "
+    "(as performed in e.g. dwi2fod)."
+
+  + "These synthetic workloads stand in for timing actual commands on NUMA "
+    "hardware: they isolate the effect of page placement from image IO and "
+    "other per-command overheads, but will not reflect the mix of memory and "
+    "compute load of any particular command."
+
+  + "For the most representative results, run on a multi-socket system with "
+    "the NUMAAware config file option set, so that worker threads are also "
+    "pinned to individual CPU cores.";
+
+  OPTIONS
+  + Option ("voxels", "the number of voxels in each image (default: 1048576)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("volumes", "the number of volumes in the matrix multiplication test (default: 16)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("repeats", "the number of times to repeat each workload (default: 5)")
+  +   Argument ("number").type_integer (1);
+}
+
+
+
+using value_type = float;
+
+// number of voxels processed by a thread at a time:
+constexpr size_t block_size = 65536;
+
+
+
+class Buffer { NOMEMALIGN
+  public:
+    Buffer (size_t num_values, bool parallel) :
+        data (new value_type [num_values]) {
+      uint8_t* address = reinterpret_cast<uint8_t*> (data.get());
+      if (parallel)
+        Thread::first_touch (address, num_values * sizeof (value_type));
+      else
+        memset (address, 0, num_values * sizeof (value_type));
+    }
+    value_type* get () const { return data.get(); }
+  private:
+    std::unique_ptr<value_type[]> data;
+};
+
+
+
+class MultAdd { NOMEMALIGN
+  public:
+    const value_type *a, *b, *c;
+    value_type* out;
+    size_t num_voxels;
+    std::atomic<size_t>& next;
+    void execute () {
+      size_t block;
+      while ((block = next++) * block_size < num_voxels) {
+        const size_t end = std::min ((block+1) * block_size, num_voxels);
+        for (size_t n = block * block_size; n < end; ++n)
+          out[n] = a[n] * b[n] + c[n];
+      }
+    }
+};
+
+
+
+class MatrixMult { NOMEMALIGN
+  public:
+    const value_type* in;
+    value_type* out;
+    size_t num_voxels;
+    const Eigen::MatrixXf& M;
+    std::atomic<size_t>& next;
+    void execute () {
+      const size_t volumes = M.cols();
+      size_t block;
+      while ((block = next++) * block_size < num_voxels) {
+        const size_t start = block * block_size;
+        const size_t count = std::min (block_size, num_voxels - start);
+        Eigen::Map<const Eigen::MatrixXf> input (in + start*volumes, volumes, count);
+        Eigen::Map<Eigen::MatrixXf> output (out + start*volumes, volumes, count);
+        output.noalias() = M * input;
+      }
+    }
+};
+
+
+
+template <class Functor>
+double time_workload (Functor& functor, std::atomic<size_t>& next, size_t repeats)
+{
+  Timer timer;
+  for (size_t n = 0; n < repeats; ++n) {
+    next = 0;
+    Thread::run (Thread::multi (functor), "benchmark").wait();
+  }
+  return timer.elapsed() / repeats;
+}
+
+
+
+void run ()
+{
+  const size_t num_voxels = get_option_value ("voxels", 1048576);
+  const size_t volumes = get_option_value ("volumes", 16);
+  const size_t repeats = get_option_value ("repeats", 5);
+
+  CONSOLE ("using " + str(Thread::number_of_threads()) + " threads, with thread pinning "
+      + (Thread::numa_aware() ? "enabled" : "disabled (set NUMAAware in the config file to enable)"));
+
+  const Eigen::MatrixXf M = Eigen::MatrixXf::Random (volumes, volumes);
+
+  for (const bool parallel : { false, true }) {
+    Timer timer;
+    Buffer a (num_voxels, parallel), b (num_voxels, parallel), c (num_voxels, parallel), out (num_voxels, parallel);
+    Buffer in4D (num_voxels * volumes, parallel), out4D (num_voxels * volumes, parallel);
+    const double init = timer.elapsed();
+
+    std::atomic<size_t> next (0);
+    MultAdd mult_add = { a.get(), b.get(), c.get(), out.get(), num_voxels, next };
+    const double mult_add_time = time_workload (mult_add, next, repeats);
+    MatrixMult matrix_mult = { in4D.get(), out4D.get(), num_voxels, M, next };
+    const double matrix_mult_time = time_workload (matrix_mult, next, repeats);
+
+    CONSOLE (std::string (parallel ? "parallel first-touch" : "serial") + " initialisation: "
+        + "initialise " + str(1.0e3*init, 4) + " ms, "
+        + "mult-add " + str(1.0e3*mult_add_time, 4) + " ms, "
+        + "matrix multiply " + str(1.0e3*matrix_mult_time, 4) + " ms");
+  }
+}
+
@@ -0,0 +1,224 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <random>
+
+#include "command.h"
+#include "header.h"
+#include "timer.h"
+#include "dwi/tractography/GT/gt.h"
+#include "dwi/tractography/GT/internalenergy.h"
+#include "dwi/tractography/GT/particlegrid.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::GT;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Measure the speed of the neighbourhood search used to propose connections in global tractography";
+
+  DESCRIPTION
+  + "A particle grid is populated with randomly placed particles, which are then "
+    "subjected to a sequence of random births, deaths and shifts, such that the "
+    "particles are scattered through the particle pool as they would be during "
+    "a run of tckglobal. The neighbourhood of an end point of each particle is "
+    "then scanned for connection candidates, as in each connection proposal of "
+    "the MHSampler. The throughput is reported for the current implementation, "
+    "which evaluates the distance and angular thresholds using the positions and "
+    "directions stored contiguously within each grid cell, and for a reference "
+    "implementation in which each grid cell holds a list of pointers to the "
+    "particles. The largest relative difference in the sum of the connection "
+    "probabilities between the two is also reported, and the command fails if "
+    "it exceeds the specified tolerance.";
+
+  OPTIONS
+  + Option ("particles", "the number of particles (default: 1000000)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("extent", "the width of the cubic volume containing the particles, in mm (default: 100)")
+  +   Argument ("value").type_float (1.0)
+
+  + Option ("updates", "the number of random births, deaths and shifts applied to the particles "
+      "before the test, as a multiple of the number of particles (default: 5)")
+  +   Argument ("number").type_integer (0)
+
+  + Option ("repeats", "the number of repeats of each test (default: 3)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("tolerance", "the largest relative difference in the sum of the connection probabilities "
+      "accepted between the two implementations (default: 1e-5)")
+  +   Argument ("value").type_float (0.0);
+}
+
+
+
+// reference implementation, with each grid cell holding a list of pointers to its particles:
+class PointerGrid { MEMALIGN(PointerGrid)
+  public:
+    PointerGrid (const ParticleGrid& pgrid, const size_t size, const ParticleGrid::ParticleVectorType& particles) :
+      pgrid (pgrid), size (size), grid (size*size*size)
+    {
+      for (auto p : particles)
+        grid[index (p->getPosition())].push_back (p);
+    }
+
+    double scan (const Particle* p, const int alpha0, const double currTemp) const
+    {
+      const Point_t ep = p->getEndPoint (alpha0);
+      size_t x, y, z;
+      pgrid.pos2xyz (ep, x, y, z);
+      const float tolerance2 = Particle::L * Particle::L;
+      const float costheta = Math::sqrt1_2;
+      double normalization = 1.0;
+      for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+          for (int k = -1; k <= 1; k++) {
+            const ssize_t xi = x+i, yj = y+j, zk = z+k;
+            if (xi < 0 || yj < 0 || zk < 0 || xi >= ssize_t(size) || yj >= ssize_t(size) || zk >= ssize_t(size))
+              continue;
+            for (const Particle* par : grid[zk + size * (yj + size * xi)]) {
+              if (par == p)
+                continue;
+              const float d1 = (ep - par->getEndPoint(-1)).squaredNorm();
+              const float d2 = (ep - par->getEndPoint(+1)).squaredNorm();
+              const float d = (d1 < d2) ? d1 : d2;
+              const int alpha = (d1 < d2) ? -1 : 1;
+              if ( (alpha == -1) ? (par->hasPredecessor() && par->getPredecessor() != p) : (par->hasSuccessor() && par->getSuccessor() != p) )
+                continue;
+              const float ct = (-alpha0*alpha) * p->getDirection().dot (par->getDirection());
+              if (d < tolerance2 && ct > costheta) {
+                const Point_t Xm = (p->getPosition() + par->getPosition()) * 0.5;
+                const double e_conn = ( (ep - Xm).squaredNorm() + (par->getEndPoint(alpha) - Xm).squaredNorm() ) / (Particle::L * Particle::L) - 1.0;
+                normalization += exp (-e_conn/currTemp);
+              }
+            }
+          }
+        }
+      }
+      return normalization;
+    }
+
+  private:
+    const ParticleGrid& pgrid;
+    const size_t size;
+    vector<ParticleGrid::ParticleVectorType> grid;
+
+    size_t index (const Point_t& pos) const {
+      size_t x, y, z;
+      pgrid.pos2xyz (pos, x, y, z);
+      return z + size * (y + size * x);
+    }
+};
+
+
+
+// current implementation, exposing the neighbourhood search of the InternalEnergyComputer:
+class Scanner : public InternalEnergyComputer { MEMALIGN(Scanner)
+  public:
+    Scanner (Stats& stats, ParticleGrid& pgrid) : InternalEnergyComputer (stats, pgrid) { }
+    double scan (const Particle* p, const int alpha0, const double currTemp) {
+      scanNeighbourhood (p, alpha0, currTemp);
+      return normalization;
+    }
+};
+
+
+
+void run ()
+{
+  const size_t num_particles = get_option_value ("particles", 1000000);
+  const float extent = get_option_value ("extent", 100.0);
+  const size_t updates = get_option_value ("updates", 5);
+  const size_t repeats = get_option_value ("repeats", 3);
+  const double tolerance = get_option_value ("tolerance", 1e-5);
+
+  Header H;
+  H.ndim() = 3;
+  for (size_t axis = 0; axis != 3; ++axis) {
+    H.size (axis) = std::ceil (extent);
+    H.spacing (axis) = 1.0;
+  }
+  H.transform().setIdentity();
+  const size_t grid_size = Math::ceil<size_t> (H.size(0) / (2.0*Particle::L));
+
+  Stats stats (1.0, 1.0, 1);
+  ParticleGrid pgrid (H);
+  ParticleGrid::ParticleVectorType particles;
+  {
+    std::mt19937 rng (0);
+    std::uniform_real_distribution<float> position (0.0, H.size(0) - 1.0);
+    std::normal_distribution<float> normal (0.0, 1.0);
+    auto random_point = [&] () { return Point_t (position (rng), position (rng), position (rng)); };
+    auto random_dir = [&] () { return Point_t (normal (rng), normal (rng), normal (rng)).normalized(); };
+
+    ProgressBar progress ("generating particles", (1 + updates) * num_particles);
+    for (size_t n = 0; n != num_particles; ++n) {
+      pgrid.add (random_point(), random_dir());
+      ++progress;
+    }
+    std::uniform_int_distribution<int> proposal (0, 2);
+    for (size_t n = 0; n != updates * num_particles; ++n) {
+      Particle* par = pgrid.getRandom();
+      if (par) {
+        switch (proposal (rng)) {
+          case 0:
+            pgrid.remove (par);
+            pgrid.add (random_point(), random_dir());
+            break;
+          default:
+            Point_t pos = par->getPosition() + Particle::L / 8.0 * Point_t (normal (rng), normal (rng), normal (rng));
+            for (size_t axis = 0; axis != 3; ++axis)
+              pos[axis] = std::min (std::max (pos[axis], 0.0f), float (H.size(axis) - 1.0));
+            pgrid.shift (par, pos, random_dir());
+        }
+      }
+      ++progress;
+    }
+    pgrid.getParticles (particles);
+    std::shuffle (particles.begin(), particles.end(), rng);
+  }
+
+  PointerGrid reference (pgrid, grid_size, particles);
+  Scanner scanner (stats, pgrid);
+
+  double reference_time = 0.0, current_time = 0.0, max_error = 0.0;
+  for (size_t n = 0; n != repeats; ++n) {
+    vector<double> reference_sums (particles.size()), current_sums (particles.size());
+    {
+      Timer timer;
+      for (size_t i = 0; i != particles.size(); ++i)
+        reference_sums[i] = reference.scan (particles[i], (i % 2) ? 1 : -1, 0.1);
+      reference_time += timer.elapsed();
+    }
+    {
+      Timer timer;
+      for (size_t i = 0; i != particles.size(); ++i)
+        current_sums[i] = scanner.scan (particles[i], (i % 2) ? 1 : -1, 0.1);
+      current_time += timer.elapsed();
+    }
+    for (size_t i = 0; i != particles.size(); ++i)
+      max_error = std::max (max_error, std::abs (current_sums[i] / reference_sums[i] - 1.0));
+  }
+
+  CONSOLE (str(particles.size()) + " particles: pointer grid " + str(1.0e-3*repeats*particles.size()/reference_time, 4)
+      + " kscans/s, contiguous cells " + str(1.0e-3*repeats*particles.size()/current_time, 4)
+      + " kscans/s (speedup " + str(reference_time/current_time, 3) + "), maximum relative difference " + str(max_error));
+  if (max_error > tolerance)
+    throw Exception ("connection probabilities differ between the contiguous cells and the pointer grid "
+        "(maximum relative difference " + str(max_error) + ")");
+}
+
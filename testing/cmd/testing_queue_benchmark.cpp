@@ -0,0 +1,253 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <atomic>
+#include <stack>
+
+#include "command.h"
+#include "timer.h"
+#include "thread.h"
+#include "thread_queue.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Measure the throughput of Thread::Queue as a function of the number of threads";
+
+  DESCRIPTION
+  + "Equal numbers of writer and reader threads are connected through a "
+    "queue, with the writers pushing a fixed total number of items, and the "
+    "readers summing their contents. The throughput is reported in items per "
+    "second, for the current Thread::Queue implementation and for a reference "
+    "implementation in which every push and pop is guarded by a single mutex. "
+    "The sum of all items read is also checked for each run.";
+
+  OPTIONS
+  + Option ("threads", "the numbers of writer (and reader) threads to test "
+      "(default: powers of two up to the number of threads available)")
+  +   Argument ("list").type_sequence_int()
+
+  + Option ("items", "the total number of items to push through the queue for each test (default: 1000000)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("capacity", "the capacity of the queue (default: " + str(MRTRIX_QUEUE_DEFAULT_CAPACITY) + ")")
+  +   Argument ("number").type_integer (1);
+}
+
+
+
+// reference implementation, with every operation guarded by a single mutex:
+template <class T> class MutexQueue { NOMEMALIGN
+  public:
+    MutexQueue (size_t capacity) :
+      buffer (capacity), front (0), back (0), count (0), writer_count (0), reader_count (0) { }
+
+    class Writer { NOMEMALIGN
+      public:
+        Writer (MutexQueue& queue) : Q (queue) { Q.register_writer(); }
+        Writer (const Writer& W) : Q (W.Q) { Q.register_writer(); }
+        class Item { NOMEMALIGN
+          public:
+            Item (const Writer& writer) : Q (writer.Q), p (Q.get_item()) { }
+            ~Item () { Q.unregister_writer(); }
+            bool write () { return Q.push (p); }
+            T& operator*() const { return *p; }
+          private:
+            MutexQueue& Q;
+            T* p;
+        };
+      private:
+        MutexQueue& Q;
+    };
+
+    class Reader { NOMEMALIGN
+      public:
+        Reader (MutexQueue& queue) : Q (queue) { Q.register_reader(); }
+        Reader (const Reader& R) : Q (R.Q) { Q.register_reader(); }
+        class Item { NOMEMALIGN
+          public:
+            Item (const Reader& reader) : Q (reader.Q), p (nullptr) { }
+            ~Item () { Q.unregister_reader(); }
+            bool read () { return Q.pop (p); }
+            T& operator*() const { return *p; }
+          private:
+            MutexQueue& Q;
+            T* p;
+        };
+      private:
+        MutexQueue& Q;
+    };
+
+  private:
+    std::mutex mutex;
+    std::condition_variable more_data, more_space;
+    vector<T*> buffer;
+    size_t front, back, count;
+    size_t writer_count, reader_count;
+    std::stack<T*,vector<T*>> item_stack;
+    vector<std::unique_ptr<T>> items;
+
+    void register_writer () { std::lock_guard<std::mutex> lock (mutex); ++writer_count; }
+    void register_reader () { std::lock_guard<std::mutex> lock (mutex); ++reader_count; }
+    void unregister_writer () {
+      std::lock_guard<std::mutex> lock (mutex);
+      if (!(--writer_count))
+        more_data.notify_all();
+    }
+    void unregister_reader () {
+      std::lock_guard<std::mutex> lock (mutex);
+      if (!(--reader_count))
+        more_space.notify_all();
+    }
+
+    T* get_item () {
+      std::lock_guard<std::mutex> lock (mutex);
+      items.push_back (std::unique_ptr<T> (new T));
+      return items.back().get();
+    }
+
+    bool push (T*& item) {
+      std::unique_lock<std::mutex> lock (mutex);
+      more_space.wait (lock, [this]{ return !(count == buffer.size() && reader_count); });
+      if (!reader_count) return false;
+      buffer[back] = item;
+      back = (back+1) % buffer.size();
+      ++count;
+      if (item_stack.empty()) {
+        items.push_back (std::unique_ptr<T> (new T));
+        item = items.back().get();
+      }
+      else {
+        item = item_stack.top();
+        item_stack.pop();
+      }
+      more_data.notify_one();
+      return true;
+    }
+
+    bool pop (T*& item) {
+      std::unique_lock<std::mutex> lock (mutex);
+      if (item)
+        item_stack.push (item);
+      item = nullptr;
+      more_data.wait (lock, [this]{ return !(!count && writer_count); });
+      if (!count && !writer_count)
+        return false;
+      item = buffer[front];
+      front = (front+1) % buffer.size();
+      --count;
+      more_space.notify_one();
+      return true;
+    }
+};
+
+
+
+
+template <class QueueType>
+class Source { NOMEMALIGN
+  public:
+    Source (QueueType& queue, size_t items_per_thread) : writer (queue), num (items_per_thread) { }
+    void execute () {
+      typename QueueType::Writer::Item item (writer);
+      for (size_t n = 0; n < num; ++n) {
+        *item = n;
+        if (!item.write())
+          return;
+      }
+    }
+  private:
+    typename QueueType::Writer writer;
+    const size_t num;
+};
+
+
+template <class QueueType>
+class Sink { NOMEMALIGN
+  public:
+    Sink (QueueType& queue, std::atomic<uint64_t>& total) : reader (queue), total (total) { }
+    void execute () {
+      typename QueueType::Reader::Item item (reader);
+      uint64_t sum = 0;
+      while (item.read())
+        sum += *item;
+      total += sum;
+    }
+  private:
+    typename QueueType::Reader reader;
+    std::atomic<uint64_t>& total;
+};
+
+
+
+template <class QueueType>
+double items_per_second (QueueType& queue, size_t nthreads, size_t items_per_thread)
+{
+  std::atomic<uint64_t> total (0);
+  Timer timer;
+  {
+    Source<QueueType> source (queue, items_per_thread);
+    Sink<QueueType> sink (queue, total);
+    auto sources = Thread::run (Thread::multi (source, nthreads), "sources");
+    auto sinks = Thread::run (Thread::multi (sink, nthreads), "sinks");
+    sources.wait();
+    sinks.wait();
+  }
+  const double elapsed = timer.elapsed();
+
+  const uint64_t expected = uint64_t (nthreads) * (uint64_t (items_per_thread) * (items_per_thread-1) / 2);
+  if (total != expected)
+    throw Exception ("checksum mismatch for queue with " + str(nthreads) + " threads: expected "
+        + str(expected) + ", got " + str(uint64_t (total)));
+
+  return nthreads * items_per_thread / elapsed;
+}
+
+
+
+void run ()
+{
+  vector<int> nthreads;
+  auto opt = get_options ("threads");
+  if (opt.size())
+    nthreads = opt[0][0].as_sequence_int();
+  else {
+    for (size_t n = 1; n < std::max (Thread::number_of_threads(), size_t(1)); n *= 2)
+      nthreads.push_back (n);
+    nthreads.push_back (std::max (Thread::number_of_threads(), size_t(1)));
+  }
+
+  const size_t total_items = get_option_value ("items", 1000000);
+  const size_t capacity = get_option_value ("capacity", MRTRIX_QUEUE_DEFAULT_CAPACITY);
+
+  for (auto n : nthreads) {
+    if (n < 1)
+      throw Exception ("number of threads must be positive");
+    const size_t items_per_thread = total_items / n;
+
+    Thread::Queue<uint64_t> queue ("benchmark", capacity);
+    const double current = items_per_second (queue, n, items_per_thread);
+
+    MutexQueue<uint64_t> reference (capacity);
+    const double mutex = items_per_second (reference, n, items_per_thread);
+
+    CONSOLE (str(n) + " writer/reader threads: Thread::Queue " + str(1.0e-6*current, 4)
+        + " Mitems/s, mutex-based " + str(1.0e-6*mutex, 4) + " Mitems/s (speedup " + str(current/mutex, 3) + ")");
+  }
+}
+
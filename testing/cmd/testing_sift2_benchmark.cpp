@@ -0,0 +1,246 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <mutex>
+#include <random>
+
+#include "command.h"
+#include "header.h"
+#include "timer.h"
+#include "thread.h"
+#include "thread_queue.h"
+#include "dwi/tractography/SIFT/track_contribution.h"
+#include "dwi/tractography/SIFT/track_index_range.h"
+#include "dwi/tractography/SIFT2/fixel.h"
+#include "dwi/tractography/SIFT2/fixel_updater.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Measure the scaling of the SIFT2 fixel update as a function of the number of threads";
+
+  DESCRIPTION
+  + "A synthetic set of streamline-fixel contributions is generated, in which "
+    "each streamline traverses a random walk through the fixel indices. The sums "
+    "of streamline weights and densities within each fixel are then computed as "
+    "in each iteration of SIFT2, with each thread accumulating into its own buffer. "
+    "The time taken is reported for the current implementation, in which these "
+    "buffers are reduced in parallel over ranges of fixels, and for a reference "
+    "implementation in which each thread adds its buffer to the fixels in turn "
+    "while holding a single mutex. The largest relative difference in fixel "
+    "density between the two is also reported.";
+
+  OPTIONS
+  + Option ("threads", "the numbers of threads to test (default: 8,32,64)")
+  +   Argument ("list").type_sequence_int()
+
+  + Option ("fixels", "the number of fixels (default: 1000000)")
+  +   Argument ("number").type_integer (2)
+
+  + Option ("streamlines", "the number of streamlines (default: 100000)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("length", "the number of fixels traversed by each streamline (default: 100)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("repeats", "the number of repeats of each test (default: 3)")
+  +   Argument ("number").type_integer (1);
+}
+
+
+
+using Buffer = SIFT2::FixelUpdater::Buffer;
+
+
+
+void accumulate (Buffer& buffer, const SIFT::TrackContributions& contributions, const vector<double>& coefficients, const SIFT::TrackIndexRange& range)
+{
+  for (SIFT::track_t track_index = range.first; track_index != range.second; ++track_index) {
+    const double coefficient = coefficients[track_index];
+    const SIFT::TrackContribution this_contribution (contributions[track_index]);
+    const double weighting_factor = std::exp (coefficient);
+    for (size_t j = 0; j != this_contribution.dim(); ++j) {
+      const size_t fixel_index = this_contribution[j].get_fixel_index();
+      const float length = this_contribution[j].get_length();
+      buffer.coeff_sums[fixel_index] += length * coefficient;
+      buffer.TDs       [fixel_index] += length * weighting_factor;
+      buffer.counts    [fixel_index]++;
+    }
+  }
+}
+
+
+
+// reference implementation, with each thread merging its buffer while holding a single mutex:
+class MutexUpdater { MEMALIGN(MutexUpdater)
+  public:
+    MutexUpdater (vector<SIFT2::Fixel>& fixels, const SIFT::TrackContributions& contributions, const vector<double>& coefficients, std::mutex& mutex) :
+      fixels (fixels), contributions (contributions), coefficients (coefficients), mutex (mutex), buffer (fixels.size()) { }
+    MutexUpdater (const MutexUpdater& that) :
+      fixels (that.fixels), contributions (that.contributions), coefficients (that.coefficients), mutex (that.mutex), buffer (fixels.size()) { }
+    ~MutexUpdater () {
+      std::lock_guard<std::mutex> lock (mutex);
+      for (size_t i = 0; i != fixels.size(); ++i) {
+        fixels[i].add_to_mean_coeff (buffer.coeff_sums[i]);
+        fixels[i].add_TD (buffer.TDs[i], buffer.counts[i]);
+      }
+    }
+    bool operator() (const SIFT::TrackIndexRange& range) {
+      accumulate (buffer, contributions, coefficients, range);
+      return true;
+    }
+  private:
+    vector<SIFT2::Fixel>& fixels;
+    const SIFT::TrackContributions& contributions;
+    const vector<double>& coefficients;
+    std::mutex& mutex;
+    Buffer buffer;
+};
+
+
+
+// current implementation, with per-thread buffers reduced over ranges of fixels:
+class ParallelUpdater { MEMALIGN(ParallelUpdater)
+  public:
+    ParallelUpdater (SIFT2::FixelUpdater::BufferList& buffers, const size_t num_fixels, const SIFT::TrackContributions& contributions, const vector<double>& coefficients, std::mutex& mutex) :
+      buffers (buffers), num_fixels (num_fixels), contributions (contributions), coefficients (coefficients), mutex (mutex), buffer (nullptr) { }
+    ParallelUpdater (const ParallelUpdater& that) :
+      buffers (that.buffers), num_fixels (that.num_fixels), contributions (that.contributions), coefficients (that.coefficients), mutex (that.mutex), buffer (nullptr) { }
+    bool operator() (const SIFT::TrackIndexRange& range) {
+      if (!buffer) {
+        std::unique_ptr<Buffer> new_buffer (new Buffer (num_fixels));
+        buffer = new_buffer.get();
+        std::lock_guard<std::mutex> lock (mutex);
+        buffers.push_back (std::move (new_buffer));
+      }
+      accumulate (*buffer, contributions, coefficients, range);
+      return true;
+    }
+  private:
+    SIFT2::FixelUpdater::BufferList& buffers;
+    const size_t num_fixels;
+    const SIFT::TrackContributions& contributions;
+    const vector<double>& coefficients;
+    std::mutex& mutex;
+    Buffer* buffer;
+};
+
+
+
+void clear (vector<SIFT2::Fixel>& fixels)
+{
+  for (auto& f : fixels) {
+    f.clear_TD();
+    f.clear_mean_coeff();
+  }
+}
+
+
+
+void run ()
+{
+  vector<int> threads = { 8, 32, 64 };
+  auto opt = get_options ("threads");
+  if (opt.size())
+    threads = opt[0][0].as_sequence_int();
+  const size_t num_fixels = get_option_value ("fixels", 1000000);
+  const size_t num_streamlines = get_option_value ("streamlines", 100000);
+  const size_t length = get_option_value ("length", 100);
+  const size_t repeats = get_option_value ("repeats", 3);
+
+  Header H;
+  H.ndim() = 3;
+  for (size_t axis = 0; axis != 3; ++axis)
+    H.spacing (axis) = 1.0;
+  SIFT::Track_fixel_contribution::set_scaling (H);
+
+  SIFT::TrackContributions contributions;
+  vector<double> coefficients (num_streamlines);
+  {
+    std::mt19937 rng (0);
+    std::uniform_int_distribution<size_t> start (1, num_fixels-1);
+    std::uniform_int_distribution<int> step (-10, 10);
+    std::uniform_real_distribution<float> segment (0.1, 1.0);
+    std::normal_distribution<double> coefficient (0.0, 0.5);
+    contributions.init (num_streamlines);
+    SIFT::TrackContributions::Buffer& buffer (contributions.create_buffer());
+    vector<SIFT::Track_fixel_contribution> tck;
+    for (size_t n = 0; n != num_streamlines; ++n) {
+      tck.clear();
+      int64_t fixel = start (rng);
+      float total_length = 0.0;
+      for (size_t i = 0; i != length; ++i) {
+        fixel = std::max (int64_t(1), std::min (int64_t(num_fixels-1), fixel + step (rng)));
+        const float l = segment (rng);
+        tck.push_back (SIFT::Track_fixel_contribution (fixel, l));
+        total_length += l;
+      }
+      buffer.add (n, tck, total_length, total_length);
+      coefficients[n] = coefficient (rng);
+    }
+    contributions.finalise();
+  }
+
+  vector<SIFT2::Fixel> mutex_fixels (num_fixels), parallel_fixels (num_fixels);
+  std::mutex mutex;
+
+  for (const auto nthreads : threads) {
+    if (nthreads < 1)
+      throw Exception ("number of threads must be positive");
+    double mutex_time = 0.0, parallel_time = 0.0;
+    for (size_t n = 0; n != repeats; ++n) {
+      clear (mutex_fixels);
+      {
+        Timer timer;
+        {
+          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_streamlines);
+          MutexUpdater updater (mutex_fixels, contributions, coefficients, mutex);
+          Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (updater, nthreads));
+        }
+        mutex_time += timer.elapsed();
+      }
+
+      clear (parallel_fixels);
+      {
+        Timer timer;
+        SIFT2::FixelUpdater::BufferList buffers;
+        {
+          SIFT::TrackIndexRangeWriter writer (SIFT_TRACK_INDEX_BUFFER_SIZE, num_streamlines);
+          ParallelUpdater updater (buffers, num_fixels, contributions, coefficients, mutex);
+          Thread::run_queue (writer, SIFT::TrackIndexRange(), Thread::multi (updater, nthreads));
+        }
+        SIFT2::FixelUpdater::reduce (parallel_fixels, buffers, nthreads);
+        parallel_time += timer.elapsed();
+      }
+    }
+
+    default_type max_error = 0.0;
+    for (size_t i = 0; i != num_fixels; ++i) {
+      if (mutex_fixels[i].get_count() != parallel_fixels[i].get_count())
+        throw Exception ("mismatch between fixel streamline counts of reference and parallel implementations");
+      if (mutex_fixels[i].get_TD())
+        max_error = std::max (max_error, std::abs (parallel_fixels[i].get_TD() / mutex_fixels[i].get_TD() - 1.0));
+    }
+
+    CONSOLE (str(nthreads) + " threads: mutex " + str(1.0e3*mutex_time/repeats, 4) + " ms, parallel "
+        + str(1.0e3*parallel_time/repeats, 4) + " ms (speedup " + str(mutex_time/parallel_time, 3)
+        + "), maximum relative difference " + str(max_error));
+  }
+}
+
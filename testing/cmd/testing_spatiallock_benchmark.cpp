@@ -0,0 +1,235 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <atomic>
+#include <mutex>
+#include <random>
+
+#include "command.h"
+#include "timer.h"
+#include "thread.h"
+#include "dwi/tractography/GT/spatiallock.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Measure the throughput of the global tractography spatial lock as a function of the number of threads";
+
+  DESCRIPTION
+  + "Each thread repeatedly locks a random position within a cubic volume, "
+    "as the MHSampler does for each proposal in tckglobal, performs a fixed "
+    "amount of computation standing in for the evaluation of the proposal, "
+    "and releases the lock. The throughput is reported in proposals per "
+    "second, for the current GT::SpatialLock implementation and for a "
+    "reference implementation in which every lock and unlock is guarded by a "
+    "single mutex, with a linear search over all active lock centres. The "
+    "number of conflicts between concurrently held locks is also checked.";
+
+  OPTIONS
+  + Option ("threads", "the numbers of threads to test "
+      "(default: powers of two up to the number of threads available)")
+  +   Argument ("list").type_sequence_int()
+
+  + Option ("proposals", "the number of proposals made by each thread for each test (default: 100000)")
+  +   Argument ("number").type_integer (1)
+
+  + Option ("extent", "the width of the volume within which positions are drawn, in mm (default: 100)")
+  +   Argument ("value").type_float (0.0)
+
+  + Option ("threshold", "the half-width of the region locked around each position, in mm (default: 5, "
+      "as for the default particle length in tckglobal)")
+  +   Argument ("value").type_float (0.0)
+
+  + Option ("work", "the number of iterations of dummy computation performed while each lock is held (default: 1000)")
+  +   Argument ("number").type_integer (0);
+}
+
+
+
+using point_type = Eigen::Vector3f;
+
+
+
+// reference implementation, with a single mutex and a linear search over all lock centres:
+class GlobalLock { NOMEMALIGN
+  public:
+    GlobalLock (float t) : threshold (t) { }
+
+    class Guard { NOMEMALIGN
+      public:
+        Guard (GlobalLock& l) : lock (l), idx (-1) { }
+        ~Guard () {
+          if (idx >= 0) {
+            std::lock_guard<std::mutex> guard (lock.mutex);
+            lock.lockcentres[idx].second = false;
+          }
+        }
+        bool try_lock (const point_type& pos) { return lock.try_lock (pos, idx); }
+      private:
+        GlobalLock& lock;
+        ssize_t idx;
+    };
+
+  private:
+    std::mutex mutex;
+    vector<std::pair<point_type, bool>> lockcentres;
+    const float threshold;
+
+    bool try_lock (const point_type& pos, ssize_t& idx) {
+      std::lock_guard<std::mutex> guard (mutex);
+      idx = -1;
+      ssize_t i = 0;
+      for (auto& x : lockcentres) {
+        if (x.second) {
+          const point_type d = x.first - pos;
+          if (std::fabs (d[0]) < threshold && std::fabs (d[1]) < threshold && std::fabs (d[2]) < threshold)
+            return false;
+        } else {
+          idx = i;
+        }
+        i++;
+      }
+      if (idx == -1) {
+        idx = lockcentres.size();
+        lockcentres.emplace_back (pos, true);
+      } else {
+        lockcentres[idx] = std::make_pair (pos, true);
+      }
+      return true;
+    }
+};
+
+
+
+// check that no two concurrently held locks conflict, using a list of one position per thread:
+class Checker { NOMEMALIGN
+  public:
+    Checker (size_t nthreads, float threshold) : held (nthreads), threshold (threshold), conflicts (0) { }
+    void enter (size_t thread, const point_type& pos) {
+      std::lock_guard<std::mutex> lock (mutex);
+      for (size_t n = 0; n != held.size(); ++n) {
+        if (n != thread && held[n].first) {
+          const point_type d = held[n].second - pos;
+          if (std::fabs (d[0]) < threshold && std::fabs (d[1]) < threshold && std::fabs (d[2]) < threshold)
+            ++conflicts;
+        }
+      }
+      held[thread] = std::make_pair (true, pos);
+    }
+    void leave (size_t thread) {
+      std::lock_guard<std::mutex> lock (mutex);
+      held[thread].first = false;
+    }
+    size_t count () const { return conflicts; }
+  private:
+    std::mutex mutex;
+    vector<std::pair<bool,point_type>> held;
+    const float threshold;
+    size_t conflicts;
+};
+
+
+
+template <class LockType>
+class Proposer { NOMEMALIGN
+  public:
+    Proposer (LockType& lock, Checker* checker, std::atomic<size_t>& thread_index, size_t proposals, float extent, size_t work) :
+      lock (lock), checker (checker), thread_index (thread_index), proposals (proposals), extent (extent), work (work) { }
+
+    void execute () {
+      const size_t index = thread_index++;
+      std::mt19937 rng (index);
+      std::uniform_real_distribution<float> uniform (0.0, extent);
+      volatile double sink = 0.0;
+      for (size_t n = 0; n != proposals; ++n) {
+        typename LockType::Guard guard (lock);
+        point_type pos;
+        do {
+          pos = point_type (uniform (rng), uniform (rng), uniform (rng));
+        } while (!guard.try_lock (pos));
+        if (checker)
+          checker->enter (index, pos);
+        double x = pos[0];
+        for (size_t i = 0; i != work; ++i)
+          x = x * 0.999 + 1.0e-3;
+        sink = sink + x;
+        if (checker)
+          checker->leave (index);
+      }
+    }
+
+  private:
+    LockType& lock;
+    Checker* checker;
+    std::atomic<size_t>& thread_index;
+    const size_t proposals;
+    const float extent;
+    const size_t work;
+};
+
+
+
+template <class LockType>
+double proposals_per_second (size_t nthreads, size_t proposals, float extent, float threshold, size_t work, Checker* checker = nullptr)
+{
+  LockType lock (threshold);
+  std::atomic<size_t> thread_index (0);
+  Proposer<LockType> proposer (lock, checker, thread_index, proposals, extent, work);
+  Timer timer;
+  Thread::run (Thread::multi (proposer, nthreads), "proposers").wait();
+  return nthreads * proposals / timer.elapsed();
+}
+
+
+
+void run ()
+{
+  vector<int> nthreads;
+  auto opt = get_options ("threads");
+  if (opt.size())
+    nthreads = opt[0][0].as_sequence_int();
+  else {
+    for (size_t n = 1; n < std::max (Thread::number_of_threads(), size_t(1)); n *= 2)
+      nthreads.push_back (n);
+    nthreads.push_back (std::max (Thread::number_of_threads(), size_t(1)));
+  }
+
+  const size_t proposals = get_option_value ("proposals", 100000);
+  const float extent = get_option_value ("extent", 100.0);
+  const float threshold = get_option_value ("threshold", 5.0);
+  const size_t work = get_option_value ("work", 1000);
+
+  for (auto n : nthreads) {
+    if (n < 1)
+      throw Exception ("number of threads must be positive");
+
+    const double current = proposals_per_second<GT::SpatialLock<float>> (n, proposals, extent, threshold, work);
+    const double reference = proposals_per_second<GlobalLock> (n, proposals, extent, threshold, work);
+
+    Checker checker (n, threshold);
+    proposals_per_second<GT::SpatialLock<float>> (n, std::max (proposals / 10, size_t(1)), extent, threshold, work, &checker);
+    if (checker.count())
+      throw Exception ("GT::SpatialLock allowed " + str(checker.count()) + " conflicting locks with " + str(n) + " threads");
+
+    CONSOLE (str(n) + " threads: GT::SpatialLock " + str(1.0e-3*current, 4)
+        + " kproposals/s, single mutex " + str(1.0e-3*reference, 4)
+        + " kproposals/s (speedup " + str(current/reference, 3) + ")");
+  }
+}
+
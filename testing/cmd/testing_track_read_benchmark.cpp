@@ -0,0 +1,119 @@
+/* Copyright (c) 2008-2017 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * MRtrix is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <sys/stat.h>
+
+#include "command.h"
+#include "timer.h"
+#include "dwi/tractography/file.h"
+#include "dwi/tractography/properties.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+void usage ()
+{
+  AUTHOR = "MRtrix3 contributors";
+
+  SYNOPSIS = "Compare the throughput of reading .tck and quantised (.tcq) track files";
+
+  DESCRIPTION
+  + "The input .tck file is converted to the quantised track file format, "
+    "and both files are then read in full a number of times using the "
+    "regular Reader class. The file sizes, the throughput in streamlines per "
+    "second, and the largest deviation of any vertex from its original "
+    "position are reported."
+
+  + "Both files will typically be held in the page cache after the first "
+    "pass, so that this measures the cost of decoding the data; when the "
+    "data must be fetched from storage, the smaller file size of the "
+    "quantised format provides a further advantage.";
+
+  ARGUMENTS
+  + Argument ("input", "the input .tck file").type_tracks_in()
+  + Argument ("output", "the path of the quantised track file to create").type_tracks_out();
+
+  OPTIONS
+  + Option ("repeats", "the number of passes over each file (default: 5)")
+  +   Argument ("number").type_integer (1);
+}
+
+
+
+int64_t file_size (const std::string& path)
+{
+  struct stat sbuf;
+  if (stat (path.c_str(), &sbuf))
+    throw Exception ("unable to query size of file \"" + path + "\": " + strerror (errno));
+  return sbuf.st_size;
+}
+
+
+
+double time_reading (const std::string& path, size_t repeats, size_t& count)
+{
+  Timer timer;
+  for (size_t n = 0; n < repeats; ++n) {
+    Properties properties;
+    Reader<float> reader (path, properties);
+    Streamline<float> tck;
+    count = 0;
+    while (reader (tck))
+      ++count;
+  }
+  return timer.elapsed() / repeats;
+}
+
+
+
+void run ()
+{
+  const size_t repeats = get_option_value ("repeats", 5);
+
+  {
+    Properties properties;
+    Reader<float> reader (argument[0], properties);
+    Writer<float> writer (argument[1], properties);
+    Streamline<float> tck;
+    while (reader (tck))
+      writer (tck);
+  }
+
+  default_type max_error = 0.0;
+  {
+    Properties properties, quantised_properties;
+    Reader<float> reader (argument[0], properties), quantised_reader (argument[1], quantised_properties);
+    Streamline<float> tck, quantised_tck;
+    while (reader (tck)) {
+      if (!quantised_reader (quantised_tck) || quantised_tck.size() != tck.size())
+        throw Exception ("mismatch between streamlines read from input and quantised track files");
+      for (size_t n = 0; n < tck.size(); ++n)
+        max_error = std::max (max_error, default_type ((tck[n] - quantised_tck[n]).cwiseAbs().maxCoeff()));
+    }
+  }
+
+  size_t count, quantised_count;
+  const double tck_time = time_reading (argument[0], repeats, count);
+  const double tcq_time = time_reading (argument[1], repeats, quantised_count);
+  if (count != quantised_count)
+    throw Exception ("mismatch between number of streamlines in input and quantised track files");
+
+  CONSOLE ("file size: .tck " + str(1.0e-6*file_size (argument[0]), 4) + " MB, .tcq "
+      + str(1.0e-6*file_size (argument[1]), 4) + " MB");
+  CONSOLE ("read throughput: .tck " + str(1.0e-6*count/tck_time, 4) + " Mtracks/s, .tcq "
+      + str(1.0e-6*count/tcq_time, 4) + " Mtracks/s (speedup " + str(tck_time/tcq_time, 3) + ")");
+  CONSOLE ("maximum vertex deviation: " + str(max_error) + " mm");
+}
+
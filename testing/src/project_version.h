@@ -0,0 +1 @@
+#define MRTRIX_PROJECT_VERSION "cf4a2332-dirty"